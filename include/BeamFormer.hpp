@@ -13,9 +13,16 @@
 // limitations under the License.
 
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
 
 #include <utils.hpp>
 #include <Observation.hpp>
+#include <Timer.hpp>
+#include <BufferPool.hpp>
+#include <Profiler.hpp>
 
 
 #ifndef BEAM_FORMER_HPP
@@ -23,13 +30,368 @@
 
 namespace RadioAstronomy {
 
+// The beam former stores either the dual-polarization voltages (p0_r, p0_i, p1_r, p1_i), or their Stokes I or IQUV parameters integrated in time
+enum OutputMode { OUTPUT_VOLTAGES = 0, OUTPUT_STOKES_I, OUTPUT_STOKES_IQUV };
+
+// Number of values per output sample: four for voltages and Stokes IQUV, one for Stokes I
+unsigned int getNrOutputValues(const OutputMode outputMode);
+// Stokes parameters are integrated over nrSamplesPerIntegration samples, voltages are never integrated
+unsigned int getNrOutputSamplesPerSecond(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration);
+unsigned int getNrOutputSamplesPerPaddedSecond(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration);
+// Stokes parameters need a second made of whole integrations, there is no output sample for a partial one
+bool isIntegrationValid(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration);
+// Throws std::invalid_argument if the integration is not valid for the observation
+void checkIntegration(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration);
+// Order of the output dimensions, fastest last; output samples are made of getNrOutputValues values, and are padded in every layout
+// LAYOUT_BEAM_CHANNEL_SAMPLE is [beam][channel][paddedOutputSample], LAYOUT_CHANNEL_BEAM_SAMPLE is [channel][beam][paddedOutputSample],
+// and LAYOUT_BEAM_SAMPLE_CHANNEL is [beam][paddedOutputSample][paddedChannel], the input of the dedispersion
+enum OutputLayout { LAYOUT_BEAM_CHANNEL_SAMPLE = 0, LAYOUT_CHANNEL_BEAM_SAMPLE, LAYOUT_BEAM_SAMPLE_CHANNEL };
+
+// Number of values in the output of a second
+unsigned int getOutputSize(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout);
+// Index of the first value of an output sample
+unsigned int getOutputIndex(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const unsigned int beam, const unsigned int channel, const unsigned int outputSample);
+// Distance, in values, between two consecutive output samples of the same beam and channel
+unsigned int getOutputSampleStride(const AstroData::Observation & observation, const OutputMode outputMode, const OutputLayout outputLayout);
+// The incoherent beam is the Stokes I of every station, averaged over the stations; it has the output samples of outputMode,
+// is organized as [channel][paddedOutputSample], and is computed in the same pass over the samples as the beams
+unsigned int getIncoherentOutputSize(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration);
+// Floating point operations of a second: 16 per beam, station and sample to weight and sum, 4 per beam and sample to average,
+// and 8 or 20 per beam and sample for Stokes I or IQUV, integration included
+double getBeamFormerFLOP(const AstroData::Observation & observation, const OutputMode outputMode);
+// Bytes moved in a second by the tiled CPU engines, with samples of inputSize and output of outputSize bytes:
+// the samples are read once per tile of nrBeamsPerTile beams, the weights are read and the output is written once
+double getBeamFormerTiledBytes(const AstroData::Observation & observation, const unsigned int nrBeamsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::size_t inputSize, const std::size_t outputSize);
+// Adds the Stokes parameters of the voltages to stokes; I = |p0|^2 + |p1|^2, Q = |p0|^2 - |p1|^2, U = 2 Re(p0 p1*), V = 2 Im(p0* p1)
+template< typename T > void integrateStokes(const OutputMode outputMode, const T * const voltages, T * const stokes);
+
+// Tuning parameters of the OpenCL kernel
+class BeamFormerConf {
+public:
+  BeamFormerConf();
+  ~BeamFormerConf();
+  // Get
+  bool getLocalMem() const;
+  unsigned int getNrSamplesPerBlock() const;
+  unsigned int getNrBeamsPerBlock() const;
+  unsigned int getNrChannelsPerBlock() const;
+  unsigned int getNrSamplesPerThread() const;
+  unsigned int getNrBeamsPerThread() const;
+  // Zero means that every work-item sums all the stations
+  unsigned int getNrStationsPerThread() const;
+  // Work-items summing different stations of the same samples and beams, whose partial beams are reduced in local memory
+  unsigned int getNrStationGroups(const AstroData::Observation & observation) const;
+  // Stations whose weights are staged together in local memory, zero means that weights are read from global memory
+  unsigned int getNrStationsPerBlock() const;
+  // With local memory, the samples of the next station are loaded while the current one is computed
+  bool getDoubleBuffer() const;
+  // Set
+  void setLocalMem(const bool local);
+  void setNrSamplesPerBlock(const unsigned int samples);
+  void setNrBeamsPerBlock(const unsigned int beams);
+  void setNrChannelsPerBlock(const unsigned int channels);
+  void setNrSamplesPerThread(const unsigned int samples);
+  void setNrBeamsPerThread(const unsigned int beams);
+  void setNrStationsPerThread(const unsigned int stations);
+  void setNrStationsPerBlock(const unsigned int stations);
+  void setDoubleBuffer(const bool buffer);
+  // Utils
+  // A configuration is valid for an observation if the work-items exactly cover samples, beams, channels and stations, and the integrations cover the second
+  bool isValid(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) const;
+  std::string print() const;
+
+private:
+  bool localMem;
+  unsigned int nrSamplesPerBlock;
+  unsigned int nrBeamsPerBlock;
+  unsigned int nrChannelsPerBlock;
+  unsigned int nrSamplesPerThread;
+  unsigned int nrBeamsPerThread;
+  unsigned int nrStationsPerThread;
+  unsigned int nrStationsPerBlock;
+  bool doubleBuffer;
+};
+
+// Signature of the functions computing a tile of the CPU engines
+template< typename I, typename T > struct TileFunction {
+  typedef void (* type)(const AstroData::Observation &, const I * const, const float * const, const unsigned int, const unsigned int, const unsigned int, const unsigned int, const unsigned int, const unsigned int, T * const);
+};
+
+// In the CPU algorithms samples are of type I, and are widened to T for accumulation and output
 // Sequential beam forming algorithm
-template< typename T > void beamFormer(const AstroData::Observation & observation, std::vector< T > & samples, std::vector< T > & output, std::vector< float > & weights);
-// OpenCL beam forming algorithm
-std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamplesPerBlock, const unsigned int nrBeamsPerBlock, const unsigned int nrSamplesPerThread, const unsigned int nrBeamsPerThread, const std::string & dataType, const AstroData::Observation & observation);
+template< typename I, typename T > void beamFormer(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE);
+// Sums only the stations in activeStations, and averages over their number; flagged stations are never read
+template< typename I, typename T > void beamFormer(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const std::vector< unsigned int > & activeStations, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE);
+// Compacts a station mask, with one element per station and true for the flagged ones, in the increasing indices of the active stations
+void getActiveStations(const std::vector< bool > & flagged, std::vector< unsigned int > & activeStations);
+// Parallel, cache-blocked beam forming algorithm
+template< typename I, typename T > void beamFormerParallel(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE, Profiler * profiler = 0);
+// With incoherent, the tiles of the first beams also compute the incoherent beam, while their samples are still in cache
+// With profiler, the compute, store and incoherent stages of the run are recorded
+template< typename I, typename T > void beamFormerTiled(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction, std::vector< T > * incoherent = 0, Profiler * profiler = 0);
+// Same engine on samples that are not in a vector, e.g. a second of a memory-mapped StationDataFile
+template< typename I, typename T > void beamFormerTiled(const AstroData::Observation & observation, const I * const samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction, std::vector< T > * incoherent = 0, Profiler * profiler = 0);
+// Averages the accumulators of a tile and stores them in the output layout
+template< typename T > void beamFormerStoreTile(const AstroData::Observation & observation, const T * const accumulators, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, T * const output);
+// Computes the non averaged beams of a tile; accumulators are organized as [beam][sample][4]
+template< typename I, typename T > void beamFormerTile(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, T * const accumulators);
+// Sequential incoherent beam of the active stations
+template< typename I, typename T > void beamFormerIncoherent(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & incoherent, const std::vector< unsigned int > & activeStations, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1);
+// Stores the incoherent beam of the active stations for the samples of a tile; tiles contain whole integrations
+template< typename I, typename T > void beamFormerIncoherentTile(const AstroData::Observation & observation, const I * const samples, const std::vector< unsigned int > & activeStations, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, T * const incoherent);
+// Parallel beam forming algorithm for few tiles and many stations: the stations of every tile are split in groups of nrStationsPerThread,
+// the threads compute the partial beams of the groups, and the partial beams are reduced in a tree; with profiler, the compute, reduce and store stages are recorded
+template< typename I, typename T > void beamFormerParallelStations(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const unsigned int nrStationsPerThread, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE, typename TileFunction< I, T >::type tileFunction = beamFormerTile< I, T >, Profiler * profiler = 0);
+// OpenCL beam forming algorithm; for Stokes output with nrSamplesPerIntegration > 1, the integration must divide nrSamplesPerBlock * nrSamplesPerThread
+// Work-groups contain nrChannelsPerBlock channels; with LAYOUT_BEAM_SAMPLE_CHANNEL their output is transposed in local memory and stored in runs of nrChannelsPerBlock channels
+// With generateWeights the third argument of the kernel is the geometry table of BeamFormerWeights.hpp instead of the weights
+// With nrStationsPerThread > 0 the third dimension of the work-groups is nrChannelsPerBlock * nrStationGroups, every work-item sums nrStationsPerThread stations
+// and the partial beams are reduced in local memory
+// With nrStationsPerBlock > 0 the weights of that many stations are staged in local memory, unless generateWeights; with local and doubleBuffer
+// the samples of the next station are loaded in a second local buffer while the current one is computed
+// With generic, beams, stations, channels, samples and padding are kernel arguments instead of constants; see getBeamFormerGenericOpenCL
+// With flagging, only the stations of an active station list are summed; see getBeamFormerFlaggingOpenCL
+// With incoherent, the last argument of the kernel is the output of the incoherent beam, of type dataType
+std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamplesPerBlock, const unsigned int nrBeamsPerBlock, const unsigned int nrChannelsPerBlock, const unsigned int nrSamplesPerThread, const unsigned int nrBeamsPerThread, const unsigned int nrStationsPerThread, const unsigned int nrStationsPerBlock, const bool doubleBuffer, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool generic = false, const bool flagging = false, const bool incoherent = false);
+std::string * getBeamFormerOpenCL(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent = false);
+// Kernel that can be compiled once and run on any observation for which conf is valid; the geometry follows the first three arguments:
+// nrBeams, nrPaddedBeams, nrStations, nrChannels, nrPaddedChannels, nrSamplesPerPaddedSecond and nrOutputSamplesPerPaddedSecond
+// The stations are neither split over work-items nor blocked: conf must have nrStationsPerThread and nrStationsPerBlock equal to zero, or std::invalid_argument is thrown
+std::string * getBeamFormerGenericOpenCL(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent = false);
+// Kernel that sums only the stations of the active station list, and averages over their number; the list follows the first three arguments:
+// activeStations, a buffer of at least one station index as made by getActiveStations, and nrActiveStations
+// The list can change between runs without generating the kernel again; the stations are neither split over work-items nor blocked,
+// so conf must have nrStationsPerThread and nrStationsPerBlock equal to zero, or std::invalid_argument is thrown
+std::string * getBeamFormerFlaggingOpenCL(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent = false);
+// Same code as getBeamFormerOpenCL, generated only once per process for each set of parameters
+const std::string & getBeamFormerOpenCLMemo(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent = false);
+// OpenCL expression of the index of an output sample, in elements of the output type
+std::string getOutputIndexOpenCL(const std::string & beam, const std::string & channel, const std::string & outputSample, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const AstroData::Observation & observation, const bool generic = false);
+// A geometry value in the OpenCL code: the constant value, or the expression of the kernel arguments in the generic kernel
+std::string getGeometryOpenCL(const bool generic, const unsigned int value, const std::string & expression);
+// OpenCL expression that loads a sample of type inputDataType4 (vload_half4 for half) and widens it to dataType4
+std::string getLoadSampleOpenCL(const std::string & index, const std::string & inputDataType, const std::string & dataType);
 
 // Implementations
-template< typename T > void beamFormer(const AstroData::Observation & observation, std::vector< T > & samples, std::vector< T > & output, std::vector< float > & weights) {
+BeamFormerConf::BeamFormerConf() : localMem(false), nrSamplesPerBlock(1), nrBeamsPerBlock(1), nrChannelsPerBlock(1), nrSamplesPerThread(1), nrBeamsPerThread(1), nrStationsPerThread(0), nrStationsPerBlock(0), doubleBuffer(false) {}
+
+BeamFormerConf::~BeamFormerConf() {}
+
+bool BeamFormerConf::isValid(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) const {
+  if ( (observation.getNrSamplesPerPaddedSecond() % (nrSamplesPerBlock * nrSamplesPerThread)) != 0 ) {
+    return false;
+  } else if ( (observation.getNrBeams() % (nrBeamsPerBlock * nrBeamsPerThread)) != 0 ) {
+    return false;
+  } else if ( (observation.getNrChannels() % nrChannelsPerBlock) != 0 ) {
+    return false;
+  } else if ( (nrStationsPerThread > 0) && ((observation.getNrStations() % nrStationsPerThread) != 0) ) {
+    return false;
+  } else if ( (nrStationsPerBlock > 0) && (nrStationsPerThread > 0) && ((nrStationsPerThread % nrStationsPerBlock) != 0) ) {
+    return false;
+  } else if ( (nrStationsPerBlock > 0) && (nrStationsPerThread == 0) && ((observation.getNrStations() % nrStationsPerBlock) != 0) ) {
+    return false;
+  } else if ( doubleBuffer && !localMem ) {
+    return false;
+  } else if ( (outputMode != OUTPUT_VOLTAGES) && (((nrSamplesPerBlock * nrSamplesPerThread) % nrSamplesPerIntegration) != 0) ) {
+    return false;
+  } else if ( !isIntegrationValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    return false;
+  }
+  return true;
+}
+
+inline bool BeamFormerConf::getLocalMem() const {
+  return localMem;
+}
+
+inline unsigned int BeamFormerConf::getNrSamplesPerBlock() const {
+  return nrSamplesPerBlock;
+}
+
+inline unsigned int BeamFormerConf::getNrBeamsPerBlock() const {
+  return nrBeamsPerBlock;
+}
+
+inline unsigned int BeamFormerConf::getNrChannelsPerBlock() const {
+  return nrChannelsPerBlock;
+}
+
+inline unsigned int BeamFormerConf::getNrSamplesPerThread() const {
+  return nrSamplesPerThread;
+}
+
+inline unsigned int BeamFormerConf::getNrBeamsPerThread() const {
+  return nrBeamsPerThread;
+}
+
+inline unsigned int BeamFormerConf::getNrStationsPerThread() const {
+  return nrStationsPerThread;
+}
+
+unsigned int BeamFormerConf::getNrStationGroups(const AstroData::Observation & observation) const {
+  if ( nrStationsPerThread == 0 ) {
+    return 1;
+  }
+  return observation.getNrStations() / nrStationsPerThread;
+}
+
+inline unsigned int BeamFormerConf::getNrStationsPerBlock() const {
+  return nrStationsPerBlock;
+}
+
+inline bool BeamFormerConf::getDoubleBuffer() const {
+  return doubleBuffer;
+}
+
+inline void BeamFormerConf::setLocalMem(const bool local) {
+  localMem = local;
+}
+
+inline void BeamFormerConf::setNrSamplesPerBlock(const unsigned int samples) {
+  nrSamplesPerBlock = samples;
+}
+
+inline void BeamFormerConf::setNrBeamsPerBlock(const unsigned int beams) {
+  nrBeamsPerBlock = beams;
+}
+
+inline void BeamFormerConf::setNrChannelsPerBlock(const unsigned int channels) {
+  nrChannelsPerBlock = channels;
+}
+
+inline void BeamFormerConf::setNrSamplesPerThread(const unsigned int samples) {
+  nrSamplesPerThread = samples;
+}
+
+inline void BeamFormerConf::setNrBeamsPerThread(const unsigned int beams) {
+  nrBeamsPerThread = beams;
+}
+
+inline void BeamFormerConf::setNrStationsPerThread(const unsigned int stations) {
+  nrStationsPerThread = stations;
+}
+
+inline void BeamFormerConf::setNrStationsPerBlock(const unsigned int stations) {
+  nrStationsPerBlock = stations;
+}
+
+inline void BeamFormerConf::setDoubleBuffer(const bool buffer) {
+  doubleBuffer = buffer;
+}
+
+std::string BeamFormerConf::print() const {
+  return isa::utils::toString(localMem) + " " + isa::utils::toString(nrSamplesPerBlock) + " " + isa::utils::toString(nrBeamsPerBlock) + " " + isa::utils::toString(nrSamplesPerThread) + " " + isa::utils::toString(nrBeamsPerThread) + " " + isa::utils::toString(nrChannelsPerBlock) + " " + isa::utils::toString(nrStationsPerThread) + " " + isa::utils::toString(nrStationsPerBlock) + " " + isa::utils::toString(doubleBuffer);
+}
+
+unsigned int getNrOutputValues(const OutputMode outputMode) {
+  if ( outputMode == OUTPUT_STOKES_I ) {
+    return 1;
+  }
+  return 4;
+}
+
+unsigned int getNrOutputSamplesPerSecond(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  if ( outputMode == OUTPUT_VOLTAGES ) {
+    return observation.getNrSamplesPerSecond();
+  }
+  return observation.getNrSamplesPerSecond() / nrSamplesPerIntegration;
+}
+
+unsigned int getNrOutputSamplesPerPaddedSecond(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  if ( outputMode == OUTPUT_VOLTAGES ) {
+    return observation.getNrSamplesPerPaddedSecond();
+  }
+  return isa::utils::pad(observation.getNrSamplesPerSecond() / nrSamplesPerIntegration, observation.getPadding());
+}
+
+bool isIntegrationValid(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  if ( outputMode == OUTPUT_VOLTAGES ) {
+    return true;
+  }
+  return (nrSamplesPerIntegration > 0) && ((observation.getNrSamplesPerSecond() % nrSamplesPerIntegration) == 0);
+}
+
+void checkIntegration(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  if ( !isIntegrationValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    throw std::invalid_argument("The integration of " + isa::utils::toString(nrSamplesPerIntegration) + " samples does not divide the " + isa::utils::toString(observation.getNrSamplesPerSecond()) + " samples of a second.");
+  }
+}
+
+unsigned int getOutputSize(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout) {
+  if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    return observation.getNrBeams() * getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration) * observation.getNrPaddedChannels() * getNrOutputValues(outputMode);
+  }
+  return observation.getNrBeams() * observation.getNrChannels() * getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration) * getNrOutputValues(outputMode);
+}
+
+unsigned int getIncoherentOutputSize(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  return observation.getNrChannels() * getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration);
+}
+
+double getBeamFormerFLOP(const AstroData::Observation & observation, const OutputMode outputMode) {
+  const double nrBeamSamples = static_cast< double >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerSecond();
+  double flop = (nrBeamSamples * observation.getNrStations() * 16) + (nrBeamSamples * 4);
+
+  if ( outputMode == OUTPUT_STOKES_I ) {
+    flop += nrBeamSamples * 8;
+  } else if ( outputMode == OUTPUT_STOKES_IQUV ) {
+    flop += nrBeamSamples * 20;
+  }
+  return flop;
+}
+
+double getBeamFormerTiledBytes(const AstroData::Observation & observation, const unsigned int nrBeamsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::size_t inputSize, const std::size_t outputSize) {
+  const double nrBeamTiles = (observation.getNrBeams() + nrBeamsPerTile - 1) / nrBeamsPerTile;
+  const double samplesBytes = static_cast< double >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations() * 4 * inputSize;
+  const double outputBytes = static_cast< double >(observation.getNrBeams()) * observation.getNrChannels() * getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration) * getNrOutputValues(outputMode) * outputSize;
+  const double weightsBytes = static_cast< double >(observation.getNrChannels()) * observation.getNrStations() * observation.getNrBeams() * 2 * sizeof(float);
+
+  return (samplesBytes * nrBeamTiles) + outputBytes + weightsBytes;
+}
+
+unsigned int getOutputIndex(const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const unsigned int beam, const unsigned int channel, const unsigned int outputSample) {
+  const unsigned int nrOutputSamples = getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration);
+
+  if ( outputLayout == LAYOUT_CHANNEL_BEAM_SAMPLE ) {
+    return ((channel * observation.getNrBeams() * nrOutputSamples) + (beam * nrOutputSamples) + outputSample) * getNrOutputValues(outputMode);
+  } else if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    return ((beam * nrOutputSamples * observation.getNrPaddedChannels()) + (outputSample * observation.getNrPaddedChannels()) + channel) * getNrOutputValues(outputMode);
+  }
+  return ((beam * observation.getNrChannels() * nrOutputSamples) + (channel * nrOutputSamples) + outputSample) * getNrOutputValues(outputMode);
+}
+
+unsigned int getOutputSampleStride(const AstroData::Observation & observation, const OutputMode outputMode, const OutputLayout outputLayout) {
+  if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    return observation.getNrPaddedChannels() * getNrOutputValues(outputMode);
+  }
+  return getNrOutputValues(outputMode);
+}
+
+template< typename T > void integrateStokes(const OutputMode outputMode, const T * const voltages, T * const stokes) {
+  const T powerP0 = (voltages[0] * voltages[0]) + (voltages[1] * voltages[1]);
+  const T powerP1 = (voltages[2] * voltages[2]) + (voltages[3] * voltages[3]);
+
+  stokes[0] += powerP0 + powerP1;
+  if ( outputMode == OUTPUT_STOKES_IQUV ) {
+    stokes[1] += powerP0 - powerP1;
+    stokes[2] += 2 * ((voltages[0] * voltages[2]) + (voltages[1] * voltages[3]));
+    stokes[3] += 2 * ((voltages[0] * voltages[3]) - (voltages[1] * voltages[2]));
+  }
+}
+
+template< typename I, typename T > void beamFormer(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout) {
+  std::vector< unsigned int > activeStations(observation.getNrStations());
+
+  for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+    activeStations[station] = station;
+  }
+  beamFormer< I, T >(observation, samples, output, weights, activeStations, outputMode, nrSamplesPerIntegration, outputLayout);
+}
+
+template< typename I, typename T > void beamFormer(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const std::vector< unsigned int > & activeStations, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout) {
+  const unsigned int nrOutputValues = getNrOutputValues(outputMode);
+
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
   for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
     for ( unsigned int sample = 0; sample < observation.getNrSamplesPerSecond(); sample++ ) {
       for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
@@ -38,82 +400,691 @@ template< typename T > void beamFormer(const AstroData::Observation & observatio
         T beamP1_r = 0;
         T beamP1_i = 0;
 
-        for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
-          T * samplePointer = &(samples.data()[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (station * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4)]); 
-          float * weightPointer = &(weights.data()[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (station * observation.getNrPaddedBeams() * 2) + (beam * 2)]);
+        for ( std::vector< unsigned int >::const_iterator station = activeStations.begin(); station != activeStations.end(); ++station ) {
+          I * samplePointer = &(samples.data()[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (*station * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4)]); 
+          float * weightPointer = &(weights.data()[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (*station * observation.getNrPaddedBeams() * 2) + (beam * 2)]);
 
           beamP0_r += (samplePointer[0] * weightPointer[0]) - (samplePointer[1] * weightPointer[1]);
           beamP0_i += (samplePointer[0] * weightPointer[1]) + (samplePointer[1] * weightPointer[0]);
           beamP1_r += (samplePointer[2] * weightPointer[0]) - (samplePointer[3] * weightPointer[1]);
           beamP1_i += (samplePointer[2] * weightPointer[1]) + (samplePointer[3] * weightPointer[0]);
         }
-        beamP0_r /= observation.getNrStations();
-        beamP0_i /= observation.getNrStations();
-        beamP1_r /= observation.getNrStations();
-        beamP1_i /= observation.getNrStations();
-        output[(beam * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4) + (channel * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4)] = beamP0_r;
-        output[(beam * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4) + (channel * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4) + 1] = beamP0_i;
-        output[(beam * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4) + (channel * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4) + 2] = beamP1_r;
-        output[(beam * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4) + (channel * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4) + 3] = beamP1_i;
+        beamP0_r /= activeStations.size();
+        beamP0_i /= activeStations.size();
+        beamP1_r /= activeStations.size();
+        beamP1_i /= activeStations.size();
+        if ( outputMode == OUTPUT_VOLTAGES ) {
+          T * voltagesPointer = &(output.data()[getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, beam, channel, sample)]);
+
+          voltagesPointer[0] = beamP0_r;
+          voltagesPointer[1] = beamP0_i;
+          voltagesPointer[2] = beamP1_r;
+          voltagesPointer[3] = beamP1_i;
+        } else {
+          const T voltages[4] = {beamP0_r, beamP0_i, beamP1_r, beamP1_i};
+          T * stokesPointer = &(output.data()[getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, beam, channel, sample / nrSamplesPerIntegration)]);
+
+          if ( (sample % nrSamplesPerIntegration) == 0 ) {
+            std::fill(stokesPointer, stokesPointer + nrOutputValues, 0);
+          }
+          integrateStokes< T >(outputMode, voltages, stokesPointer);
+        }
+      }
+    }
+  }
+}
+
+void getActiveStations(const std::vector< bool > & flagged, std::vector< unsigned int > & activeStations) {
+  activeStations.clear();
+  for ( unsigned int station = 0; station < flagged.size(); station++ ) {
+    if ( !flagged[station] ) {
+      activeStations.push_back(station);
+    }
+  }
+}
+
+template< typename I, typename T > void beamFormerParallel(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, Profiler * profiler) {
+  beamFormerTiled< I, T >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, beamFormerTile< I, T >, 0, profiler);
+}
+
+template< typename I, typename T > void beamFormerTiled(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction, std::vector< T > * incoherent, Profiler * profiler) {
+  beamFormerTiled< I, T >(observation, static_cast< const I * >(samples.data()), output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, tileFunction, incoherent, profiler);
+}
+
+template< typename I, typename T > void beamFormerTiled(const AstroData::Observation & observation, const I * const samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction, std::vector< T > * incoherent, Profiler * profiler) {
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
+  // Tiles contain whole integrations
+  const unsigned int nrSamplesPerIntegratedTile = (outputMode == OUTPUT_VOLTAGES) ? nrSamplesPerTile : isa::utils::pad(nrSamplesPerTile, nrSamplesPerIntegration);
+  const unsigned int nrSampleTiles = (observation.getNrSamplesPerSecond() + nrSamplesPerIntegratedTile - 1) / nrSamplesPerIntegratedTile;
+  const unsigned int nrBeamTiles = (observation.getNrBeams() + nrBeamsPerTile - 1) / nrBeamsPerTile;
+  const long long int nrTiles = static_cast< long long int >(observation.getNrChannels()) * nrSampleTiles * nrBeamTiles;
+  std::vector< unsigned int > activeStations;
+  if ( incoherent != 0 ) {
+    activeStations.resize(observation.getNrStations());
+    for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+      activeStations[station] = station;
+    }
+  }
+  // Busy time of the threads in every stage
+  const double started = (profiler != 0) ? profiler->now() : 0.0;
+  double computeTime = 0.0;
+  double storeTime = 0.0;
+  double incoherentTime = 0.0;
+  unsigned int nrThreads = 0;
+
+  // Every (channel, sample tile, beam tile) triplet is independent, so they are all distributed over the threads
+  #pragma omp parallel
+  {
+    AlignedBuffer< T > * accumulators = getScratchPool< T >().acquire(nrBeamsPerTile * nrSamplesPerIntegratedTile * 4);
+    isa::utils::Timer computeTimer;
+    isa::utils::Timer storeTimer;
+    isa::utils::Timer incoherentTimer;
+
+    #pragma omp for schedule(dynamic)
+    for ( long long int tile = 0; tile < nrTiles; tile++ ) {
+      const unsigned int channel = tile / (nrSampleTiles * nrBeamTiles);
+      const unsigned int firstSample = ((tile / nrBeamTiles) % nrSampleTiles) * nrSamplesPerIntegratedTile;
+      const unsigned int firstBeam = (tile % nrBeamTiles) * nrBeamsPerTile;
+      const unsigned int nrTileSamples = std::min(nrSamplesPerIntegratedTile, observation.getNrSamplesPerSecond() - firstSample);
+      const unsigned int nrTileBeams = std::min(nrBeamsPerTile, observation.getNrBeams() - firstBeam);
+
+      if ( profiler != 0 ) {
+        computeTimer.start();
+      }
+      tileFunction(observation, samples, weights.data(), channel, firstSample, nrTileSamples, firstBeam, nrTileBeams, nrStationsPerTile, accumulators->data());
+      if ( profiler != 0 ) {
+        computeTimer.stop();
+        storeTimer.start();
+      }
+      beamFormerStoreTile< T >(observation, accumulators->data(), channel, firstSample, nrTileSamples, firstBeam, nrTileBeams, outputMode, nrSamplesPerIntegration, outputLayout, output.data());
+      if ( profiler != 0 ) {
+        storeTimer.stop();
+      }
+      if ( (incoherent != 0) && (firstBeam == 0) ) {
+        if ( profiler != 0 ) {
+          incoherentTimer.start();
+        }
+        beamFormerIncoherentTile< I, T >(observation, samples, activeStations, channel, firstSample, nrTileSamples, outputMode, nrSamplesPerIntegration, incoherent->data());
+        if ( profiler != 0 ) {
+          incoherentTimer.stop();
+        }
+      }
+    }
+    getScratchPool< T >().release(accumulators);
+    if ( profiler != 0 ) {
+      #pragma omp critical (beamFormerProfiler)
+      {
+        computeTime += computeTimer.getTotalTime();
+        storeTime += storeTimer.getTotalTime();
+        incoherentTime += incoherentTimer.getTotalTime();
+        nrThreads++;
       }
     }
   }
+  if ( profiler != 0 ) {
+    const double ended = profiler->now();
+    const std::string configuration = isa::utils::toString(nrSamplesPerTile) + " " + isa::utils::toString(nrBeamsPerTile) + " " + isa::utils::toString(nrStationsPerTile);
+    const double nrSamples = static_cast< double >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations();
+    const double computeFLOP = nrSamples * observation.getNrBeams() * 16;
+
+    // The samples of a tile are read once per beam tile
+    profiler->record("compute", configuration, started, ended, computeTime / nrThreads, computeFLOP, (nrSamples * nrBeamTiles * 4 * sizeof(I)) + (weights.size() * sizeof(float)));
+    profiler->record("store", configuration, started, ended, storeTime / nrThreads, getBeamFormerFLOP(observation, outputMode) - computeFLOP, output.size() * sizeof(T));
+    if ( incoherent != 0 ) {
+      profiler->record("incoherent", configuration, started, ended, incoherentTime / nrThreads, nrSamples * 8, (nrSamples * 4 * sizeof(I)) + (incoherent->size() * sizeof(T)));
+    }
+  }
 }
 
-std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamplesPerBlock, const unsigned int nrBeamsPerBlock, const unsigned int nrSamplesPerThread, const unsigned int nrBeamsPerThread, const std::string & dataType, const AstroData::Observation & observation) {
+template< typename I, typename T > void beamFormerIncoherent(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & incoherent, const std::vector< unsigned int > & activeStations, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
+  for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+    beamFormerIncoherentTile< I, T >(observation, samples.data(), activeStations, channel, 0, observation.getNrSamplesPerSecond(), outputMode, nrSamplesPerIntegration, incoherent.data());
+  }
+}
+
+template< typename I, typename T > void beamFormerIncoherentTile(const AstroData::Observation & observation, const I * const samples, const std::vector< unsigned int > & activeStations, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, T * const incoherent) {
+  // Voltages are never integrated
+  const unsigned int nrSamplesPerOutput = (outputMode == OUTPUT_VOLTAGES) ? 1 : nrSamplesPerIntegration;
+  const unsigned int nrTileOutputSamples = (nrTileSamples + nrSamplesPerOutput - 1) / nrSamplesPerOutput;
+  T * const incoherentPointer = &(incoherent[(channel * getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration)) + (firstSample / nrSamplesPerOutput)]);
+
+  std::fill(incoherentPointer, incoherentPointer + nrTileOutputSamples, 0);
+  for ( std::vector< unsigned int >::const_iterator station = activeStations.begin(); station != activeStations.end(); ++station ) {
+    const I * const samplePointer = &(samples[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (*station * observation.getNrSamplesPerPaddedSecond() * 4) + (firstSample * 4)]);
+
+    for ( unsigned int sample = 0; sample < nrTileSamples; sample++ ) {
+      const T p0_r = samplePointer[(sample * 4)];
+      const T p0_i = samplePointer[(sample * 4) + 1];
+      const T p1_r = samplePointer[(sample * 4) + 2];
+      const T p1_i = samplePointer[(sample * 4) + 3];
+
+      incoherentPointer[sample / nrSamplesPerOutput] += (p0_r * p0_r) + (p0_i * p0_i) + (p1_r * p1_r) + (p1_i * p1_i);
+    }
+  }
+  for ( unsigned int sample = 0; sample < nrTileOutputSamples; sample++ ) {
+    incoherentPointer[sample] /= activeStations.size();
+  }
+}
+
+template< typename I, typename T > void beamFormerParallelStations(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const unsigned int nrStationsPerThread, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction, Profiler * profiler) {
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
+  const unsigned int nrSamplesPerIntegratedTile = (outputMode == OUTPUT_VOLTAGES) ? nrSamplesPerTile : isa::utils::pad(nrSamplesPerTile, nrSamplesPerIntegration);
+  const unsigned int nrSampleTiles = (observation.getNrSamplesPerSecond() + nrSamplesPerIntegratedTile - 1) / nrSamplesPerIntegratedTile;
+  const unsigned int nrBeamTiles = (observation.getNrBeams() + nrBeamsPerTile - 1) / nrBeamsPerTile;
+  const long long int nrTiles = static_cast< long long int >(observation.getNrChannels()) * nrSampleTiles * nrBeamTiles;
+  const unsigned int nrStationGroups = (observation.getNrStations() + nrStationsPerThread - 1) / nrStationsPerThread;
+  const unsigned int nrPartialValues = nrBeamsPerTile * nrSamplesPerIntegratedTile * 4;
+  // Partial beams of the station groups of a tile, organized as [group][beam][sample][4]
+  AlignedBuffer< T > * partialsBuffer = getScratchPool< T >().acquire(nrStationGroups * nrPartialValues);
+  T * const partials = partialsBuffer->data();
+  // Busy time of the threads in every stage, barriers included
+  const double started = (profiler != 0) ? profiler->now() : 0.0;
+  double computeTime = 0.0;
+  double reduceTime = 0.0;
+  double storeTime = 0.0;
+  unsigned int nrThreads = 0;
+
+  #pragma omp parallel
+  {
+    isa::utils::Timer computeTimer;
+    isa::utils::Timer reduceTimer;
+    isa::utils::Timer storeTimer;
+
+    // The tiles are computed one after the other, the station groups of a tile in parallel
+    for ( long long int tile = 0; tile < nrTiles; tile++ ) {
+      const unsigned int channel = tile / (nrSampleTiles * nrBeamTiles);
+      const unsigned int firstSample = ((tile / nrBeamTiles) % nrSampleTiles) * nrSamplesPerIntegratedTile;
+      const unsigned int firstBeam = (tile % nrBeamTiles) * nrBeamsPerTile;
+      const unsigned int nrTileSamples = std::min(nrSamplesPerIntegratedTile, observation.getNrSamplesPerSecond() - firstSample);
+      const unsigned int nrTileBeams = std::min(nrBeamsPerTile, observation.getNrBeams() - firstBeam);
+      const unsigned int nrTileValues = nrTileBeams * nrTileSamples * 4;
+
+      if ( profiler != 0 ) {
+        computeTimer.start();
+      }
+      #pragma omp for schedule(static)
+      for ( int group = 0; group < static_cast< int >(nrStationGroups); group++ ) {
+        // A group is seen by the tile function as the only channel of an observation with its stations
+        const unsigned int firstStation = group * nrStationsPerThread;
+        AstroData::Observation groupObservation(observation);
+
+        groupObservation.setNrStations(std::min(nrStationsPerThread, observation.getNrStations() - firstStation));
+        tileFunction(groupObservation, &(samples.data()[((channel * observation.getNrStations()) + firstStation) * observation.getNrSamplesPerPaddedSecond() * 4]), &(weights.data()[((channel * observation.getNrStations()) + firstStation) * observation.getNrPaddedBeams() * 2]), 0, firstSample, nrTileSamples, firstBeam, nrTileBeams, nrStationsPerTile, &(partials[group * nrPartialValues]));
+      }
+      if ( profiler != 0 ) {
+        computeTimer.stop();
+        reduceTimer.start();
+      }
+      for ( unsigned int step = 1; step < nrStationGroups; step *= 2 ) {
+        #pragma omp for schedule(static)
+        for ( int group = 0; group < static_cast< int >(nrStationGroups - step); group += 2 * step ) {
+          for ( unsigned int item = 0; item < nrTileValues; item++ ) {
+            partials[(group * nrPartialValues) + item] += partials[((group + step) * nrPartialValues) + item];
+          }
+        }
+      }
+      if ( profiler != 0 ) {
+        reduceTimer.stop();
+        storeTimer.start();
+      }
+      #pragma omp single
+      {
+        beamFormerStoreTile< T >(observation, partials, channel, firstSample, nrTileSamples, firstBeam, nrTileBeams, outputMode, nrSamplesPerIntegration, outputLayout, output.data());
+      }
+      if ( profiler != 0 ) {
+        storeTimer.stop();
+      }
+    }
+    if ( profiler != 0 ) {
+      #pragma omp critical (beamFormerProfiler)
+      {
+        computeTime += computeTimer.getTotalTime();
+        reduceTime += reduceTimer.getTotalTime();
+        storeTime += storeTimer.getTotalTime();
+        nrThreads++;
+      }
+    }
+  }
+  getScratchPool< T >().release(partialsBuffer);
+  if ( profiler != 0 ) {
+    const double ended = profiler->now();
+    const std::string configuration = isa::utils::toString(nrSamplesPerTile) + " " + isa::utils::toString(nrBeamsPerTile) + " " + isa::utils::toString(nrStationsPerTile) + " " + isa::utils::toString(nrStationsPerThread);
+    const double nrSamples = static_cast< double >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations();
+    const double computeFLOP = nrSamples * observation.getNrBeams() * 16;
+    // Every group but the first is added once to another, reading both and writing one
+    const double reduceValues = static_cast< double >(nrStationGroups - 1) * observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerSecond() * 4;
+
+    profiler->record("compute", configuration, started, ended, computeTime / nrThreads, computeFLOP, (nrSamples * nrBeamTiles * 4 * sizeof(I)) + (weights.size() * sizeof(float)));
+    profiler->record("reduce", configuration, started, ended, reduceTime / nrThreads, reduceValues, reduceValues * 3 * sizeof(T));
+    profiler->record("store", configuration, started, ended, storeTime / nrThreads, getBeamFormerFLOP(observation, outputMode) - computeFLOP, output.size() * sizeof(T));
+  }
+}
+
+template< typename T > void beamFormerStoreTile(const AstroData::Observation & observation, const T * const accumulators, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, T * const output) {
+  const unsigned int nrOutputValues = getNrOutputValues(outputMode);
+  // The transpose to the output layout is part of the store of the tiles
+  const unsigned int outputSampleStride = getOutputSampleStride(observation, outputMode, outputLayout);
+
+  for ( unsigned int beam = 0; beam < nrTileBeams; beam++ ) {
+    T * outputPointer = &(output[getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, firstBeam + beam, channel, firstSample / nrSamplesPerIntegration)]);
+
+    if ( outputMode == OUTPUT_VOLTAGES ) {
+      for ( unsigned int sample = 0; sample < nrTileSamples; sample++ ) {
+        for ( unsigned int item = 0; item < 4; item++ ) {
+          outputPointer[(sample * outputSampleStride) + item] = accumulators[(beam * nrTileSamples * 4) + (sample * 4) + item] / observation.getNrStations();
+        }
+      }
+    } else {
+      for ( unsigned int sample = 0; sample < nrTileSamples; sample++ ) {
+        T voltages[4];
+        T * stokesPointer = &(outputPointer[(sample / nrSamplesPerIntegration) * outputSampleStride]);
+
+        for ( unsigned int item = 0; item < 4; item++ ) {
+          voltages[item] = accumulators[(beam * nrTileSamples * 4) + (sample * 4) + item] / observation.getNrStations();
+        }
+        if ( (sample % nrSamplesPerIntegration) == 0 ) {
+          std::fill(stokesPointer, stokesPointer + nrOutputValues, 0);
+        }
+        integrateStokes< T >(outputMode, voltages, stokesPointer);
+      }
+    }
+  }
+}
+
+template< typename I, typename T > void beamFormerTile(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, T * const accumulators) {
+  std::fill(accumulators, accumulators + (nrTileBeams * nrTileSamples * 4), 0);
+
+  for ( unsigned int firstStation = 0; firstStation < observation.getNrStations(); firstStation += nrStationsPerTile ) {
+    const unsigned int nrTileStations = std::min(nrStationsPerTile, observation.getNrStations() - firstStation);
+
+    // The samples of this station tile are reused for every beam of the tile
+    for ( unsigned int beam = 0; beam < nrTileBeams; beam++ ) {
+      T * const beamPointer = &(accumulators[beam * nrTileSamples * 4]);
+
+      for ( unsigned int station = firstStation; station < firstStation + nrTileStations; station++ ) {
+        const I * const samplePointer = &(samples[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (station * observation.getNrSamplesPerPaddedSecond() * 4) + (firstSample * 4)]);
+        const float * const weightPointer = &(weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (station * observation.getNrPaddedBeams() * 2) + ((firstBeam + beam) * 2)]);
+        const float weight_r = weightPointer[0];
+        const float weight_i = weightPointer[1];
+
+        for ( unsigned int sample = 0; sample < nrTileSamples; sample++ ) {
+          beamPointer[(sample * 4)] += (samplePointer[(sample * 4)] * weight_r) - (samplePointer[(sample * 4) + 1] * weight_i);
+          beamPointer[(sample * 4) + 1] += (samplePointer[(sample * 4)] * weight_i) + (samplePointer[(sample * 4) + 1] * weight_r);
+          beamPointer[(sample * 4) + 2] += (samplePointer[(sample * 4) + 2] * weight_r) - (samplePointer[(sample * 4) + 3] * weight_i);
+          beamPointer[(sample * 4) + 3] += (samplePointer[(sample * 4) + 2] * weight_i) + (samplePointer[(sample * 4) + 3] * weight_r);
+        }
+      }
+    }
+  }
+}
+
+std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamplesPerBlock, const unsigned int nrBeamsPerBlock, const unsigned int nrChannelsPerBlock, const unsigned int nrSamplesPerThread, const unsigned int nrBeamsPerThread, const unsigned int nrStationsPerThread, const unsigned int nrStationsPerBlock, const bool doubleBuffer, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool generic, const bool flagging, const bool incoherent) {
   std::string * code = new std::string();
 
   // Begin kernel's template
-  *code = "__kernel void beamFormer(__global const " + dataType + "4 * restrict const samples, __global " + dataType + "4 * restrict const output, __global const float2 * restrict const weights) {\n"
-    "const unsigned int channel = get_group_id(2);\n"
+  std::string samplesType = inputDataType + "4";
+  std::string outputType = dataType + "4";
+
+  if ( inputDataType == "half" ) {
+    samplesType = "half";
+  }
+  if ( outputMode == OUTPUT_STOKES_I ) {
+    outputType = dataType;
+  }
+  std::string geometryArguments;
+  if ( generic ) {
+    geometryArguments = ", const unsigned int nrBeams, const unsigned int nrPaddedBeams, const unsigned int nrStations, const unsigned int nrChannels, const unsigned int nrPaddedChannels, const unsigned int nrSamplesPerPaddedSecond, const unsigned int nrOutputSamplesPerPaddedSecond";
+  }
+  if ( flagging ) {
+    geometryArguments += ", __global const unsigned int * restrict const activeStations, const unsigned int nrActiveStations";
+  }
+  if ( incoherent ) {
+    geometryArguments += ", __global " + dataType + " * restrict const incoherentOutput";
+  }
+  if ( generateWeights ) {
+    *code = "__kernel void beamFormer(__global const " + samplesType + " * restrict const samples, __global " + outputType + " * restrict const output, __global const float4 * restrict const geometry" + geometryArguments + ") {\n";
+  } else {
+    *code = "__kernel void beamFormer(__global const " + samplesType + " * restrict const samples, __global " + outputType + " * restrict const output, __global const float2 * restrict const weights" + geometryArguments + ") {\n";
+  }
+  // The work-items of the same channel and different station groups are consecutive in the third dimension
+  const unsigned int nrStationGroups = (nrStationsPerThread > 0) ? observation.getNrStations() / nrStationsPerThread : 1;
+  std::string localChannel = "get_local_id(2)";
+  if ( nrStationGroups > 1 ) {
+    localChannel = "localChannel";
+    *code += "const unsigned int localChannel = get_local_id(2) / " + isa::utils::toString(nrStationGroups) + ";\n"
+      "const unsigned int stationGroup = get_local_id(2) % " + isa::utils::toString(nrStationGroups) + ";\n";
+  }
+  if ( nrChannelsPerBlock > 1 ) {
+    *code += "const unsigned int channel = (get_group_id(2) * " + isa::utils::toString(nrChannelsPerBlock) + ") + " + localChannel + ";\n";
+  } else {
+    *code += "const unsigned int channel = get_group_id(2);\n";
+  }
+  *code += ""
     "const unsigned int beam = (get_group_id(1) * " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ") + (get_local_id(1) * " + isa::utils::toString(nrBeamsPerThread) + ");\n"
     "<%DEF_SAMPLES%>"
     "<%DEF_SUMS%>"
     + dataType + "4 sample = (" + dataType + "4)(0);\n";
-  if ( local ) {
-    *code += "__local float localSamples[" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding()) * 4) + "];\n";
+  // With more channels or station groups per work-group, every channel and station group has its own slice of local memory
+  const bool stageWeights = (nrStationsPerBlock > 0) && !generateWeights;
+  const bool stageSamples = local && doubleBuffer;
+  // The padding of the generic kernel is not known, so its local samples are not padded
+  unsigned int nrLocalSamples = isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding()) * 4;
+  if ( generic ) {
+    nrLocalSamples = nrSamplesPerBlock * nrSamplesPerThread * 4;
   }
-  *code += "float2 weight = (float2)(0);\n"
-    "\n"
-    "for ( unsigned int station = 0; station < " + isa::utils::toString(observation.getNrStations()) + "; station++ ) {\n";
-  if ( local ) {
-    *code += "unsigned int itemGlobal = (channel * " + isa::utils::toString(observation.getNrStations() * observation.getNrSamplesPerPaddedSecond()) + ") + (station * " + isa::utils::toString(observation.getNrSamplesPerPaddedSecond()) + ") + (get_group_id(0) * " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") + (get_local_id(1) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0);\n"
-      "unsigned int itemLocal = (get_local_id(1) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0);\n"
-      "while ( itemLocal < " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") {\n"
-      "sample = samples[itemGlobal];\n"
-      "localSamples[itemLocal] = sample.x;\n"
-      "localSamples[(" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding())) + ") + itemLocal] = sample.y;\n"
-      "localSamples[(" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding()) * 2) + ") + itemLocal] = sample.z;\n"
-      "localSamples[(" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding()) * 3) + ") + itemLocal] = sample.w;\n"
-      "itemLocal += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + ";\n"
-      "itemGlobal += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + ";\n"
+  std::string localSamplesName = "localSamples";
+  if ( stageSamples ) {
+    localSamplesName = "localSamplesBuffers";
+  }
+  if ( local && ((nrChannelsPerBlock * nrStationGroups) > 1) ) {
+    *code += "__local float localSamplesBlock[" + isa::utils::toString(nrChannelsPerBlock * nrStationGroups * (stageSamples ? 2 : 1) * nrLocalSamples) + "];\n"
+      "__local float * const " + localSamplesName + " = &(localSamplesBlock[get_local_id(2) * " + isa::utils::toString((stageSamples ? 2 : 1) * nrLocalSamples) + "]);\n";
+  } else if ( local ) {
+    *code += "__local float " + localSamplesName + "[" + isa::utils::toString((stageSamples ? 2 : 1) * nrLocalSamples) + "];\n";
+  }
+  if ( stageWeights && ((nrChannelsPerBlock * nrStationGroups) > 1) ) {
+    *code += "__local float2 localWeightsBlock[" + isa::utils::toString(nrChannelsPerBlock * nrStationGroups * nrStationsPerBlock * nrBeamsPerBlock * nrBeamsPerThread) + "];\n"
+      "__local float2 * const localWeights = &(localWeightsBlock[get_local_id(2) * " + isa::utils::toString(nrStationsPerBlock * nrBeamsPerBlock * nrBeamsPerThread) + "]);\n";
+  } else if ( stageWeights ) {
+    *code += "__local float2 localWeights[" + isa::utils::toString(nrStationsPerBlock * nrBeamsPerBlock * nrBeamsPerThread) + "];\n";
+  }
+  if ( (outputMode != OUTPUT_VOLTAGES) && (nrSamplesPerIntegration > 1) && (nrChannelsPerBlock > 1) ) {
+    *code += "__local " + outputType + " localStokesBlock[" + isa::utils::toString(nrChannelsPerBlock * nrBeamsPerBlock * nrBeamsPerThread * nrSamplesPerBlock * nrSamplesPerThread) + "];\n"
+      "__local " + outputType + " * const localStokes = &(localStokesBlock[" + localChannel + " * " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread * nrSamplesPerBlock * nrSamplesPerThread) + "]);\n";
+  } else if ( (outputMode != OUTPUT_VOLTAGES) && (nrSamplesPerIntegration > 1) ) {
+    *code += "__local " + outputType + " localStokes[" + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread * nrSamplesPerBlock * nrSamplesPerThread) + "];\n";
+  }
+  if ( incoherent && (outputMode != OUTPUT_VOLTAGES) && (nrSamplesPerIntegration > 1) ) {
+    *code += "__local " + dataType + " localIncoherentBlock[" + isa::utils::toString(nrChannelsPerBlock * nrSamplesPerBlock * nrSamplesPerThread) + "];\n"
+      "__local " + dataType + " * const localIncoherent = &(localIncoherentBlock[" + localChannel + " * " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + "]);\n";
+  }
+  // Output samples computed by a work-group for each of its beams and channels
+  unsigned int nrOutputSamplesPerBlock = nrSamplesPerBlock * nrSamplesPerThread;
+  if ( outputMode != OUTPUT_VOLTAGES ) {
+    nrOutputSamplesPerBlock /= nrSamplesPerIntegration;
+  }
+  if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    *code += "__local " + outputType + " localOutput[" + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread * nrOutputSamplesPerBlock * nrChannelsPerBlock) + "];\n";
+  }
+  if ( nrStationGroups > 1 ) {
+    *code += "__local " + dataType + "4 localPartials[" + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups * nrSamplesPerThread * nrBeamsPerThread) + "];\n";
+    if ( incoherent ) {
+      *code += "__local " + dataType + " localIncoherentPartials[" + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups * nrSamplesPerThread) + "];\n";
+    }
+  }
+  if ( generateWeights ) {
+    *code += "float4 delay = (float4)(0);\n"
+      "float phase = 0.0f;\n"
+      "<%DEF_WEIGHTS%>";
+  } else {
+    *code += "float2 weight = (float2)(0);\n";
+  }
+  // Stations summed by a work-item; with flagging the loop runs over the active station list, and station is read from it
+  std::string firstStation = "0";
+  std::string lastStation = getGeometryOpenCL(generic, observation.getNrStations(), "nrStations");
+  std::string stationCounter = "station";
+  if ( flagging ) {
+    lastStation = "nrActiveStations";
+    stationCounter = "activeStation";
+  }
+  if ( nrStationGroups > 1 ) {
+    firstStation = "stationGroup * " + isa::utils::toString(nrStationsPerThread);
+    lastStation = "(stationGroup + 1) * " + isa::utils::toString(nrStationsPerThread);
+  }
+  // Copies the samples of <%STATION%> in <%LOCAL_SAMPLES%>, as four planes of x, y, z and w
+  std::string loadLocalTemplate = "unsigned int itemGlobal = (channel * " + getGeometryOpenCL(generic, observation.getNrStations() * observation.getNrSamplesPerPaddedSecond(), "nrStations * nrSamplesPerPaddedSecond") + ") + (<%STATION%> * " + getGeometryOpenCL(generic, observation.getNrSamplesPerPaddedSecond(), "nrSamplesPerPaddedSecond") + ") + (get_group_id(0) * " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") + (get_local_id(1) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0);\n"
+    "unsigned int itemLocal = (get_local_id(1) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0);\n"
+    "while ( itemLocal < " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") {\n"
+    "sample = " + getLoadSampleOpenCL("itemGlobal", inputDataType, dataType) + ";\n"
+    "<%LOCAL_SAMPLES%>[itemLocal] = sample.x;\n"
+    "<%LOCAL_SAMPLES%>[(" + isa::utils::toString(nrLocalSamples / 4) + ") + itemLocal] = sample.y;\n"
+    "<%LOCAL_SAMPLES%>[(" + isa::utils::toString((nrLocalSamples / 4) * 2) + ") + itemLocal] = sample.z;\n"
+    "<%LOCAL_SAMPLES%>[(" + isa::utils::toString((nrLocalSamples / 4) * 3) + ") + itemLocal] = sample.w;\n"
+    "itemLocal += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + ";\n"
+    "itemGlobal += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + ";\n"
+    "}\n";
+  std::string * loadLocal_s = 0;
+  if ( stageSamples ) {
+    // The first station is loaded before the loop, then every station loads the next one in the other buffer
+    if ( flagging ) {
+      loadLocal_s = isa::utils::replace(&loadLocalTemplate, "<%STATION%>", "activeStations[" + firstStation + "]");
+    } else {
+      loadLocal_s = isa::utils::replace(&loadLocalTemplate, "<%STATION%>", "(" + firstStation + ")");
+    }
+    loadLocal_s = isa::utils::replace(loadLocal_s, "<%LOCAL_SAMPLES%>", "nextLocalSamples", true);
+    *code += "{\n"
+      "__local float * const nextLocalSamples = &(localSamplesBuffers[((" + firstStation + ") % 2) * " + isa::utils::toString(nrLocalSamples) + "]);\n"
+      + *loadLocal_s +
       "}\n"
       "barrier(CLK_LOCAL_MEM_FENCE);\n";
+    delete loadLocal_s;
   }
-  *code += "<%LOAD_COMPUTE%>"
-    "}\n"
-    "<%AVERAGE%>"
-    "<%STORE%>"
-    "}\n";
+  if ( stageWeights ) {
+    // The weights of a block of stations are copied in local memory by the whole work-group, consecutive work-items copy consecutive beams
+    *code += "\n"
+      "for ( unsigned int firstStation = " + firstStation + "; firstStation < " + lastStation + "; firstStation += " + isa::utils::toString(nrStationsPerBlock) + " ) {\n"
+      "for ( unsigned int weightItem = (get_local_id(1) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0); weightItem < " + isa::utils::toString(nrStationsPerBlock * nrBeamsPerBlock * nrBeamsPerThread) + "; weightItem += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + " ) {\n"
+      "localWeights[weightItem] = weights[(channel * " + getGeometryOpenCL(generic, observation.getNrStations() * observation.getNrPaddedBeams(), "nrStations * nrPaddedBeams") + ") + ((firstStation + (weightItem / " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ")) * " + getGeometryOpenCL(generic, observation.getNrPaddedBeams(), "nrPaddedBeams") + ") + (get_group_id(1) * " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ") + (weightItem % " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ")];\n"
+      "}\n"
+      "barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "for ( unsigned int station = firstStation; station < firstStation + " + isa::utils::toString(nrStationsPerBlock) + "; station++ ) {\n";
+  } else {
+    *code += "\n"
+      "for ( unsigned int " + stationCounter + " = " + firstStation + "; " + stationCounter + " < " + lastStation + "; " + stationCounter + "++ ) {\n";
+  }
+  if ( flagging ) {
+    *code += "const unsigned int station = activeStations[activeStation];\n";
+  }
+  if ( stageSamples ) {
+    if ( flagging ) {
+      loadLocal_s = isa::utils::replace(&loadLocalTemplate, "<%STATION%>", "activeStations[activeStation + 1]");
+    } else {
+      loadLocal_s = isa::utils::replace(&loadLocalTemplate, "<%STATION%>", "(station + 1)");
+    }
+    loadLocal_s = isa::utils::replace(loadLocal_s, "<%LOCAL_SAMPLES%>", "nextLocalSamples", true);
+    *code += "__local float * const localSamples = &(localSamplesBuffers[(" + stationCounter + " % 2) * " + isa::utils::toString(nrLocalSamples) + "]);\n"
+      "if ( (" + stationCounter + " + 1) < " + lastStation + " ) {\n"
+      "__local float * const nextLocalSamples = &(localSamplesBuffers[((" + stationCounter + " + 1) % 2) * " + isa::utils::toString(nrLocalSamples) + "]);\n"
+      + *loadLocal_s +
+      "}\n";
+    delete loadLocal_s;
+  } else if ( local ) {
+    loadLocal_s = isa::utils::replace(&loadLocalTemplate, "<%STATION%>", "station");
+    loadLocal_s = isa::utils::replace(loadLocal_s, "<%LOCAL_SAMPLES%>", "localSamples", true);
+    *code += *loadLocal_s +
+      "barrier(CLK_LOCAL_MEM_FENCE);\n";
+    delete loadLocal_s;
+  }
+  if ( generateWeights ) {
+    *code += "<%COMPUTE_WEIGHTS%>";
+  }
+  *code += "<%LOAD_COMPUTE%>";
+  // The local samples and weights of this station are not overwritten before every work-item is done with them
+  if ( local ) {
+    *code += "barrier(CLK_LOCAL_MEM_FENCE);\n";
+  }
+  *code += "}\n";
+  if ( stageWeights && !local ) {
+    *code += "barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "}\n";
+  } else if ( stageWeights ) {
+    *code += "}\n";
+  }
+  if ( nrStationGroups > 1 ) {
+    // Tree reduction of the partial beams of the station groups, the first station group stores the beams
+    unsigned int firstStep = 1;
+
+    while ( (firstStep * 2) < nrStationGroups ) {
+      firstStep *= 2;
+    }
+    *code += "const unsigned int partialItem = (((get_local_id(2) * " + isa::utils::toString(nrBeamsPerBlock) + ") + get_local_id(1)) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0);\n"
+      "<%STORE_PARTIALS%>"
+      "for ( unsigned int step = " + isa::utils::toString(firstStep) + "; step > 0; step /= 2 ) {\n"
+      "barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "if ( (stationGroup < step) && ((stationGroup + step) < " + isa::utils::toString(nrStationGroups) + ") ) {\n"
+      "<%REDUCE%>"
+      "}\n"
+      "}\n"
+      "if ( stationGroup == 0 ) {\n"
+      "<%AVERAGE%>"
+      "<%STORE%>"
+      "}\n";
+  } else {
+    *code += "<%AVERAGE%>"
+      "<%STORE%>";
+  }
+  if ( (outputMode != OUTPUT_VOLTAGES) && (nrSamplesPerIntegration > 1) ) {
+    // The Stokes parameters of the block are in local memory, every work-item integrates some of them
+    std::string firstItem = "(get_local_id(1) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0)";
+    std::string integratedStore;
+
+    if ( nrStationGroups > 1 ) {
+      firstItem = "(((stationGroup * " + isa::utils::toString(nrBeamsPerBlock) + ") + get_local_id(1)) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0)";
+    }
+
+    if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+      integratedStore = "localOutput[(((localBeam * " + isa::utils::toString(nrOutputSamplesPerBlock) + ") + localSample) * " + isa::utils::toString(nrChannelsPerBlock) + ") + " + localChannel + "] = stokes;\n";
+    } else {
+      integratedStore = "output[" + getOutputIndexOpenCL("(get_group_id(1) * " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ") + localBeam", "channel", "(get_group_id(0) * " + isa::utils::toString(nrOutputSamplesPerBlock) + ") + localSample", outputMode, nrSamplesPerIntegration, outputLayout, observation, generic) + "] = stokes;\n";
+    }
+    *code += "barrier(CLK_LOCAL_MEM_FENCE);\n";
+    if ( incoherent ) {
+      // The first beams of the work-groups are the only ones storing the incoherent beam
+      *code += "if ( get_group_id(1) == 0 ) {\n"
+        "for ( unsigned int localSample = " + firstItem + "; localSample < " + isa::utils::toString(nrOutputSamplesPerBlock) + "; localSample += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrStationGroups) + " ) {\n"
+        + dataType + " power = 0;\n"
+        "\n"
+        "for ( unsigned int integrationSample = localSample * " + isa::utils::toString(nrSamplesPerIntegration) + "; integrationSample < (localSample + 1) * " + isa::utils::toString(nrSamplesPerIntegration) + "; integrationSample++ ) {\n"
+        "power += localIncoherent[integrationSample];\n"
+        "}\n"
+        "incoherentOutput[(channel * " + getGeometryOpenCL(generic, getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration), "nrOutputSamplesPerPaddedSecond") + ") + (get_group_id(0) * " + isa::utils::toString(nrOutputSamplesPerBlock) + ") + localSample] = power;\n"
+        "}\n"
+        "}\n";
+    }
+    *code += "for ( unsigned int localItem = " + firstItem + "; localItem < " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread * nrOutputSamplesPerBlock) + "; localItem += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrStationGroups) + " ) {\n"
+      "const unsigned int localBeam = localItem / " + isa::utils::toString(nrOutputSamplesPerBlock) + ";\n"
+      "const unsigned int localSample = localItem % " + isa::utils::toString(nrOutputSamplesPerBlock) + ";\n"
+      + outputType + " stokes = (" + outputType + ")(0);\n"
+      "\n"
+      "for ( unsigned int integrationSample = localSample * " + isa::utils::toString(nrSamplesPerIntegration) + "; integrationSample < (localSample + 1) * " + isa::utils::toString(nrSamplesPerIntegration) + "; integrationSample++ ) {\n"
+      "stokes += localStokes[(localBeam * " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") + integrationSample];\n"
+      "}\n"
+      + integratedStore +
+      "}\n";
+  }
+  if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    // The output of the work-group is in local memory as [beam][sample][channel], consecutive work-items store consecutive channels
+    *code += "barrier(CLK_LOCAL_MEM_FENCE);\n"
+      "for ( unsigned int localItem = (((get_local_id(2) * " + isa::utils::toString(nrBeamsPerBlock) + ") + get_local_id(1)) * " + isa::utils::toString(nrSamplesPerBlock) + ") + get_local_id(0); localItem < " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread * nrOutputSamplesPerBlock * nrChannelsPerBlock) + "; localItem += " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups) + " ) {\n"
+      "const unsigned int localBeam = localItem / " + isa::utils::toString(nrOutputSamplesPerBlock * nrChannelsPerBlock) + ";\n"
+      "const unsigned int localSample = (localItem / " + isa::utils::toString(nrChannelsPerBlock) + ") % " + isa::utils::toString(nrOutputSamplesPerBlock) + ";\n"
+      "output[" + getOutputIndexOpenCL("(get_group_id(1) * " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ") + localBeam", "(get_group_id(2) * " + isa::utils::toString(nrChannelsPerBlock) + ") + (localItem % " + isa::utils::toString(nrChannelsPerBlock) + ")", "(get_group_id(0) * " + isa::utils::toString(nrOutputSamplesPerBlock) + ") + localSample", outputMode, nrSamplesPerIntegration, outputLayout, observation, generic) + "] = localOutput[localItem];\n"
+      "}\n";
+  }
+  *code += "}\n";
   std::string defSamplesTemplate = "const unsigned int sample<%SNUM%> = (get_group_id(0) * " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") + get_local_id(0) + <%OFFSET%>;\n";
   std::string defSumsTemplate = dataType + "4 beam<%BNUM%>s<%SNUM%> = (" + dataType + "4)(0);\n";
   std::string loadComputeTemplate;
   if ( local ) {
    loadComputeTemplate += "sample.x = localSamples[get_local_id(0) + <%OFFSET%>];\n"
-     "sample.y = localSamples[(" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding())) + ") + get_local_id(0) + <%OFFSET%>];\n"
-     "sample.z = localSamples[(" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding()) * 2) + ") + get_local_id(0) + <%OFFSET%>];\n"
-     "sample.w = localSamples[(" + isa::utils::toString(isa::utils::pad(nrSamplesPerBlock * nrSamplesPerThread, observation.getPadding()) * 3) + ") + get_local_id(0) + <%OFFSET%>];\n";
+     "sample.y = localSamples[(" + isa::utils::toString(nrLocalSamples / 4) + ") + get_local_id(0) + <%OFFSET%>];\n"
+     "sample.z = localSamples[(" + isa::utils::toString((nrLocalSamples / 4) * 2) + ") + get_local_id(0) + <%OFFSET%>];\n"
+     "sample.w = localSamples[(" + isa::utils::toString((nrLocalSamples / 4) * 3) + ") + get_local_id(0) + <%OFFSET%>];\n";
   } else {
-   loadComputeTemplate += "sample = samples[(channel * " + isa::utils::toString(observation.getNrStations() * observation.getNrSamplesPerPaddedSecond()) + ") + (station * " + isa::utils::toString(observation.getNrSamplesPerPaddedSecond()) + ") + sample<%SNUM%>];\n";
+   loadComputeTemplate += "sample = " + getLoadSampleOpenCL("(channel * " + getGeometryOpenCL(generic, observation.getNrStations() * observation.getNrSamplesPerPaddedSecond(), "nrStations * nrSamplesPerPaddedSecond") + ") + (station * " + getGeometryOpenCL(generic, observation.getNrSamplesPerPaddedSecond(), "nrSamplesPerPaddedSecond") + ") + sample<%SNUM%>", inputDataType, dataType) + ";\n";
   }
   loadComputeTemplate += "<%SUMS%>";
-  std::string sumsTemplate = "weight = weights[(channel * " + isa::utils::toString(observation.getNrStations() * observation.getNrPaddedBeams()) + ") + (station * " + isa::utils::toString(observation.getNrPaddedBeams()) + ") + beam + <%BNUM%>];\n"
-    "beam<%BNUM%>s<%SNUM%>.x += (sample.x * weight.x) - (sample.y * weight.y);\n"
+  // The incoherent beam is accumulated from the samples already loaded for the beams
+  std::string defIncoherentTemplate;
+  if ( incoherent ) {
+    defIncoherentTemplate = dataType + " incoherent<%SNUM%> = 0;\n";
+    loadComputeTemplate += "incoherent<%SNUM%> += (sample.x * sample.x) + (sample.y * sample.y) + (sample.z * sample.z) + (sample.w * sample.w);\n";
+  }
+  std::string sumsTemplate;
+  std::string defWeightsTemplate;
+  std::string computeWeightsTemplate;
+  if ( generateWeights ) {
+    // The weights of a station are computed once and reused for all the samples of the work-item
+    // The phase in turns is delay.x + (channel * (delay.y + delay.z)); the whole turns of channel * delay.y are dropped by the fma, before any rounding
+    defWeightsTemplate = "float2 weight<%BNUM%> = (float2)(0);\n";
+    computeWeightsTemplate = "delay = geometry[(station * " + getGeometryOpenCL(generic, observation.getNrPaddedBeams(), "nrPaddedBeams") + ") + beam + <%BNUM%>];\n"
+      "phase = fma((float)(channel), delay.y, -floor(channel * delay.y)) + fma((float)(channel), delay.z, delay.x);\n"
+      "phase = -6.283185307f * (phase - floor(phase));\n"
+      "weight<%BNUM%> = (float2)(cos(phase), sin(phase));\n";
+  } else {
+    sumsTemplate = "weight = weights[(channel * " + getGeometryOpenCL(generic, observation.getNrStations() * observation.getNrPaddedBeams(), "nrStations * nrPaddedBeams") + ") + (station * " + getGeometryOpenCL(generic, observation.getNrPaddedBeams(), "nrPaddedBeams") + ") + beam + <%BNUM%>];\n";
+  }
+  if ( stageWeights ) {
+    sumsTemplate = "weight = localWeights[((station - firstStation) * " + isa::utils::toString(nrBeamsPerBlock * nrBeamsPerThread) + ") + (get_local_id(1) * " + isa::utils::toString(nrBeamsPerThread) + ") + <%BNUM%>];\n";
+  }
+  sumsTemplate += "beam<%BNUM%>s<%SNUM%>.x += (sample.x * weight.x) - (sample.y * weight.y);\n"
     "beam<%BNUM%>s<%SNUM%>.y += (sample.x * weight.y) + (sample.y * weight.x);\n"
     "beam<%BNUM%>s<%SNUM%>.z += (sample.z * weight.x) - (sample.w * weight.y);\n"
     "beam<%BNUM%>s<%SNUM%>.w += (sample.z * weight.y) + (sample.w * weight.x);\n";
-  std::string averageTemplate = "beam<%BNUM%>s<%SNUM%> *= " + isa::utils::toString(1.0f / observation.getNrStations()) + "f;\n";
-  std::string storeTemplate = "output[((beam + <%BNUM%>) * " + isa::utils::toString(observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond()) + ") + (channel * " + isa::utils::toString(observation.getNrSamplesPerPaddedSecond()) + ") + sample<%SNUM%>] = beam<%BNUM%>s<%SNUM%>;\n";
+  if ( generateWeights ) {
+    std::string * sums_s = isa::utils::replace(&sumsTemplate, "weight.", "weight<%BNUM%>.");
+
+    sumsTemplate = *sums_s;
+    delete sums_s;
+  }
+  // Partial beams are stored as [beam][sample][work-item], the partner of a work-item in the reduction is step station groups away
+  std::string partialTemplate = "localPartials[(((<%BNUM%> * " + isa::utils::toString(nrSamplesPerThread) + ") + <%SNUM%>) * " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups) + ") + partialItem]";
+  std::string storePartialsTemplate = partialTemplate + " = beam<%BNUM%>s<%SNUM%>;\n";
+  std::string reduceTemplate = "beam<%BNUM%>s<%SNUM%> += localPartials[(((<%BNUM%> * " + isa::utils::toString(nrSamplesPerThread) + ") + <%SNUM%>) * " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups) + ") + partialItem + (step * " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + ")];\n"
+    + storePartialsTemplate;
+  std::string averageFactor = isa::utils::toString(1.0f / observation.getNrStations()) + "f";
+  if ( flagging ) {
+    averageFactor = "1.0f / nrActiveStations";
+  } else if ( generic ) {
+    averageFactor = "1.0f / nrStations";
+  }
+  std::string averageTemplate = "beam<%BNUM%>s<%SNUM%> *= " + averageFactor + ";\n";
+  std::string incoherentTemplate;
+  std::string storePartialsIncoherentTemplate;
+  std::string reduceIncoherentTemplate;
+  if ( incoherent ) {
+    // Incoherent partials are stored as [sample][work-item]
+    storePartialsIncoherentTemplate = "localIncoherentPartials[(<%SNUM%> * " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups) + ") + partialItem] = incoherent<%SNUM%>;\n";
+    reduceIncoherentTemplate = "incoherent<%SNUM%> += localIncoherentPartials[(<%SNUM%> * " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock * nrChannelsPerBlock * nrStationGroups) + ") + partialItem + (step * " + isa::utils::toString(nrSamplesPerBlock * nrBeamsPerBlock) + ")];\n"
+      + storePartialsIncoherentTemplate;
+    incoherentTemplate = "incoherent<%SNUM%> *= " + averageFactor + ";\n";
+    if ( (outputMode != OUTPUT_VOLTAGES) && (nrSamplesPerIntegration > 1) ) {
+      incoherentTemplate += "if ( get_local_id(1) == 0 ) {\n"
+        "localIncoherent[get_local_id(0) + <%OFFSET%>] = incoherent<%SNUM%>;\n"
+        "}\n";
+    } else {
+      incoherentTemplate += "if ( beam == 0 ) {\n"
+        "incoherentOutput[(channel * " + getGeometryOpenCL(generic, getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration), "nrOutputSamplesPerPaddedSecond") + ") + sample<%SNUM%>] = incoherent<%SNUM%>;\n"
+        "}\n";
+    }
+  }
+  std::string storeTemplate;
+  // Transposed outputs are first stored in local memory
+  std::string localOutputTemplate = "localOutput[(((((get_local_id(1) * " + isa::utils::toString(nrBeamsPerThread) + ") + <%BNUM%>) * " + isa::utils::toString(nrOutputSamplesPerBlock) + ") + get_local_id(0) + <%OFFSET%>) * " + isa::utils::toString(nrChannelsPerBlock) + ") + " + localChannel + "]";
+  if ( (outputMode == OUTPUT_VOLTAGES) && (outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL) ) {
+    storeTemplate = localOutputTemplate + " = beam<%BNUM%>s<%SNUM%>;\n";
+  } else if ( outputMode == OUTPUT_VOLTAGES ) {
+    storeTemplate = "output[" + getOutputIndexOpenCL("beam + <%BNUM%>", "channel", "sample<%SNUM%>", outputMode, nrSamplesPerIntegration, outputLayout, observation, generic) + "] = beam<%BNUM%>s<%SNUM%>;\n";
+  } else {
+    std::string stokesTemplate;
+
+    if ( outputMode == OUTPUT_STOKES_I ) {
+      stokesTemplate = "(beam<%BNUM%>s<%SNUM%>.x * beam<%BNUM%>s<%SNUM%>.x) + (beam<%BNUM%>s<%SNUM%>.y * beam<%BNUM%>s<%SNUM%>.y) + (beam<%BNUM%>s<%SNUM%>.z * beam<%BNUM%>s<%SNUM%>.z) + (beam<%BNUM%>s<%SNUM%>.w * beam<%BNUM%>s<%SNUM%>.w)";
+    } else {
+      stokesTemplate = "(" + outputType + ")((beam<%BNUM%>s<%SNUM%>.x * beam<%BNUM%>s<%SNUM%>.x) + (beam<%BNUM%>s<%SNUM%>.y * beam<%BNUM%>s<%SNUM%>.y) + (beam<%BNUM%>s<%SNUM%>.z * beam<%BNUM%>s<%SNUM%>.z) + (beam<%BNUM%>s<%SNUM%>.w * beam<%BNUM%>s<%SNUM%>.w), "
+        "(beam<%BNUM%>s<%SNUM%>.x * beam<%BNUM%>s<%SNUM%>.x) + (beam<%BNUM%>s<%SNUM%>.y * beam<%BNUM%>s<%SNUM%>.y) - (beam<%BNUM%>s<%SNUM%>.z * beam<%BNUM%>s<%SNUM%>.z) - (beam<%BNUM%>s<%SNUM%>.w * beam<%BNUM%>s<%SNUM%>.w), "
+        "2 * ((beam<%BNUM%>s<%SNUM%>.x * beam<%BNUM%>s<%SNUM%>.z) + (beam<%BNUM%>s<%SNUM%>.y * beam<%BNUM%>s<%SNUM%>.w)), "
+        "2 * ((beam<%BNUM%>s<%SNUM%>.x * beam<%BNUM%>s<%SNUM%>.w) - (beam<%BNUM%>s<%SNUM%>.y * beam<%BNUM%>s<%SNUM%>.z)))";
+    }
+    if ( nrSamplesPerIntegration > 1 ) {
+      storeTemplate = "localStokes[(((get_local_id(1) * " + isa::utils::toString(nrBeamsPerThread) + ") + <%BNUM%>) * " + isa::utils::toString(nrSamplesPerBlock * nrSamplesPerThread) + ") + get_local_id(0) + <%OFFSET%>] = " + stokesTemplate + ";\n";
+    } else if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+      storeTemplate = localOutputTemplate + " = " + stokesTemplate + ";\n";
+    } else {
+      storeTemplate = "output[" + getOutputIndexOpenCL("beam + <%BNUM%>", "channel", "sample<%SNUM%>", outputMode, nrSamplesPerIntegration, outputLayout, observation, generic) + "] = " + stokesTemplate + ";\n";
+    }
+  }
   // End kernel's template
 
   std::string * defSamples_s = new std::string();
@@ -121,7 +1092,22 @@ std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamples
   std::string * loadCompute_s = new std::string();
   std::string * average_s = new std::string();
   std::string * store_s = new std::string();
+  std::string * defWeights_s = new std::string();
+  std::string * computeWeights_s = new std::string();
+  std::string * storePartials_s = new std::string();
+  std::string * reduce_s = new std::string();
 
+  for ( unsigned int beam = 0; beam < nrBeamsPerThread; beam++ ) {
+    std::string beam_s = isa::utils::toString(beam);
+    std::string * temp_s = 0;
+
+    temp_s = isa::utils::replace(&defWeightsTemplate, "<%BNUM%>", beam_s);
+    defWeights_s->append(*temp_s);
+    delete temp_s;
+    temp_s = isa::utils::replace(&computeWeightsTemplate, "<%BNUM%>", beam_s);
+    computeWeights_s->append(*temp_s);
+    delete temp_s;
+  }
   for ( unsigned int sample = 0; sample < nrSamplesPerThread; sample++ ) {
     std::string sample_s = isa::utils::toString(sample);
     std::string offset_s = isa::utils::toString(sample * nrSamplesPerBlock);
@@ -132,6 +1118,9 @@ std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamples
     temp_s = isa::utils::replace(temp_s, "<%OFFSET%>", offset_s, true);
     defSamples_s->append(*temp_s);
     delete temp_s;
+    temp_s = isa::utils::replace(&defIncoherentTemplate, "<%SNUM%>", sample_s);
+    defSums_s->append(*temp_s);
+    delete temp_s;
 
     for ( unsigned int beam = 0; beam < nrBeamsPerThread; beam++ ) {
       std::string beam_s = isa::utils::toString(beam);
@@ -143,6 +1132,12 @@ std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamples
       temp_s = isa::utils::replace(&sumsTemplate, "<%BNUM%>", beam_s);
       sums_s->append(*temp_s);
       delete temp_s;
+      temp_s = isa::utils::replace(&storePartialsTemplate, "<%BNUM%>", beam_s);
+      storePartials_s->append(*temp_s);
+      delete temp_s;
+      temp_s = isa::utils::replace(&reduceTemplate, "<%BNUM%>", beam_s);
+      reduce_s->append(*temp_s);
+      delete temp_s;
       temp_s = isa::utils::replace(&averageTemplate, "<%BNUM%>", beam_s);
       average_s->append(*temp_s);
       delete temp_s;
@@ -150,6 +1145,9 @@ std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamples
       store_s->append(*temp_s);
       delete temp_s;
     }
+    storePartials_s->append(storePartialsIncoherentTemplate);
+    reduce_s->append(reduceIncoherentTemplate);
+    store_s->append(incoherentTemplate);
     defSums_s = isa::utils::replace(defSums_s, "<%SNUM%>", sample_s, true);
     temp_s = isa::utils::replace(&loadComputeTemplate, "<%SNUM%>", sample_s);
     temp_s = isa::utils::replace(temp_s, "<%OFFSET%>", offset_s, true);
@@ -157,8 +1155,11 @@ std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamples
     temp_s = isa::utils::replace(temp_s, "<%SNUM%>", sample_s, true);
     loadCompute_s->append(*temp_s);
     delete temp_s;
+    storePartials_s = isa::utils::replace(storePartials_s, "<%SNUM%>", sample_s, true);
+    reduce_s = isa::utils::replace(reduce_s, "<%SNUM%>", sample_s, true);
     average_s = isa::utils::replace(average_s, "<%SNUM%>", sample_s, true);
     store_s = isa::utils::replace(store_s, "<%SNUM%>", sample_s, true);
+    store_s = isa::utils::replace(store_s, "<%OFFSET%>", offset_s, true);
   }
 
   code = isa::utils::replace(code, "<%DEF_SAMPLES%>", *defSamples_s, true);
@@ -166,10 +1167,80 @@ std::string * getBeamFormerOpenCL(const bool local, const unsigned int nrSamples
   code = isa::utils::replace(code, "<%LOAD_COMPUTE%>", *loadCompute_s, true);
   code = isa::utils::replace(code, "<%AVERAGE%>", *average_s, true);
   code = isa::utils::replace(code, "<%STORE%>", *store_s, true);
+  code = isa::utils::replace(code, "<%DEF_WEIGHTS%>", *defWeights_s, true);
+  code = isa::utils::replace(code, "<%COMPUTE_WEIGHTS%>", *computeWeights_s, true);
+  code = isa::utils::replace(code, "<%STORE_PARTIALS%>", *storePartials_s, true);
+  code = isa::utils::replace(code, "<%REDUCE%>", *reduce_s, true);
 
   return code;
 }
 
+std::string * getBeamFormerOpenCL(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent) {
+  return getBeamFormerOpenCL(conf.getLocalMem(), conf.getNrSamplesPerBlock(), conf.getNrBeamsPerBlock(), conf.getNrChannelsPerBlock(), conf.getNrSamplesPerThread(), conf.getNrBeamsPerThread(), conf.getNrStationsPerThread(), conf.getNrStationsPerBlock(), conf.getDoubleBuffer(), outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputDataType, dataType, observation, false, false, incoherent);
+}
+
+std::string * getBeamFormerGenericOpenCL(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent) {
+  if ( (conf.getNrStationsPerThread() > 0) || (conf.getNrStationsPerBlock() > 0) ) {
+    throw std::invalid_argument("The generic kernel neither splits nor blocks the stations, the configuration has " + isa::utils::toString(conf.getNrStationsPerThread()) + " stations per work-item and " + isa::utils::toString(conf.getNrStationsPerBlock()) + " per block.");
+  }
+  return getBeamFormerOpenCL(conf.getLocalMem(), conf.getNrSamplesPerBlock(), conf.getNrBeamsPerBlock(), conf.getNrChannelsPerBlock(), conf.getNrSamplesPerThread(), conf.getNrBeamsPerThread(), conf.getNrStationsPerThread(), conf.getNrStationsPerBlock(), conf.getDoubleBuffer(), outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputDataType, dataType, observation, true, false, incoherent);
+}
+
+std::string * getBeamFormerFlaggingOpenCL(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent) {
+  if ( (conf.getNrStationsPerThread() > 0) || (conf.getNrStationsPerBlock() > 0) ) {
+    throw std::invalid_argument("The flagging kernel neither splits nor blocks the stations, the configuration has " + isa::utils::toString(conf.getNrStationsPerThread()) + " stations per work-item and " + isa::utils::toString(conf.getNrStationsPerBlock()) + " per block.");
+  }
+  return getBeamFormerOpenCL(conf.getLocalMem(), conf.getNrSamplesPerBlock(), conf.getNrBeamsPerBlock(), conf.getNrChannelsPerBlock(), conf.getNrSamplesPerThread(), conf.getNrBeamsPerThread(), conf.getNrStationsPerThread(), conf.getNrStationsPerBlock(), conf.getDoubleBuffer(), outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputDataType, dataType, observation, false, true, incoherent);
+}
+
+const std::string & getBeamFormerOpenCLMemo(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, const bool incoherent) {
+  static std::map< std::string, std::string > codes;
+  const std::string key = conf.print() + " " + isa::utils::toString(outputMode) + " " + isa::utils::toString(nrSamplesPerIntegration) + " " + isa::utils::toString(outputLayout) + " " + isa::utils::toString(generateWeights) + " " + inputDataType + " " + dataType + " " + isa::utils::toString(observation.getNrBeams()) + " " + isa::utils::toString(observation.getNrStations()) + " " + isa::utils::toString(observation.getNrChannels()) + " " + isa::utils::toString(observation.getNrSamplesPerSecond()) + " " + isa::utils::toString(observation.getPadding()) + " " + isa::utils::toString(incoherent);
+  std::map< std::string, std::string >::iterator code;
+
+  #pragma omp critical (beamFormerOpenCLMemo)
+  {
+    code = codes.find(key);
+    if ( code == codes.end() ) {
+      std::string * newCode = getBeamFormerOpenCL(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputDataType, dataType, observation, incoherent);
+
+      code = codes.insert(std::make_pair(key, *newCode)).first;
+      delete newCode;
+    }
+  }
+  return code->second;
+}
+
+std::string getOutputIndexOpenCL(const std::string & beam, const std::string & channel, const std::string & outputSample, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const AstroData::Observation & observation, const bool generic) {
+  const unsigned int nrOutputSamples = getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration);
+
+  if ( outputLayout == LAYOUT_CHANNEL_BEAM_SAMPLE ) {
+    return "((" + channel + ") * " + getGeometryOpenCL(generic, observation.getNrBeams() * nrOutputSamples, "nrBeams * nrOutputSamplesPerPaddedSecond") + ") + ((" + beam + ") * " + getGeometryOpenCL(generic, nrOutputSamples, "nrOutputSamplesPerPaddedSecond") + ") + " + outputSample;
+  } else if ( outputLayout == LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    return "((" + beam + ") * " + getGeometryOpenCL(generic, nrOutputSamples * observation.getNrPaddedChannels(), "nrOutputSamplesPerPaddedSecond * nrPaddedChannels") + ") + ((" + outputSample + ") * " + getGeometryOpenCL(generic, observation.getNrPaddedChannels(), "nrPaddedChannels") + ") + " + channel;
+  }
+  return "((" + beam + ") * " + getGeometryOpenCL(generic, observation.getNrChannels() * nrOutputSamples, "nrChannels * nrOutputSamplesPerPaddedSecond") + ") + ((" + channel + ") * " + getGeometryOpenCL(generic, nrOutputSamples, "nrOutputSamplesPerPaddedSecond") + ") + " + outputSample;
+}
+
+std::string getGeometryOpenCL(const bool generic, const unsigned int value, const std::string & expression) {
+  if ( generic ) {
+    return "(" + expression + ")";
+  }
+  return isa::utils::toString(value);
+}
+
+std::string getLoadSampleOpenCL(const std::string & index, const std::string & inputDataType, const std::string & dataType) {
+  if ( inputDataType == "half" ) {
+    if ( dataType == "float" ) {
+      return "vload_half4(" + index + ", samples)";
+    }
+    return "convert_" + dataType + "4(vload_half4(" + index + ", samples))";
+  } else if ( inputDataType == dataType ) {
+    return "samples[" + index + "]";
+  }
+  return "convert_" + dataType + "4(samples[" + index + "])";
+}
+
 } // RadioAstronomy
 
 #endif // BEAM_FORMER_HPP
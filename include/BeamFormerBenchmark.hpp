@@ -0,0 +1,161 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <Observation.hpp>
+
+
+#ifndef BEAM_FORMER_BENCHMARK_HPP
+#define BEAM_FORMER_BENCHMARK_HPP
+
+namespace RadioAstronomy {
+
+// Named observation used to benchmark the CPU engines; the seconds are shortened, so that a run fits in the memory of a workstation
+class BeamFormerGeometry {
+public:
+  BeamFormerGeometry(const std::string & name, const unsigned int nrBeams, const unsigned int nrStations, const unsigned int nrChannels, const unsigned int nrSamples);
+  ~BeamFormerGeometry();
+  // The observation of the geometry, with samples padded to padding bytes
+  AstroData::Observation getObservation(const unsigned int padding) const;
+
+  std::string name;
+  unsigned int nrBeams;
+  unsigned int nrStations;
+  unsigned int nrChannels;
+  unsigned int nrSamples;
+};
+
+// LOFAR-like: tied-array beams of the core stations; Apertif-like: many beams of a few dishes; SKA-like: few beams of many stations
+std::vector< BeamFormerGeometry > getReferenceGeometries();
+
+// Performance of an engine, with a number of threads, on a reference geometry
+class BeamFormerBenchmarkEntry {
+public:
+  BeamFormerBenchmarkEntry();
+  ~BeamFormerBenchmarkEntry();
+  // Two entries have the same key if they describe the same geometry, engine and threads
+  bool sameKey(const BeamFormerBenchmarkEntry & entry) const;
+
+  std::string geometry;
+  std::string engine;
+  unsigned int nrThreads;
+  double gflops;
+};
+
+typedef std::vector< BeamFormerBenchmarkEntry > BeamFormerBenchmarkBaseline;
+
+// The baseline is a text file with one entry per line, lines starting with # are ignored: geometry engine threads GFLOP/s
+// Baselines are only meaningful on the machine where they were measured
+void readBeamFormerBenchmarkBaseline(BeamFormerBenchmarkBaseline & baseline, const std::string & filename);
+void writeBeamFormerBenchmarkBaseline(const BeamFormerBenchmarkBaseline & baseline, const std::string & filename);
+// Adds the entry, or replaces the entry with the same key
+void updateBeamFormerBenchmarkBaseline(BeamFormerBenchmarkBaseline & baseline, const BeamFormerBenchmarkEntry & entry);
+// Returns the entry with the same key, or null if the baseline does not contain it
+const BeamFormerBenchmarkEntry * findBeamFormerBenchmarkEntry(const BeamFormerBenchmarkBaseline & baseline, const BeamFormerBenchmarkEntry & entry);
+
+// Implementations
+BeamFormerGeometry::BeamFormerGeometry(const std::string & name, const unsigned int nrBeams, const unsigned int nrStations, const unsigned int nrChannels, const unsigned int nrSamples) : name(name), nrBeams(nrBeams), nrStations(nrStations), nrChannels(nrChannels), nrSamples(nrSamples) {}
+
+BeamFormerGeometry::~BeamFormerGeometry() {}
+
+AstroData::Observation BeamFormerGeometry::getObservation(const unsigned int padding) const {
+  AstroData::Observation observation;
+
+  observation.setPadding(padding);
+  observation.setNrBeams(nrBeams);
+  observation.setNrStations(nrStations);
+  observation.setFrequencyRange(nrChannels, 0, 0);
+  observation.setNrSamplesPerSecond(nrSamples);
+  return observation;
+}
+
+std::vector< BeamFormerGeometry > getReferenceGeometries() {
+  std::vector< BeamFormerGeometry > geometries;
+
+  geometries.push_back(BeamFormerGeometry("LOFAR", 127, 48, 32, 1024));
+  geometries.push_back(BeamFormerGeometry("Apertif", 384, 12, 16, 1024));
+  geometries.push_back(BeamFormerGeometry("SKA", 64, 512, 16, 512));
+  return geometries;
+}
+
+BeamFormerBenchmarkEntry::BeamFormerBenchmarkEntry() : nrThreads(0), gflops(0.0) {}
+
+BeamFormerBenchmarkEntry::~BeamFormerBenchmarkEntry() {}
+
+bool BeamFormerBenchmarkEntry::sameKey(const BeamFormerBenchmarkEntry & entry) const {
+  return (geometry == entry.geometry) && (engine == entry.engine) && (nrThreads == entry.nrThreads);
+}
+
+void readBeamFormerBenchmarkBaseline(BeamFormerBenchmarkBaseline & baseline, const std::string & filename) {
+  std::string line;
+  std::ifstream file(filename.c_str());
+
+  // A missing baseline is an empty baseline
+  if ( !file ) {
+    return;
+  }
+  while ( std::getline(file, line) ) {
+    std::istringstream fields(line);
+    BeamFormerBenchmarkEntry entry;
+
+    if ( line.empty() || (line[0] == '#') ) {
+      continue;
+    }
+    fields >> entry.geometry >> entry.engine >> entry.nrThreads >> entry.gflops;
+    if ( fields.fail() ) {
+      throw std::runtime_error("Malformed line in benchmark baseline " + filename + ": " + line);
+    }
+    baseline.push_back(entry);
+  }
+}
+
+void writeBeamFormerBenchmarkBaseline(const BeamFormerBenchmarkBaseline & baseline, const std::string & filename) {
+  std::ofstream file(filename.c_str());
+
+  if ( !file ) {
+    throw std::runtime_error("Impossible to write benchmark baseline " + filename);
+  }
+  file << "# geometry engine threads GFLOP/s" << std::endl;
+  for ( BeamFormerBenchmarkBaseline::const_iterator entry = baseline.begin(); entry != baseline.end(); ++entry ) {
+    file << entry->geometry << " " << entry->engine << " " << entry->nrThreads << " " << entry->gflops << std::endl;
+  }
+}
+
+void updateBeamFormerBenchmarkBaseline(BeamFormerBenchmarkBaseline & baseline, const BeamFormerBenchmarkEntry & entry) {
+  for ( BeamFormerBenchmarkBaseline::iterator item = baseline.begin(); item != baseline.end(); ++item ) {
+    if ( item->sameKey(entry) ) {
+      *item = entry;
+      return;
+    }
+  }
+  baseline.push_back(entry);
+}
+
+const BeamFormerBenchmarkEntry * findBeamFormerBenchmarkEntry(const BeamFormerBenchmarkBaseline & baseline, const BeamFormerBenchmarkEntry & entry) {
+  for ( BeamFormerBenchmarkBaseline::const_iterator item = baseline.begin(); item != baseline.end(); ++item ) {
+    if ( item->sameKey(entry) ) {
+      return &(*item);
+    }
+  }
+  return 0;
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_BENCHMARK_HPP
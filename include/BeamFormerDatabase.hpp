@@ -0,0 +1,217 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+
+#include <utils.hpp>
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+
+
+#ifndef BEAM_FORMER_DATABASE_HPP
+#define BEAM_FORMER_DATABASE_HPP
+
+namespace RadioAstronomy {
+
+// Best known configuration of the OpenCL kernel for a device, data types, output and observation
+class BeamFormerTuningEntry {
+public:
+  BeamFormerTuningEntry();
+  ~BeamFormerTuningEntry();
+  // Two entries have the same key if they describe the same device, types, output and observation
+  bool sameKey(const BeamFormerTuningEntry & entry) const;
+
+  std::string deviceName;
+  std::string inputDataType;
+  std::string dataType;
+  OutputMode outputMode;
+  unsigned int nrSamplesPerIntegration;
+  unsigned int nrBeams;
+  unsigned int nrStations;
+  unsigned int nrChannels;
+  unsigned int nrSamples;
+  BeamFormerConf conf;
+  double gflops;
+};
+
+typedef std::vector< BeamFormerTuningEntry > BeamFormerTuningDatabase;
+
+// Device names are stored as a single token, with white space replaced by underscores
+std::string getDeviceKey(const std::string & deviceName);
+// The database is a text file with one entry per line, lines starting with # are ignored:
+// device inputDataType dataType outputMode integration beams stations channels samples local samplesPerBlock beamsPerBlock samplesPerThread beamsPerThread [channelsPerBlock [stationsPerThread [stationsPerBlock [doubleBuffer]]]] GFLOP/s
+// Parameters added after beamsPerThread are optional, and take their default value in older databases
+void readBeamFormerTuningDatabase(BeamFormerTuningDatabase & database, const std::string & filename);
+void writeBeamFormerTuningDatabase(const BeamFormerTuningDatabase & database, const std::string & filename);
+// Adds the entry, or replaces an entry with the same key if the new one is faster
+void updateBeamFormerTuningDatabase(BeamFormerTuningDatabase & database, const BeamFormerTuningEntry & entry);
+// Returns the configuration tuned for the observation, or the one tuned for the nearest observation among the configurations valid for it
+// Throws std::out_of_range if there is no valid configuration for device, types and output
+BeamFormerConf getBestBeamFormerConf(const BeamFormerTuningDatabase & database, const std::string & deviceName, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation);
+
+// Implementations
+BeamFormerTuningEntry::BeamFormerTuningEntry() : outputMode(OUTPUT_VOLTAGES), nrSamplesPerIntegration(1), nrBeams(0), nrStations(0), nrChannels(0), nrSamples(0), gflops(0.0) {}
+
+BeamFormerTuningEntry::~BeamFormerTuningEntry() {}
+
+bool BeamFormerTuningEntry::sameKey(const BeamFormerTuningEntry & entry) const {
+  return (deviceName == entry.deviceName) && (inputDataType == entry.inputDataType) && (dataType == entry.dataType) && (outputMode == entry.outputMode) && (nrSamplesPerIntegration == entry.nrSamplesPerIntegration) && (nrBeams == entry.nrBeams) && (nrStations == entry.nrStations) && (nrChannels == entry.nrChannels) && (nrSamples == entry.nrSamples);
+}
+
+std::string getDeviceKey(const std::string & deviceName) {
+  std::string key;
+
+  for ( unsigned int item = 0; item < deviceName.size(); item++ ) {
+    if ( deviceName[item] == '\0' ) {
+      break;
+    } else if ( (deviceName[item] == ' ') || (deviceName[item] == '\t') ) {
+      if ( !key.empty() && (key[key.size() - 1] != '_') ) {
+        key += '_';
+      }
+    } else {
+      key += deviceName[item];
+    }
+  }
+  if ( !key.empty() && (key[key.size() - 1] == '_') ) {
+    key.erase(key.size() - 1);
+  }
+  return key;
+}
+
+void readBeamFormerTuningDatabase(BeamFormerTuningDatabase & database, const std::string & filename) {
+  std::string line;
+  std::ifstream file(filename.c_str());
+
+  // A missing database is an empty database
+  if ( !file ) {
+    return;
+  }
+  while ( std::getline(file, line) ) {
+    std::istringstream fields(line);
+    BeamFormerTuningEntry entry;
+    unsigned int outputMode = 0;
+    bool localMem = false;
+    unsigned int nrSamplesPerBlock = 0;
+    unsigned int nrBeamsPerBlock = 0;
+    unsigned int nrSamplesPerThread = 0;
+    unsigned int nrBeamsPerThread = 0;
+    std::vector< double > values;
+    double value = 0.0;
+
+    if ( line.empty() || (line[0] == '#') ) {
+      continue;
+    }
+    fields >> entry.deviceName >> entry.inputDataType >> entry.dataType >> outputMode >> entry.nrSamplesPerIntegration;
+    fields >> entry.nrBeams >> entry.nrStations >> entry.nrChannels >> entry.nrSamples;
+    fields >> localMem >> nrSamplesPerBlock >> nrBeamsPerBlock >> nrSamplesPerThread >> nrBeamsPerThread;
+    if ( fields.fail() || (outputMode > OUTPUT_STOKES_IQUV) ) {
+      throw std::runtime_error("Malformed line in tuning database " + filename + ": " + line);
+    }
+    // The optional parameters are followed by the GFLOP/s
+    while ( fields >> value ) {
+      values.push_back(value);
+    }
+    if ( !fields.eof() || values.empty() || (values.size() > 5) ) {
+      throw std::runtime_error("Malformed line in tuning database " + filename + ": " + line);
+    }
+    entry.gflops = values.back();
+    if ( values.size() > 1 ) {
+      entry.conf.setNrChannelsPerBlock(static_cast< unsigned int >(values[0]));
+    }
+    if ( values.size() > 2 ) {
+      entry.conf.setNrStationsPerThread(static_cast< unsigned int >(values[1]));
+    }
+    if ( values.size() > 3 ) {
+      entry.conf.setNrStationsPerBlock(static_cast< unsigned int >(values[2]));
+    }
+    if ( values.size() > 4 ) {
+      entry.conf.setDoubleBuffer(values[3] != 0.0);
+    }
+    entry.outputMode = static_cast< OutputMode >(outputMode);
+    entry.conf.setLocalMem(localMem);
+    entry.conf.setNrSamplesPerBlock(nrSamplesPerBlock);
+    entry.conf.setNrBeamsPerBlock(nrBeamsPerBlock);
+    entry.conf.setNrSamplesPerThread(nrSamplesPerThread);
+    entry.conf.setNrBeamsPerThread(nrBeamsPerThread);
+    database.push_back(entry);
+  }
+}
+
+void writeBeamFormerTuningDatabase(const BeamFormerTuningDatabase & database, const std::string & filename) {
+  std::ofstream file(filename.c_str());
+
+  if ( !file ) {
+    throw std::runtime_error("Impossible to write tuning database " + filename);
+  }
+  file << "# device inputDataType dataType outputMode integration beams stations channels samples local samplesPerBlock beamsPerBlock samplesPerThread beamsPerThread channelsPerBlock stationsPerThread stationsPerBlock doubleBuffer GFLOP/s" << std::endl;
+  for ( BeamFormerTuningDatabase::const_iterator entry = database.begin(); entry != database.end(); ++entry ) {
+    file << entry->deviceName << " " << entry->inputDataType << " " << entry->dataType << " " << entry->outputMode << " " << entry->nrSamplesPerIntegration << " ";
+    file << entry->nrBeams << " " << entry->nrStations << " " << entry->nrChannels << " " << entry->nrSamples << " ";
+    file << entry->conf.print() << " " << entry->gflops << std::endl;
+  }
+}
+
+void updateBeamFormerTuningDatabase(BeamFormerTuningDatabase & database, const BeamFormerTuningEntry & entry) {
+  for ( BeamFormerTuningDatabase::iterator item = database.begin(); item != database.end(); ++item ) {
+    if ( item->sameKey(entry) ) {
+      if ( entry.gflops > item->gflops ) {
+        *item = entry;
+      }
+      return;
+    }
+  }
+  database.push_back(entry);
+}
+
+BeamFormerConf getBestBeamFormerConf(const BeamFormerTuningDatabase & database, const std::string & deviceName, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation) {
+  const std::string deviceKey = getDeviceKey(deviceName);
+  double bestDistance = std::numeric_limits< double >::max();
+  BeamFormerTuningDatabase::const_iterator best = database.end();
+
+  for ( BeamFormerTuningDatabase::const_iterator entry = database.begin(); entry != database.end(); ++entry ) {
+    if ( (entry->deviceName != deviceKey) || (entry->inputDataType != inputDataType) || (entry->dataType != dataType) || (entry->outputMode != outputMode) ) {
+      continue;
+    } else if ( !entry->conf.isValid(observation, outputMode, nrSamplesPerIntegration) ) {
+      continue;
+    }
+    // Distance in log space, so that sizes are compared by ratio; a different integration counts as a doubling
+    double distance = 0.0;
+
+    distance += std::pow(std::log(static_cast< double >(entry->nrBeams) / observation.getNrBeams()), 2.0);
+    distance += std::pow(std::log(static_cast< double >(entry->nrStations) / observation.getNrStations()), 2.0);
+    distance += std::pow(std::log(static_cast< double >(entry->nrChannels) / observation.getNrChannels()), 2.0);
+    distance += std::pow(std::log(static_cast< double >(entry->nrSamples) / observation.getNrSamplesPerSecond()), 2.0);
+    if ( entry->nrSamplesPerIntegration != nrSamplesPerIntegration ) {
+      distance += std::pow(std::log(2.0), 2.0);
+    }
+    if ( (distance < bestDistance) || ((distance == bestDistance) && (entry->gflops > best->gflops)) ) {
+      bestDistance = distance;
+      best = entry;
+    }
+  }
+  if ( best == database.end() ) {
+    throw std::out_of_range("No tuned configuration for " + deviceKey + " (" + inputDataType + ", " + dataType + ").");
+  }
+  return best->conf;
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_DATABASE_HPP
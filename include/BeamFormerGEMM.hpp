@@ -0,0 +1,233 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef HAVE_CBLAS_CGEMM_BATCH
+#include <mkl.h>
+#endif
+
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+#include <BufferPool.hpp>
+
+
+#ifndef BEAM_FORMER_GEMM_HPP
+#define BEAM_FORMER_GEMM_HPP
+
+namespace RadioAstronomy {
+
+// Per channel, the beams are the complex matrix product weights^T [beam x station] * samples [station x (sample, polarization)]
+enum GEMMBackend { GEMM_INTERNAL = 0, GEMM_BLAS };
+
+// Size of the register blocks of the internal micro-kernel: beams x (sample, polarization) columns
+const unsigned int GEMM_ROWS = 4;
+const unsigned int GEMM_COLUMNS = 8;
+
+// The BLAS backend is available only if a batched CGEMM was found at configure time
+GEMMBackend getGEMMBackend();
+// Fastest backend for the types, output mode and layout; the BLAS backend computes only float samples and voltage output in the default layout
+template< typename I, typename T > GEMMBackend getGEMMBackend(const OutputMode outputMode, const OutputLayout outputLayout);
+template< > GEMMBackend getGEMMBackend< float, float >(const OutputMode outputMode, const OutputLayout outputLayout);
+std::string getGEMMBackendName(const GEMMBackend backend);
+// Beam forming as a blocked complex matrix product batched across channels; tile sizes are the GEMM blocking factors
+// Samples are widened to T while packing; a backend that cannot compute the types, output mode and layout throws std::invalid_argument
+template< typename I, typename T > void beamFormerGEMM(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE, const GEMMBackend backend = getGEMMBackend(), Profiler * profiler = 0);
+template< > void beamFormerGEMM< float, float >(const AstroData::Observation & observation, std::vector< float > & samples, std::vector< float > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const GEMMBackend backend, Profiler * profiler);
+template< typename I, typename T > void beamFormerTileGEMM(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, T * const accumulators);
+template< typename T > void beamFormerMicroKernelGEMM(const unsigned int nrStations, const T * const packedWeights, const T * const packedSamples, const unsigned int nrRows, const unsigned int nrColumns, const unsigned int rowStride, T * const accumulators);
+#ifdef HAVE_CBLAS_CGEMM_BATCH
+void beamFormerBLAS(const AstroData::Observation & observation, std::vector< float > & samples, std::vector< float > & output, std::vector< float > & weights);
+#endif
+
+// Implementations
+GEMMBackend getGEMMBackend() {
+#ifdef HAVE_CBLAS_CGEMM_BATCH
+  return GEMM_BLAS;
+#else
+  return GEMM_INTERNAL;
+#endif
+}
+
+template< typename I, typename T > GEMMBackend getGEMMBackend(const OutputMode, const OutputLayout) {
+  return GEMM_INTERNAL;
+}
+
+template< > GEMMBackend getGEMMBackend< float, float >(const OutputMode outputMode, const OutputLayout outputLayout) {
+  if ( (outputMode == OUTPUT_VOLTAGES) && (outputLayout == LAYOUT_BEAM_CHANNEL_SAMPLE) ) {
+    return getGEMMBackend();
+  }
+  return GEMM_INTERNAL;
+}
+
+std::string getGEMMBackendName(const GEMMBackend backend) {
+  if ( backend == GEMM_BLAS ) {
+    return "BLAS";
+  }
+  return "internal";
+}
+
+template< typename I, typename T > void beamFormerGEMM(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const GEMMBackend backend, Profiler * profiler) {
+  if ( backend > getGEMMBackend< I, T >(outputMode, outputLayout) ) {
+    throw std::invalid_argument("The " + getGEMMBackendName(backend) + " GEMM backend computes only float samples.");
+  }
+  beamFormerTiled< I, T >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, beamFormerTileGEMM< I, T >, 0, profiler);
+}
+
+template< > void beamFormerGEMM< float, float >(const AstroData::Observation & observation, std::vector< float > & samples, std::vector< float > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const GEMMBackend backend, Profiler * profiler) {
+  if ( backend > getGEMMBackend< float, float >(outputMode, outputLayout) ) {
+    throw std::invalid_argument("The " + getGEMMBackendName(backend) + " GEMM backend is not available, or does not compute this output mode and layout.");
+  }
+#ifdef HAVE_CBLAS_CGEMM_BATCH
+  if ( backend == GEMM_BLAS ) {
+    const double started = (profiler != 0) ? profiler->now() : 0.0;
+
+    beamFormerBLAS(observation, samples, output, weights);
+    if ( profiler != 0 ) {
+      // The library does not expose its stages
+      const double ended = profiler->now();
+
+      profiler->record("compute", "BLAS", started, ended, ended - started, getBeamFormerFLOP(observation, outputMode), (samples.size() + output.size() + weights.size()) * sizeof(float));
+    }
+    return;
+  }
+#endif
+  beamFormerTiled< float, float >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, beamFormerTileGEMM< float, float >, 0, profiler);
+}
+
+template< typename I, typename T > void beamFormerTileGEMM(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, T * const accumulators) {
+  const unsigned int nrTileColumns = nrTileSamples * 2;
+  const unsigned int nrRowPanels = (nrTileBeams + GEMM_ROWS - 1) / GEMM_ROWS;
+  const unsigned int nrColumnPanels = (nrTileColumns + GEMM_COLUMNS - 1) / GEMM_COLUMNS;
+  // Packed panels are planar (real, then imaginary) and zero padded to whole register blocks
+  AlignedBuffer< T > * packedWeightsBuffer = getScratchPool< T >().acquire(nrRowPanels * nrStationsPerTile * GEMM_ROWS * 2);
+  AlignedBuffer< T > * packedSamplesBuffer = getScratchPool< T >().acquire(nrColumnPanels * nrStationsPerTile * GEMM_COLUMNS * 2);
+  T * const packedWeights = packedWeightsBuffer->data();
+  T * const packedSamples = packedSamplesBuffer->data();
+
+  std::fill(accumulators, accumulators + (nrTileBeams * nrTileSamples * 4), 0);
+  for ( unsigned int firstStation = 0; firstStation < observation.getNrStations(); firstStation += nrStationsPerTile ) {
+    const unsigned int nrTileStations = std::min(nrStationsPerTile, observation.getNrStations() - firstStation);
+
+    for ( unsigned int panel = 0; panel < nrRowPanels; panel++ ) {
+      for ( unsigned int station = 0; station < nrTileStations; station++ ) {
+        T * const panelPointer = &(packedWeights[(panel * nrStationsPerTile * GEMM_ROWS * 2) + (station * GEMM_ROWS * 2)]);
+        const float * const weightPointer = &(weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + ((firstStation + station) * observation.getNrPaddedBeams() * 2) + (firstBeam * 2)]);
+
+        for ( unsigned int row = 0; row < GEMM_ROWS; row++ ) {
+          const unsigned int beam = (panel * GEMM_ROWS) + row;
+
+          panelPointer[row] = (beam < nrTileBeams) ? weightPointer[(beam * 2)] : 0;
+          panelPointer[GEMM_ROWS + row] = (beam < nrTileBeams) ? weightPointer[(beam * 2) + 1] : 0;
+        }
+      }
+    }
+    for ( unsigned int panel = 0; panel < nrColumnPanels; panel++ ) {
+      for ( unsigned int station = 0; station < nrTileStations; station++ ) {
+        T * const panelPointer = &(packedSamples[(panel * nrStationsPerTile * GEMM_COLUMNS * 2) + (station * GEMM_COLUMNS * 2)]);
+        const I * const samplePointer = &(samples[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + ((firstStation + station) * observation.getNrSamplesPerPaddedSecond() * 4) + (firstSample * 4)]);
+
+        for ( unsigned int column = 0; column < GEMM_COLUMNS; column++ ) {
+          const unsigned int item = (panel * GEMM_COLUMNS) + column;
+
+          panelPointer[column] = (item < nrTileColumns) ? samplePointer[(item * 2)] : 0;
+          panelPointer[GEMM_COLUMNS + column] = (item < nrTileColumns) ? samplePointer[(item * 2) + 1] : 0;
+        }
+      }
+    }
+
+    for ( unsigned int rowPanel = 0; rowPanel < nrRowPanels; rowPanel++ ) {
+      for ( unsigned int columnPanel = 0; columnPanel < nrColumnPanels; columnPanel++ ) {
+        const unsigned int nrRows = std::min(GEMM_ROWS, nrTileBeams - (rowPanel * GEMM_ROWS));
+        const unsigned int nrColumns = std::min(GEMM_COLUMNS, nrTileColumns - (columnPanel * GEMM_COLUMNS));
+
+        beamFormerMicroKernelGEMM< T >(nrTileStations, &(packedWeights[rowPanel * nrStationsPerTile * GEMM_ROWS * 2]), &(packedSamples[columnPanel * nrStationsPerTile * GEMM_COLUMNS * 2]), nrRows, nrColumns, nrTileColumns * 2, &(accumulators[(rowPanel * GEMM_ROWS * nrTileColumns * 2) + (columnPanel * GEMM_COLUMNS * 2)]));
+      }
+    }
+  }
+  getScratchPool< T >().release(packedWeightsBuffer);
+  getScratchPool< T >().release(packedSamplesBuffer);
+}
+
+template< typename T > void beamFormerMicroKernelGEMM(const unsigned int nrStations, const T * const packedWeights, const T * const packedSamples, const unsigned int nrRows, const unsigned int nrColumns, const unsigned int rowStride, T * const accumulators) {
+  T sums_r[GEMM_ROWS][GEMM_COLUMNS];
+  T sums_i[GEMM_ROWS][GEMM_COLUMNS];
+
+  for ( unsigned int row = 0; row < GEMM_ROWS; row++ ) {
+    for ( unsigned int column = 0; column < GEMM_COLUMNS; column++ ) {
+      sums_r[row][column] = 0;
+      sums_i[row][column] = 0;
+    }
+  }
+  // The whole register block is always computed, the padding of the panels is zero
+  for ( unsigned int station = 0; station < nrStations; station++ ) {
+    const T * const weightPointer = &(packedWeights[station * GEMM_ROWS * 2]);
+    const T * const samplePointer = &(packedSamples[station * GEMM_COLUMNS * 2]);
+
+    for ( unsigned int row = 0; row < GEMM_ROWS; row++ ) {
+      const T weight_r = weightPointer[row];
+      const T weight_i = weightPointer[GEMM_ROWS + row];
+
+      for ( unsigned int column = 0; column < GEMM_COLUMNS; column++ ) {
+        sums_r[row][column] += (samplePointer[column] * weight_r) - (samplePointer[GEMM_COLUMNS + column] * weight_i);
+        sums_i[row][column] += (samplePointer[column] * weight_i) + (samplePointer[GEMM_COLUMNS + column] * weight_r);
+      }
+    }
+  }
+  for ( unsigned int row = 0; row < nrRows; row++ ) {
+    for ( unsigned int column = 0; column < nrColumns; column++ ) {
+      accumulators[(row * rowStride) + (column * 2)] += sums_r[row][column];
+      accumulators[(row * rowStride) + (column * 2) + 1] += sums_i[row][column];
+    }
+  }
+}
+
+#ifdef HAVE_CBLAS_CGEMM_BATCH
+void beamFormerBLAS(const AstroData::Observation & observation, std::vector< float > & samples, std::vector< float > & output, std::vector< float > & weights) {
+  // A single group containing one product per channel
+  const MKL_INT groupSize = observation.getNrChannels();
+  const CBLAS_TRANSPOSE transposeWeights = CblasTrans;
+  const CBLAS_TRANSPOSE transposeSamples = CblasNoTrans;
+  const MKL_INT nrRows = observation.getNrBeams();
+  const MKL_INT nrColumns = observation.getNrSamplesPerSecond() * 2;
+  const MKL_INT nrStations = observation.getNrStations();
+  const MKL_INT weightsStride = observation.getNrPaddedBeams();
+  const MKL_INT samplesStride = observation.getNrSamplesPerPaddedSecond() * 2;
+  const MKL_INT outputStride = observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 2;
+  MKL_Complex8 alpha;
+  MKL_Complex8 beta;
+  std::vector< const void * > weightsPointers(observation.getNrChannels());
+  std::vector< const void * > samplesPointers(observation.getNrChannels());
+  std::vector< void * > outputPointers(observation.getNrChannels());
+
+  alpha.real = 1.0f / observation.getNrStations();
+  alpha.imag = 0.0f;
+  beta.real = 0.0f;
+  beta.imag = 0.0f;
+  for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+    weightsPointers[channel] = &(weights.data()[channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2]);
+    samplesPointers[channel] = &(samples.data()[channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4]);
+    outputPointers[channel] = &(output.data()[channel * observation.getNrSamplesPerPaddedSecond() * 4]);
+  }
+  cblas_cgemm_batch(CblasRowMajor, &transposeWeights, &transposeSamples, &nrRows, &nrColumns, &nrStations, &alpha, weightsPointers.data(), &weightsStride, samplesPointers.data(), &samplesStride, &beta, outputPointers.data(), &outputStride, 1, &groupSize);
+}
+#endif // HAVE_CBLAS_CGEMM_BATCH
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_GEMM_HPP
+
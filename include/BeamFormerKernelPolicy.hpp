@@ -0,0 +1,186 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <stdexcept>
+
+#include <Kernel.hpp>
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <BeamFormer.hpp>
+#include <KernelCache.hpp>
+
+
+#ifndef BEAM_FORMER_KERNEL_POLICY_HPP
+#define BEAM_FORMER_KERNEL_POLICY_HPP
+
+namespace RadioAstronomy {
+
+// Serves the generic kernel, compiled once for every geometry, until the kernel specialized for the geometry of the observation
+// has been compiled on a background thread; specialized kernels are kept, so going back to a geometry is immediate
+// The policy is used by one thread at a time
+class BeamFormerKernelPolicy {
+public:
+  BeamFormerKernelPolicy(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory = std::string());
+  ~BeamFormerKernelPolicy();
+  // Kernel for the observation; the caller sets the first three arguments, the geometry arguments of the generic kernel are already set
+  // A new geometry starts the compilation of its specialized kernel, unless another compilation is running or conf is not valid for it
+  // Throws std::invalid_argument if not even the generic kernel can run on the observation
+  cl::Kernel & getKernel(const AstroData::Observation & observation);
+  // Configuration of the kernel last returned by getKernel, to compute its NDRange
+  const BeamFormerConf & getConf() const;
+  bool isSpecialized() const;
+  // Waits for the running compilation, if any
+  void wait();
+
+private:
+  void compile(const AstroData::Observation observation);
+
+  BeamFormerConf conf;
+  BeamFormerConf genericConf;
+  BeamFormerConf servedConf;
+  OutputMode outputMode;
+  unsigned int nrSamplesPerIntegration;
+  OutputLayout outputLayout;
+  bool generateWeights;
+  std::string inputDataType;
+  std::string dataType;
+  cl::Context clContext;
+  cl::Device clDevice;
+  std::string cacheDirectory;
+  cl::Kernel * generic;
+  // Specialized kernels by geometry, a null kernel failed to compile
+  std::map< std::string, cl::Kernel * > specialized;
+  bool served;
+  // Geometry being compiled, empty if the compiler thread is not running
+  std::string compiling;
+  bool compiled;
+  std::mutex lock;
+  std::thread compiler;
+};
+
+// Sets the geometry arguments of a kernel generated by getBeamFormerGenericOpenCL
+void setBeamFormerGenericArguments(cl::Kernel & kernel, const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration);
+// Observations with the same key have the same specialized kernels
+std::string getGeometryKey(const AstroData::Observation & observation);
+
+// Implementations
+BeamFormerKernelPolicy::BeamFormerKernelPolicy(const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const bool generateWeights, const std::string & inputDataType, const std::string & dataType, const AstroData::Observation & observation, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory) : conf(conf), genericConf(conf), servedConf(conf), outputMode(outputMode), nrSamplesPerIntegration(nrSamplesPerIntegration), outputLayout(outputLayout), generateWeights(generateWeights), inputDataType(inputDataType), dataType(dataType), clContext(clContext), clDevice(clDevice), cacheDirectory(cacheDirectory), generic(0), served(false), compiled(false) {
+  // The generic kernel does not split or block the stations
+  genericConf.setNrStationsPerThread(0);
+  genericConf.setNrStationsPerBlock(0);
+  std::string * code = getBeamFormerGenericOpenCL(genericConf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputDataType, dataType, observation);
+
+  try {
+    generic = compileCached("beamFormer", *code, "-cl-mad-enable -Werror", this->clContext, this->clDevice, cacheDirectory);
+  } catch ( isa::OpenCL::OpenCLError & err ) {
+    delete code;
+    throw;
+  }
+  delete code;
+}
+
+BeamFormerKernelPolicy::~BeamFormerKernelPolicy() {
+  if ( compiler.joinable() ) {
+    compiler.join();
+  }
+  for ( std::map< std::string, cl::Kernel * >::iterator kernel = specialized.begin(); kernel != specialized.end(); ++kernel ) {
+    delete kernel->second;
+  }
+  delete generic;
+}
+
+cl::Kernel & BeamFormerKernelPolicy::getKernel(const AstroData::Observation & observation) {
+  const std::string key = getGeometryKey(observation);
+  std::unique_lock< std::mutex > guard(lock);
+
+  // The compiler thread is done once it has stored its kernel
+  if ( !compiling.empty() && compiled ) {
+    compiler.join();
+    compiling.clear();
+  }
+  std::map< std::string, cl::Kernel * >::iterator kernel = specialized.find(key);
+  if ( (kernel != specialized.end()) && (kernel->second != 0) ) {
+    servedConf = conf;
+    served = true;
+    return *(kernel->second);
+  } else if ( (kernel == specialized.end()) && compiling.empty() && conf.isValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    compiling = key;
+    compiled = false;
+    compiler = std::thread(&BeamFormerKernelPolicy::compile, this, observation);
+  }
+  if ( !genericConf.isValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    throw std::invalid_argument("The beam former configuration " + genericConf.print() + " is not valid for the observation.");
+  }
+  setBeamFormerGenericArguments(*generic, observation, outputMode, nrSamplesPerIntegration);
+  servedConf = genericConf;
+  served = false;
+  return *generic;
+}
+
+inline const BeamFormerConf & BeamFormerKernelPolicy::getConf() const {
+  return servedConf;
+}
+
+inline bool BeamFormerKernelPolicy::isSpecialized() const {
+  return served;
+}
+
+void BeamFormerKernelPolicy::wait() {
+  std::unique_lock< std::mutex > guard(lock);
+
+  if ( !compiling.empty() ) {
+    // The compiler thread needs the lock to store its kernel
+    guard.unlock();
+    compiler.join();
+    guard.lock();
+    compiling.clear();
+  }
+}
+
+void BeamFormerKernelPolicy::compile(const AstroData::Observation observation) {
+  cl::Kernel * kernel = 0;
+
+  try {
+    kernel = compileCached("beamFormer", getBeamFormerOpenCLMemo(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputDataType, dataType, observation), "-cl-mad-enable -Werror", clContext, clDevice, cacheDirectory);
+  } catch ( isa::OpenCL::OpenCLError & err ) {
+    // The generic kernel keeps being served for this geometry
+    kernel = 0;
+  }
+  std::unique_lock< std::mutex > guard(lock);
+
+  specialized[getGeometryKey(observation)] = kernel;
+  compiled = true;
+}
+
+void setBeamFormerGenericArguments(cl::Kernel & kernel, const AstroData::Observation & observation, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration) {
+  kernel.setArg(3, observation.getNrBeams());
+  kernel.setArg(4, observation.getNrPaddedBeams());
+  kernel.setArg(5, observation.getNrStations());
+  kernel.setArg(6, observation.getNrChannels());
+  kernel.setArg(7, observation.getNrPaddedChannels());
+  kernel.setArg(8, observation.getNrSamplesPerPaddedSecond());
+  kernel.setArg(9, getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration));
+}
+
+std::string getGeometryKey(const AstroData::Observation & observation) {
+  return isa::utils::toString(observation.getNrBeams()) + " " + isa::utils::toString(observation.getNrStations()) + " " + isa::utils::toString(observation.getNrChannels()) + " " + isa::utils::toString(observation.getNrSamplesPerSecond()) + " " + isa::utils::toString(observation.getPadding());
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_KERNEL_POLICY_HPP
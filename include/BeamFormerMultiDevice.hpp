@@ -0,0 +1,632 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include <Observation.hpp>
+#include <Timer.hpp>
+#include <utils.hpp>
+#include <BeamFormer.hpp>
+#include <BufferPool.hpp>
+#include <Profiler.hpp>
+
+
+#ifndef BEAM_FORMER_MULTI_DEVICE_HPP
+#define BEAM_FORMER_MULTI_DEVICE_HPP
+
+namespace RadioAstronomy {
+
+// Contiguous range of channels, the unit of work of the scheduler
+struct ChannelChunk {
+  unsigned int firstChannel;
+  unsigned int nrChannels;
+};
+
+// Splits the channels of a second in chunks, and gives every worker a contiguous run of chunks in proportion to its measured throughput
+// A worker that is done with its run steals the last chunk of the worker with most chunks left; all methods but the getters are thread-safe
+class ChannelScheduler {
+public:
+  ChannelScheduler(const unsigned int nrWorkers, const unsigned int nrChannelsPerChunk, const double smoothing = 0.5);
+  ~ChannelScheduler();
+  // Get
+  unsigned int getNrWorkers() const;
+  unsigned int getNrChannelsPerChunk() const;
+  // Channels per second of busy time, zero until the worker computed its first chunk
+  double getThroughput(const unsigned int worker) const;
+  // Chunks computed by another worker than the one they were assigned to, since the last partition
+  unsigned int getNrStolenChunks() const;
+  // Utils
+  // Workers without a measured throughput are assumed to be as fast as the average measured worker
+  void partition(const unsigned int nrChannels);
+  // Returns false if no chunks are left
+  bool next(const unsigned int worker, ChannelChunk & chunk);
+  // Adds a measure of nrChannels computed in seconds of busy time; smoothing is the weight of the new measure
+  void update(const unsigned int worker, const unsigned int nrChannels, const double seconds);
+
+private:
+  unsigned int nrChannelsPerChunk;
+  double smoothing;
+  std::vector< std::deque< ChannelChunk > > chunks;
+  std::vector< double > throughput;
+  unsigned int nrStolenChunks;
+  std::mutex lock;
+};
+
+// A device, or a group of cores, beam forming chunks of channels for BeamFormerMultiDevice; every worker is driven by its own host thread
+template< typename I, typename T > class BeamFormerWorker {
+public:
+  virtual ~BeamFormerWorker();
+  virtual std::string getName() const = 0;
+  // Called on the thread of the worker before anything else, e.g. to pin it
+  virtual void start();
+  // Called on the thread of the worker, before the first second that uses the weights
+  virtual void setWeights(const std::vector< float > & weights) = 0;
+  // Beam forms the channels of chunk, and stores them in the output of the whole observation; other channels are not written
+  virtual void compute(const I * const samples, T * const output, const ChannelChunk & chunk) = 0;
+};
+
+// Cores of a NUMA node, usually a socket, running the tiled CPU engine on the chunks
+// The thread of the worker, and so the OpenMP threads it starts, are pinned to the cores; with OMP_PROC_BIND set, OpenMP may override the pinning
+template< typename I, typename T > class BeamFormerWorkerCPU : public BeamFormerWorker< I, T > {
+public:
+  BeamFormerWorkerCPU(const std::string & name, const std::vector< unsigned int > & cpus, const AstroData::Observation & observation, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE, typename TileFunction< I, T >::type tileFunction = beamFormerTile< I, T >);
+  ~BeamFormerWorkerCPU();
+  std::string getName() const;
+  void start();
+  // The copy is made on the thread of the worker, so that the weights are in the memory of its node
+  void setWeights(const std::vector< float > & weights);
+  void compute(const I * const samples, T * const output, const ChannelChunk & chunk);
+
+private:
+  std::string name;
+  std::vector< unsigned int > cpus;
+  AstroData::Observation observation;
+  std::vector< float > weights;
+  unsigned int nrSamplesPerTile;
+  unsigned int nrBeamsPerTile;
+  unsigned int nrStationsPerTile;
+  OutputMode outputMode;
+  unsigned int nrSamplesPerIntegration;
+  OutputLayout outputLayout;
+  typename TileFunction< I, T >::type tileFunction;
+};
+
+// Beam forms every second on several workers at once, e.g. the sockets of a node and its accelerators: channels are independent,
+// so they are partitioned over the workers by ChannelScheduler, and the partition follows the throughput the workers had in the previous seconds
+// Workers must not be shared between objects; the object owns, and deletes, its workers
+template< typename I, typename T > class BeamFormerMultiDevice {
+public:
+  BeamFormerMultiDevice(const AstroData::Observation & observation, const std::vector< float > & weights, const std::vector< BeamFormerWorker< I, T > * > & workers, const unsigned int nrChannelsPerChunk, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE);
+  ~BeamFormerMultiDevice();
+  BeamFormerMultiDevice(const BeamFormerMultiDevice< I, T > & multiDevice) = delete;
+  BeamFormerMultiDevice< I, T > & operator=(const BeamFormerMultiDevice< I, T > & multiDevice) = delete;
+  // Get
+  unsigned int getNrWorkers() const;
+  BeamFormerWorker< I, T > & getWorker(const unsigned int worker);
+  const ChannelScheduler & getScheduler() const;
+  // Utils
+  // Returns once all the channels of the second are in output; with profiler, the busy time of every worker is recorded
+  // An exception of a worker is thrown here, once the other workers are done; the chunks left by the failed worker are stolen by the others
+  void beamForm(std::vector< I > & samples, std::vector< T > & output, Profiler * profiler = 0);
+  void beamForm(const I * const samples, std::vector< T > & output, Profiler * profiler = 0);
+  // The weights are used from the next second on
+  void setWeights(const std::vector< float > & weights);
+  // Buffer for the samples of a second, whose channels are first written by the workers they are assigned to, so that with first-touch placement
+  // every CPU worker reads them from the memory of its own node; the caller deletes the buffer
+  AlignedBuffer< I > * allocateSamples();
+
+private:
+  enum Job { JOB_BEAM_FORM, JOB_TOUCH };
+  void run(const Job job);
+  void worker(const unsigned int worker);
+
+  AstroData::Observation observation;
+  OutputMode outputMode;
+  unsigned int nrSamplesPerIntegration;
+  OutputLayout outputLayout;
+  std::vector< BeamFormerWorker< I, T > * > workers;
+  ChannelScheduler scheduler;
+  std::vector< float > weights;
+  unsigned int weightsVersion;
+  // State of the current job, the workers are done when nrDone is the number of workers
+  Job job;
+  unsigned int generation;
+  unsigned int nrDone;
+  bool stopWorkers;
+  const I * samplesPointer;
+  I * touchPointer;
+  T * outputPointer;
+  std::vector< double > busyTime;
+  std::vector< unsigned int > nrComputedChannels;
+  std::exception_ptr error;
+  std::mutex lock;
+  std::condition_variable changed;
+  std::vector< std::thread > threads;
+};
+
+// Tiled CPU engine on the channels of chunk only
+template< typename I, typename T > void beamFormerChunk(const AstroData::Observation & observation, const I * const samples, T * const output, const float * const weights, const ChannelChunk & chunk, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction);
+// Observation containing only the channels of chunk
+AstroData::Observation getChunkObservation(const AstroData::Observation & observation, const ChannelChunk & chunk);
+// Copies the output of the observation of a chunk in the output of the whole observation
+template< typename T > void scatterChunkOutput(const AstroData::Observation & observation, const ChannelChunk & chunk, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const T * const chunkOutput, T * const output);
+// Cores of every NUMA node with cores, restricted to the cores the process can run on; without NUMA information, all the cores are one node
+void getNUMANodes(std::vector< std::vector< unsigned int > > & nodes);
+// Parses lists like 0-3,8,10-11
+void parseCPUList(const std::string & list, std::vector< unsigned int > & cpus);
+// Pins the calling thread to cpus, returns false if it is not possible
+bool pinThread(const std::vector< unsigned int > & cpus);
+
+// Implementations
+ChannelScheduler::ChannelScheduler(const unsigned int nrWorkers, const unsigned int nrChannelsPerChunk, const double smoothing) : nrChannelsPerChunk(std::max(nrChannelsPerChunk, 1u)), smoothing(smoothing), chunks(nrWorkers), throughput(nrWorkers, 0.0), nrStolenChunks(0) {}
+
+ChannelScheduler::~ChannelScheduler() {}
+
+inline unsigned int ChannelScheduler::getNrWorkers() const {
+  return chunks.size();
+}
+
+inline unsigned int ChannelScheduler::getNrChannelsPerChunk() const {
+  return nrChannelsPerChunk;
+}
+
+inline double ChannelScheduler::getThroughput(const unsigned int worker) const {
+  return throughput.at(worker);
+}
+
+inline unsigned int ChannelScheduler::getNrStolenChunks() const {
+  return nrStolenChunks;
+}
+
+void ChannelScheduler::partition(const unsigned int nrChannels) {
+  std::unique_lock< std::mutex > guard(lock);
+  const unsigned int nrChunks = (nrChannels + nrChannelsPerChunk - 1) / nrChannelsPerChunk;
+  unsigned int nrMeasured = 0;
+  double measured = 0.0;
+  double total = 0.0;
+  std::vector< double > shares(chunks.size());
+
+  for ( unsigned int worker = 0; worker < chunks.size(); worker++ ) {
+    if ( throughput[worker] > 0.0 ) {
+      measured += throughput[worker];
+      nrMeasured++;
+    }
+  }
+  for ( unsigned int worker = 0; worker < chunks.size(); worker++ ) {
+    if ( throughput[worker] > 0.0 ) {
+      shares[worker] = throughput[worker];
+    } else if ( nrMeasured > 0 ) {
+      shares[worker] = measured / nrMeasured;
+    } else {
+      shares[worker] = 1.0;
+    }
+    total += shares[worker];
+  }
+  unsigned int chunk = 0;
+  double cumulative = 0.0;
+
+  for ( unsigned int worker = 0; worker < chunks.size(); worker++ ) {
+    cumulative += shares[worker];
+    const unsigned int lastChunk = (worker == chunks.size() - 1) ? nrChunks : static_cast< unsigned int >(std::floor((nrChunks * (cumulative / total)) + 0.5));
+
+    chunks[worker].clear();
+    for ( ; chunk < lastChunk; chunk++ ) {
+      ChannelChunk item;
+
+      item.firstChannel = chunk * nrChannelsPerChunk;
+      item.nrChannels = std::min(nrChannelsPerChunk, nrChannels - item.firstChannel);
+      chunks[worker].push_back(item);
+    }
+  }
+  nrStolenChunks = 0;
+}
+
+bool ChannelScheduler::next(const unsigned int worker, ChannelChunk & chunk) {
+  std::unique_lock< std::mutex > guard(lock);
+  unsigned int victim = 0;
+
+  if ( !chunks.at(worker).empty() ) {
+    chunk = chunks[worker].front();
+    chunks[worker].pop_front();
+    return true;
+  }
+  // The chunk is taken from the end of the run, so that the straggler keeps reading contiguous channels
+  for ( unsigned int item = 1; item < chunks.size(); item++ ) {
+    if ( chunks[item].size() > chunks[victim].size() ) {
+      victim = item;
+    }
+  }
+  if ( chunks[victim].empty() ) {
+    return false;
+  }
+  chunk = chunks[victim].back();
+  chunks[victim].pop_back();
+  nrStolenChunks++;
+  return true;
+}
+
+void ChannelScheduler::update(const unsigned int worker, const unsigned int nrChannels, const double seconds) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  if ( (nrChannels == 0) || (seconds <= 0.0) ) {
+    return;
+  }
+  if ( throughput.at(worker) == 0.0 ) {
+    throughput[worker] = nrChannels / seconds;
+  } else {
+    throughput[worker] = (smoothing * (nrChannels / seconds)) + ((1.0 - smoothing) * throughput[worker]);
+  }
+}
+
+template< typename I, typename T > BeamFormerWorker< I, T >::~BeamFormerWorker() {}
+
+template< typename I, typename T > void BeamFormerWorker< I, T >::start() {}
+
+template< typename I, typename T > BeamFormerWorkerCPU< I, T >::BeamFormerWorkerCPU(const std::string & name, const std::vector< unsigned int > & cpus, const AstroData::Observation & observation, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction) : name(name), cpus(cpus), observation(observation), nrSamplesPerTile(nrSamplesPerTile), nrBeamsPerTile(nrBeamsPerTile), nrStationsPerTile(nrStationsPerTile), outputMode(outputMode), nrSamplesPerIntegration(nrSamplesPerIntegration), outputLayout(outputLayout), tileFunction(tileFunction) {}
+
+template< typename I, typename T > BeamFormerWorkerCPU< I, T >::~BeamFormerWorkerCPU() {}
+
+template< typename I, typename T > std::string BeamFormerWorkerCPU< I, T >::getName() const {
+  return name;
+}
+
+template< typename I, typename T > void BeamFormerWorkerCPU< I, T >::start() {
+  // An unpinned worker is slower, but still correct
+  pinThread(cpus);
+  omp_set_num_threads(std::max(static_cast< unsigned int >(cpus.size()), 1u));
+}
+
+template< typename I, typename T > void BeamFormerWorkerCPU< I, T >::setWeights(const std::vector< float > & weights) {
+  this->weights = weights;
+}
+
+template< typename I, typename T > void BeamFormerWorkerCPU< I, T >::compute(const I * const samples, T * const output, const ChannelChunk & chunk) {
+  beamFormerChunk< I, T >(observation, samples, output, weights.data(), chunk, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, tileFunction);
+}
+
+template< typename I, typename T > BeamFormerMultiDevice< I, T >::BeamFormerMultiDevice(const AstroData::Observation & observation, const std::vector< float > & weights, const std::vector< BeamFormerWorker< I, T > * > & workers, const unsigned int nrChannelsPerChunk, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout) : observation(observation), outputMode(outputMode), nrSamplesPerIntegration(nrSamplesPerIntegration), outputLayout(outputLayout), workers(workers), scheduler(workers.size(), nrChannelsPerChunk), weights(weights), weightsVersion(1), job(JOB_BEAM_FORM), generation(0), nrDone(0), stopWorkers(false), samplesPointer(0), touchPointer(0), outputPointer(0), busyTime(workers.size(), 0.0), nrComputedChannels(workers.size(), 0) {
+  if ( workers.empty() ) {
+    throw std::invalid_argument("The multi-device beam former needs at least one worker.");
+  }
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
+  for ( unsigned int worker = 0; worker < workers.size(); worker++ ) {
+    threads.push_back(std::thread(&BeamFormerMultiDevice< I, T >::worker, this, worker));
+  }
+}
+
+template< typename I, typename T > BeamFormerMultiDevice< I, T >::~BeamFormerMultiDevice() {
+  {
+    std::unique_lock< std::mutex > guard(lock);
+
+    stopWorkers = true;
+  }
+  changed.notify_all();
+  for ( unsigned int worker = 0; worker < threads.size(); worker++ ) {
+    threads[worker].join();
+  }
+  for ( unsigned int worker = 0; worker < workers.size(); worker++ ) {
+    delete workers[worker];
+  }
+}
+
+template< typename I, typename T > inline unsigned int BeamFormerMultiDevice< I, T >::getNrWorkers() const {
+  return workers.size();
+}
+
+template< typename I, typename T > inline BeamFormerWorker< I, T > & BeamFormerMultiDevice< I, T >::getWorker(const unsigned int worker) {
+  return *(workers.at(worker));
+}
+
+template< typename I, typename T > inline const ChannelScheduler & BeamFormerMultiDevice< I, T >::getScheduler() const {
+  return scheduler;
+}
+
+template< typename I, typename T > void BeamFormerMultiDevice< I, T >::beamForm(std::vector< I > & samples, std::vector< T > & output, Profiler * profiler) {
+  beamForm(static_cast< const I * >(samples.data()), output, profiler);
+}
+
+template< typename I, typename T > void BeamFormerMultiDevice< I, T >::beamForm(const I * const samples, std::vector< T > & output, Profiler * profiler) {
+  const double started = (profiler != 0) ? profiler->now() : 0.0;
+
+  output.resize(getOutputSize(observation, outputMode, nrSamplesPerIntegration, outputLayout));
+  samplesPointer = samples;
+  outputPointer = output.data();
+  scheduler.partition(observation.getNrChannels());
+  run(JOB_BEAM_FORM);
+  if ( profiler != 0 ) {
+    const double ended = profiler->now();
+    const double bytesPerChannel = (static_cast< double >(observation.getNrStations()) * observation.getNrSamplesPerPaddedSecond() * 4 * sizeof(I)) + (((output.size() * sizeof(T)) + (weights.size() * sizeof(float))) / observation.getNrChannels());
+
+    for ( unsigned int worker = 0; worker < workers.size(); worker++ ) {
+      const double share = static_cast< double >(nrComputedChannels[worker]) / observation.getNrChannels();
+
+      profiler->record("channels", workers[worker]->getName(), started, ended, busyTime[worker], getBeamFormerFLOP(observation, outputMode) * share, bytesPerChannel * nrComputedChannels[worker]);
+    }
+  }
+  if ( error ) {
+    std::rethrow_exception(error);
+  }
+}
+
+template< typename I, typename T > void BeamFormerMultiDevice< I, T >::setWeights(const std::vector< float > & weights) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  this->weights = weights;
+  weightsVersion++;
+}
+
+template< typename I, typename T > AlignedBuffer< I > * BeamFormerMultiDevice< I, T >::allocateSamples() {
+  // Pages are the unit of placement
+  AlignedBuffer< I > * samples = new AlignedBuffer< I >(static_cast< std::size_t >(observation.getNrChannels()) * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4, sysconf(_SC_PAGESIZE), false, false);
+
+  touchPointer = samples->data();
+  scheduler.partition(observation.getNrChannels());
+  run(JOB_TOUCH);
+  touchPointer = 0;
+  if ( error ) {
+    delete samples;
+    std::rethrow_exception(error);
+  }
+  return samples;
+}
+
+template< typename I, typename T > void BeamFormerMultiDevice< I, T >::run(const Job job) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  this->job = job;
+  nrDone = 0;
+  error = std::exception_ptr();
+  generation++;
+  changed.notify_all();
+  while ( nrDone < workers.size() ) {
+    changed.wait(guard);
+  }
+}
+
+template< typename I, typename T > void BeamFormerMultiDevice< I, T >::worker(const unsigned int worker) {
+  const std::size_t nrSamplesPerChannel = static_cast< std::size_t >(observation.getNrStations()) * observation.getNrSamplesPerPaddedSecond() * 4;
+  unsigned int seenGeneration = 0;
+  unsigned int seenWeights = 0;
+  std::exception_ptr startError;
+
+  try {
+    workers[worker]->start();
+  } catch ( ... ) {
+    // Reported at the first second
+    startError = std::current_exception();
+  }
+  while ( true ) {
+    Job currentJob = JOB_BEAM_FORM;
+    bool newWeights = false;
+    ChannelChunk chunk;
+    isa::utils::Timer timer;
+    unsigned int nrChannels = 0;
+    std::exception_ptr jobError = startError;
+
+    {
+      std::unique_lock< std::mutex > guard(lock);
+
+      while ( !stopWorkers && (generation == seenGeneration) ) {
+        changed.wait(guard);
+      }
+      if ( stopWorkers ) {
+        return;
+      }
+      seenGeneration = generation;
+      currentJob = job;
+      newWeights = (seenWeights != weightsVersion);
+      seenWeights = weightsVersion;
+    }
+    // A worker that failed to start does not take chunks, they are stolen by the others
+    if ( !startError ) {
+      try {
+        if ( newWeights ) {
+          workers[worker]->setWeights(weights);
+        }
+        while ( scheduler.next(worker, chunk) ) {
+          if ( currentJob == JOB_TOUCH ) {
+            std::memset(reinterpret_cast< void * >(touchPointer + (chunk.firstChannel * nrSamplesPerChannel)), 0, chunk.nrChannels * nrSamplesPerChannel * sizeof(I));
+          } else {
+            timer.start();
+            workers[worker]->compute(samplesPointer, outputPointer, chunk);
+            timer.stop();
+            nrChannels += chunk.nrChannels;
+          }
+        }
+      } catch ( ... ) {
+        jobError = std::current_exception();
+        // The weights are set again at the next second
+        seenWeights = 0;
+      }
+    }
+    if ( currentJob == JOB_BEAM_FORM ) {
+      scheduler.update(worker, nrChannels, timer.getTotalTime());
+    }
+    {
+      std::unique_lock< std::mutex > guard(lock);
+
+      busyTime[worker] = timer.getTotalTime();
+      nrComputedChannels[worker] = nrChannels;
+      if ( jobError && !error ) {
+        error = jobError;
+      }
+      nrDone++;
+    }
+    changed.notify_all();
+  }
+}
+
+template< typename I, typename T > void beamFormerChunk(const AstroData::Observation & observation, const I * const samples, T * const output, const float * const weights, const ChannelChunk & chunk, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, typename TileFunction< I, T >::type tileFunction) {
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
+  // Tiles contain whole integrations
+  const unsigned int nrSamplesPerIntegratedTile = (outputMode == OUTPUT_VOLTAGES) ? nrSamplesPerTile : isa::utils::pad(nrSamplesPerTile, nrSamplesPerIntegration);
+  const unsigned int nrSampleTiles = (observation.getNrSamplesPerSecond() + nrSamplesPerIntegratedTile - 1) / nrSamplesPerIntegratedTile;
+  const unsigned int nrBeamTiles = (observation.getNrBeams() + nrBeamsPerTile - 1) / nrBeamsPerTile;
+  const long long int nrTiles = static_cast< long long int >(chunk.nrChannels) * nrSampleTiles * nrBeamTiles;
+
+  #pragma omp parallel
+  {
+    AlignedBuffer< T > * accumulators = getScratchPool< T >().acquire(nrBeamsPerTile * nrSamplesPerIntegratedTile * 4);
+
+    #pragma omp for schedule(dynamic)
+    for ( long long int tile = 0; tile < nrTiles; tile++ ) {
+      const unsigned int channel = chunk.firstChannel + (tile / (nrSampleTiles * nrBeamTiles));
+      const unsigned int firstSample = ((tile / nrBeamTiles) % nrSampleTiles) * nrSamplesPerIntegratedTile;
+      const unsigned int firstBeam = (tile % nrBeamTiles) * nrBeamsPerTile;
+      const unsigned int nrTileSamples = std::min(nrSamplesPerIntegratedTile, observation.getNrSamplesPerSecond() - firstSample);
+      const unsigned int nrTileBeams = std::min(nrBeamsPerTile, observation.getNrBeams() - firstBeam);
+
+      tileFunction(observation, samples, weights, channel, firstSample, nrTileSamples, firstBeam, nrTileBeams, nrStationsPerTile, accumulators->data());
+      beamFormerStoreTile< T >(observation, accumulators->data(), channel, firstSample, nrTileSamples, firstBeam, nrTileBeams, outputMode, nrSamplesPerIntegration, outputLayout, output);
+    }
+    getScratchPool< T >().release(accumulators);
+  }
+}
+
+AstroData::Observation getChunkObservation(const AstroData::Observation & observation, const ChannelChunk & chunk) {
+  AstroData::Observation chunkObservation(observation);
+
+  chunkObservation.setFrequencyRange(chunk.nrChannels, observation.getMinFreq() + (chunk.firstChannel * observation.getChannelBandwidth()), observation.getChannelBandwidth());
+  return chunkObservation;
+}
+
+template< typename T > void scatterChunkOutput(const AstroData::Observation & observation, const ChannelChunk & chunk, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const T * const chunkOutput, T * const output) {
+  const AstroData::Observation chunkObservation = getChunkObservation(observation, chunk);
+  const unsigned int nrOutputValues = getNrOutputValues(outputMode);
+  const unsigned int nrOutputSamples = getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration);
+  // Unless channels are the fastest dimension, the samples of a beam and channel are contiguous
+  const bool contiguous = (getOutputSampleStride(observation, outputMode, outputLayout) == nrOutputValues);
+
+  for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+    for ( unsigned int channel = 0; channel < chunk.nrChannels; channel++ ) {
+      if ( contiguous ) {
+        const T * const source = &(chunkOutput[getOutputIndex(chunkObservation, outputMode, nrSamplesPerIntegration, outputLayout, beam, channel, 0)]);
+
+        std::copy(source, source + (nrOutputSamples * nrOutputValues), &(output[getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, beam, chunk.firstChannel + channel, 0)]));
+        continue;
+      }
+      for ( unsigned int sample = 0; sample < nrOutputSamples; sample++ ) {
+        const T * const source = &(chunkOutput[getOutputIndex(chunkObservation, outputMode, nrSamplesPerIntegration, outputLayout, beam, channel, sample)]);
+
+        std::copy(source, source + nrOutputValues, &(output[getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, beam, chunk.firstChannel + channel, sample)]));
+      }
+    }
+  }
+}
+
+void getNUMANodes(std::vector< std::vector< unsigned int > > & nodes) {
+  std::string list;
+  std::vector< unsigned int > nodeIDs;
+  cpu_set_t allowed;
+  std::ifstream online("/sys/devices/system/node/online");
+
+  nodes.clear();
+  CPU_ZERO(&allowed);
+  if ( sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ) {
+    for ( unsigned int cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++ ) {
+      CPU_SET(cpu, &allowed);
+    }
+  }
+  if ( online && std::getline(online, list) ) {
+    parseCPUList(list, nodeIDs);
+  }
+  for ( std::vector< unsigned int >::const_iterator node = nodeIDs.begin(); node != nodeIDs.end(); ++node ) {
+    std::ifstream cpuList(("/sys/devices/system/node/node" + isa::utils::toString(*node) + "/cpulist").c_str());
+    std::vector< unsigned int > cpus;
+    std::vector< unsigned int > allowedCPUs;
+
+    if ( !cpuList || !std::getline(cpuList, list) ) {
+      continue;
+    }
+    parseCPUList(list, cpus);
+    for ( std::vector< unsigned int >::const_iterator cpu = cpus.begin(); cpu != cpus.end(); ++cpu ) {
+      if ( (*cpu < CPU_SETSIZE) && CPU_ISSET(*cpu, &allowed) ) {
+        allowedCPUs.push_back(*cpu);
+      }
+    }
+    // Nodes with memory and no cores are not workers
+    if ( !allowedCPUs.empty() ) {
+      nodes.push_back(allowedCPUs);
+    }
+  }
+  if ( nodes.empty() ) {
+    std::vector< unsigned int > cpus;
+
+    for ( unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++ ) {
+      if ( CPU_ISSET(cpu, &allowed) ) {
+        cpus.push_back(cpu);
+      }
+    }
+    nodes.push_back(cpus);
+  }
+}
+
+void parseCPUList(const std::string & list, std::vector< unsigned int > & cpus) {
+  std::istringstream ranges(list);
+  std::string range;
+
+  cpus.clear();
+  while ( std::getline(ranges, range, ',') ) {
+    const std::string::size_type dash = range.find('-');
+
+    if ( range.empty() ) {
+      continue;
+    } else if ( dash == std::string::npos ) {
+      cpus.push_back(std::strtoul(range.c_str(), 0, 10));
+    } else {
+      const unsigned int first = std::strtoul(range.substr(0, dash).c_str(), 0, 10);
+      const unsigned int last = std::strtoul(range.substr(dash + 1).c_str(), 0, 10);
+
+      for ( unsigned int cpu = first; cpu <= last; cpu++ ) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+}
+
+bool pinThread(const std::vector< unsigned int > & cpus) {
+  cpu_set_t set;
+
+  if ( cpus.empty() ) {
+    return false;
+  }
+  CPU_ZERO(&set);
+  for ( std::vector< unsigned int >::const_iterator cpu = cpus.begin(); cpu != cpus.end(); ++cpu ) {
+    if ( *cpu < CPU_SETSIZE ) {
+      CPU_SET(*cpu, &set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_MULTI_DEVICE_HPP
@@ -0,0 +1,132 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include <Kernel.hpp>
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+#include <BeamFormerKernelPolicy.hpp>
+#include <BeamFormerMultiDevice.hpp>
+#include <HostDeviceBuffer.hpp>
+
+
+#ifndef BEAM_FORMER_MULTI_DEVICE_OPENCL_HPP
+#define BEAM_FORMER_MULTI_DEVICE_OPENCL_HPP
+
+namespace RadioAstronomy {
+
+// OpenCL device, or sub-device, computing the chunks of BeamFormerMultiDevice: the samples and weights of a chunk are uploaded,
+// the kernel runs on the observation of the chunk, and the output is copied back in the output of the whole observation
+// Chunks are served by the generic kernel until the specialized one is compiled, so nrChannelsPerBlock of conf must divide the channels of every chunk
+template< typename I, typename T > class BeamFormerWorkerOpenCL : public BeamFormerWorker< I, T > {
+public:
+  BeamFormerWorkerOpenCL(const AstroData::Observation & observation, const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const std::string & inputDataType, const std::string & dataType, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory = std::string());
+  ~BeamFormerWorkerOpenCL();
+  std::string getName() const;
+  void setWeights(const std::vector< float > & weights);
+  void compute(const I * const samples, T * const output, const ChannelChunk & chunk);
+
+private:
+  AstroData::Observation observation;
+  OutputMode outputMode;
+  unsigned int nrSamplesPerIntegration;
+  OutputLayout outputLayout;
+  std::string name;
+  cl::Context clContext;
+  cl::Device clDevice;
+  cl::CommandQueue clQueue;
+  BeamFormerKernelPolicy kernels;
+  std::vector< float > weights;
+  // Device buffers are sized for the largest chunk computed so far
+  unsigned int nrAllocatedChannels;
+  cl::Buffer samples_d;
+  cl::Buffer weights_d;
+  HostDeviceBuffer< T > * chunkOutput;
+};
+
+// Splits a CPU device in one sub-device per NUMA node, so that every socket is a worker with the memory of its node;
+// other devices, and runtimes that cannot partition by NUMA node, return the device itself
+void getNUMASubDevices(cl::Device & device, std::vector< cl::Device > & subDevices);
+
+// Implementations
+template< typename I, typename T > BeamFormerWorkerOpenCL< I, T >::BeamFormerWorkerOpenCL(const AstroData::Observation & observation, const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const std::string & inputDataType, const std::string & dataType, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory) : observation(observation), outputMode(outputMode), nrSamplesPerIntegration(nrSamplesPerIntegration), outputLayout(outputLayout), clContext(clContext), clDevice(clDevice), clQueue(clContext, clDevice), kernels(conf, outputMode, nrSamplesPerIntegration, outputLayout, false, inputDataType, dataType, observation, clContext, clDevice, cacheDirectory), nrAllocatedChannels(0), chunkOutput(0) {
+  name = clDevice.getInfo< CL_DEVICE_NAME >();
+}
+
+template< typename I, typename T > BeamFormerWorkerOpenCL< I, T >::~BeamFormerWorkerOpenCL() {
+  clQueue.finish();
+  delete chunkOutput;
+}
+
+template< typename I, typename T > std::string BeamFormerWorkerOpenCL< I, T >::getName() const {
+  return name;
+}
+
+template< typename I, typename T > void BeamFormerWorkerOpenCL< I, T >::setWeights(const std::vector< float > & weights) {
+  this->weights = weights;
+}
+
+template< typename I, typename T > void BeamFormerWorkerOpenCL< I, T >::compute(const I * const samples, T * const output, const ChannelChunk & chunk) {
+  const AstroData::Observation chunkObservation = getChunkObservation(observation, chunk);
+  const std::size_t nrSamplesPerChannel = static_cast< std::size_t >(observation.getNrStations()) * observation.getNrSamplesPerPaddedSecond() * 4;
+  const std::size_t nrWeightsPerChannel = static_cast< std::size_t >(observation.getNrStations()) * observation.getNrPaddedBeams() * 2;
+
+  if ( chunk.nrChannels > nrAllocatedChannels ) {
+    delete chunkOutput;
+    chunkOutput = 0;
+    samples_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, chunk.nrChannels * nrSamplesPerChannel * sizeof(I), 0, 0);
+    weights_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, chunk.nrChannels * nrWeightsPerChannel * sizeof(float), 0, 0);
+    chunkOutput = new HostDeviceBuffer< T >(getOutputSize(chunkObservation, outputMode, nrSamplesPerIntegration, outputLayout), CL_MEM_WRITE_ONLY, clContext, clDevice, clQueue);
+    nrAllocatedChannels = chunk.nrChannels;
+  }
+  cl::Kernel & kernel = kernels.getKernel(chunkObservation);
+  const BeamFormerConf & kernelConf = kernels.getConf();
+  cl::NDRange global(chunkObservation.getNrSamplesPerPaddedSecond() / kernelConf.getNrSamplesPerThread(), chunkObservation.getNrBeams() / kernelConf.getNrBeamsPerThread(), chunkObservation.getNrChannels() * kernelConf.getNrStationGroups(chunkObservation));
+  cl::NDRange local(kernelConf.getNrSamplesPerBlock(), kernelConf.getNrBeamsPerBlock(), kernelConf.getNrChannelsPerBlock() * kernelConf.getNrStationGroups(chunkObservation));
+
+  // Channels are the slowest dimension of samples and weights, so the data of a chunk is contiguous
+  clQueue.enqueueWriteBuffer(samples_d, CL_FALSE, 0, chunk.nrChannels * nrSamplesPerChannel * sizeof(I), reinterpret_cast< const void * >(samples + (chunk.firstChannel * nrSamplesPerChannel)));
+  clQueue.enqueueWriteBuffer(weights_d, CL_FALSE, 0, chunk.nrChannels * nrWeightsPerChannel * sizeof(float), reinterpret_cast< const void * >(weights.data() + (chunk.firstChannel * nrWeightsPerChannel)));
+  kernel.setArg(0, samples_d);
+  kernel.setArg(1, chunkOutput->getDeviceBuffer());
+  kernel.setArg(2, weights_d);
+  clQueue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local);
+  chunkOutput->download(true);
+  scatterChunkOutput< T >(observation, chunk, outputMode, nrSamplesPerIntegration, outputLayout, chunkOutput->data(), output);
+}
+
+void getNUMASubDevices(cl::Device & device, std::vector< cl::Device > & subDevices) {
+  const cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0};
+
+  subDevices.clear();
+  if ( ((device.getInfo< CL_DEVICE_TYPE >() & CL_DEVICE_TYPE_CPU) != 0) && ((device.getInfo< CL_DEVICE_PARTITION_AFFINITY_DOMAIN >() & CL_DEVICE_AFFINITY_DOMAIN_NUMA) != 0) ) {
+    try {
+      if ( device.createSubDevices(properties, &subDevices) != CL_SUCCESS ) {
+        subDevices.clear();
+      }
+    } catch ( cl::Error & err ) {
+      // Not every runtime can split its devices
+      subDevices.clear();
+    }
+  }
+  if ( subDevices.empty() ) {
+    subDevices.push_back(device);
+  }
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_MULTI_DEVICE_OPENCL_HPP
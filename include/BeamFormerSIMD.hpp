@@ -0,0 +1,260 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BEAM_FORMER_X86
+#endif
+
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+
+
+#ifndef BEAM_FORMER_SIMD_HPP
+#define BEAM_FORMER_SIMD_HPP
+
+namespace RadioAstronomy {
+
+enum SIMDInstructionSet { SIMD_SCALAR = 0, SIMD_AVX2, SIMD_AVX512 };
+
+// Most advanced instruction set supported by the CPU at run time
+SIMDInstructionSet getSIMDInstructionSet();
+std::string getSIMDInstructionSetName(const SIMDInstructionSet instructionSet);
+// Parallel, cache-blocked and vectorized beam forming algorithm; vectorized kernels exist for float, char and short samples accumulated as float
+template< typename I, typename T > void beamFormerSIMD(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE, const SIMDInstructionSet instructionSet = getSIMDInstructionSet(), Profiler * profiler = 0);
+// Tile function for the instruction set; types without a vectorized kernel get the scalar one
+template< typename I, typename T > typename TileFunction< I, T >::type getBeamFormerTileSIMD(const SIMDInstructionSet instructionSet);
+template< > TileFunction< float, float >::type getBeamFormerTileSIMD< float, float >(const SIMDInstructionSet instructionSet);
+template< > TileFunction< char, float >::type getBeamFormerTileSIMD< char, float >(const SIMDInstructionSet instructionSet);
+template< > TileFunction< short, float >::type getBeamFormerTileSIMD< short, float >(const SIMDInstructionSet instructionSet);
+#ifdef BEAM_FORMER_X86
+template< typename I > void beamFormerTileAVX2(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, float * const accumulators);
+template< typename I > void beamFormerTileAVX512(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, float * const accumulators);
+#endif
+
+// Implementations
+SIMDInstructionSet getSIMDInstructionSet() {
+#if defined(BEAM_FORMER_X86) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512f") ) {
+    return SIMD_AVX512;
+  } else if ( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) {
+    return SIMD_AVX2;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+std::string getSIMDInstructionSetName(const SIMDInstructionSet instructionSet) {
+  if ( instructionSet == SIMD_AVX512 ) {
+    return "AVX-512";
+  } else if ( instructionSet == SIMD_AVX2 ) {
+    return "AVX2";
+  }
+  return "scalar";
+}
+
+template< typename I, typename T > void beamFormerSIMD(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const SIMDInstructionSet instructionSet, Profiler * profiler) {
+  beamFormerTiled< I, T >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, getBeamFormerTileSIMD< I, T >(instructionSet), 0, profiler);
+}
+
+template< typename I, typename T > typename TileFunction< I, T >::type getBeamFormerTileSIMD(const SIMDInstructionSet instructionSet) {
+  return beamFormerTile< I, T >;
+}
+
+template< > TileFunction< float, float >::type getBeamFormerTileSIMD< float, float >(const SIMDInstructionSet instructionSet) {
+#ifdef BEAM_FORMER_X86
+  if ( instructionSet == SIMD_AVX512 ) {
+    return beamFormerTileAVX512< float >;
+  } else if ( instructionSet == SIMD_AVX2 ) {
+    return beamFormerTileAVX2< float >;
+  }
+#endif
+  return beamFormerTile< float, float >;
+}
+
+template< > TileFunction< char, float >::type getBeamFormerTileSIMD< char, float >(const SIMDInstructionSet instructionSet) {
+#ifdef BEAM_FORMER_X86
+  if ( instructionSet == SIMD_AVX512 ) {
+    return beamFormerTileAVX512< char >;
+  } else if ( instructionSet == SIMD_AVX2 ) {
+    return beamFormerTileAVX2< char >;
+  }
+#endif
+  return beamFormerTile< char, float >;
+}
+
+template< > TileFunction< short, float >::type getBeamFormerTileSIMD< short, float >(const SIMDInstructionSet instructionSet) {
+#ifdef BEAM_FORMER_X86
+  if ( instructionSet == SIMD_AVX512 ) {
+    return beamFormerTileAVX512< short >;
+  } else if ( instructionSet == SIMD_AVX2 ) {
+    return beamFormerTileAVX2< short >;
+  }
+#endif
+  return beamFormerTile< short, float >;
+}
+
+#ifdef BEAM_FORMER_X86
+// Widening loads of two (AVX2) or four (AVX-512) interleaved samples; char is signed, as in OpenCL
+__attribute__((target("avx2,fma"))) inline __m256 loadAVX2(const float * const pointer) {
+  return _mm256_loadu_ps(pointer);
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 loadAVX2(const char * const pointer) {
+  return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(pointer))));
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 loadAVX2(const short * const pointer) {
+  return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast< const __m128i * >(pointer))));
+}
+
+__attribute__((target("avx512f"))) inline __m512 loadAVX512(const float * const pointer) {
+  return _mm512_loadu_ps(pointer);
+}
+
+// The zero-masked conversions do not merge into an undefined register, that GCC reports as maybe uninitialized
+__attribute__((target("avx512f"))) inline __m512 loadAVX512(const char * const pointer) {
+  const __m128i samples = _mm_loadu_si128(reinterpret_cast< const __m128i * >(pointer));
+
+  return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepi8_epi32(0xFFFF, samples));
+}
+
+__attribute__((target("avx512f"))) inline __m512 loadAVX512(const short * const pointer) {
+  const __m256i samples = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(pointer));
+
+  return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepi16_epi32(0xFFFF, samples));
+}
+
+// Scalar code for the samples of a block that do not fill a whole vector
+template< typename I > void beamFormerBlockRemainder(const AstroData::Observation & observation, const I * const channelSamples, const float * const channelWeights, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int nrBlockBeams, const unsigned int firstStation, const unsigned int nrTileStations, float * const accumulators) {
+  for ( unsigned int sample = firstSample; sample < nrTileSamples; sample++ ) {
+    for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+      float * const beamPointer = &(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]);
+
+      for ( unsigned int station = firstStation; station < firstStation + nrTileStations; station++ ) {
+        const I * const samplePointer = &(channelSamples[(station * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4)]);
+        const float * const weightPointer = &(channelWeights[(station * observation.getNrPaddedBeams() * 2) + (beam * 2)]);
+
+        beamPointer[0] += (samplePointer[0] * weightPointer[0]) - (samplePointer[1] * weightPointer[1]);
+        beamPointer[1] += (samplePointer[0] * weightPointer[1]) + (samplePointer[1] * weightPointer[0]);
+        beamPointer[2] += (samplePointer[2] * weightPointer[0]) - (samplePointer[3] * weightPointer[1]);
+        beamPointer[3] += (samplePointer[2] * weightPointer[1]) + (samplePointer[3] * weightPointer[0]);
+      }
+    }
+  }
+}
+
+// The samples are interleaved as (p0_r, p0_i, p1_r, p1_i), so a vector holds two (AVX2) or four (AVX-512) consecutive samples.
+// A complex multiply-accumulate becomes two FMAs: acc += s * w_r and acc += swap(s) * (-w_i, w_i), where swap exchanges real and imaginary parts.
+// Every block keeps the accumulators of nrBlockBeams beams in registers for a whole station tile, so each sample load is reused nrBlockBeams times.
+template< typename I, unsigned int nrBlockBeams > __attribute__((target("avx2,fma"))) void beamFormerBlockAVX2(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int firstStation, const unsigned int nrTileStations, float * const accumulators) {
+  const __m256 sign = _mm256_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+  const I * const channelSamples = &(samples[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (firstSample * 4)]);
+  const float * const channelWeights = &(weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (firstBeam * 2)]);
+  unsigned int sample = 0;
+
+  for ( ; sample + 2 <= nrTileSamples; sample += 2 ) {
+    __m256 beams[nrBlockBeams];
+
+    for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+      beams[beam] = _mm256_loadu_ps(&(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]));
+    }
+    for ( unsigned int station = firstStation; station < firstStation + nrTileStations; station++ ) {
+      const __m256 item = loadAVX2(&(channelSamples[(station * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4)]));
+      const __m256 itemSwap = _mm256_permute_ps(item, 0xB1);
+      const float * const weightPointer = &(channelWeights[station * observation.getNrPaddedBeams() * 2]);
+
+      for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+        beams[beam] = _mm256_fmadd_ps(item, _mm256_set1_ps(weightPointer[(beam * 2)]), beams[beam]);
+        beams[beam] = _mm256_fmadd_ps(itemSwap, _mm256_mul_ps(_mm256_set1_ps(weightPointer[(beam * 2) + 1]), sign), beams[beam]);
+      }
+    }
+    for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+      _mm256_storeu_ps(&(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]), beams[beam]);
+    }
+  }
+  beamFormerBlockRemainder(observation, channelSamples, channelWeights, sample, nrTileSamples, nrBlockBeams, firstStation, nrTileStations, accumulators);
+}
+
+template< typename I, unsigned int nrBlockBeams > __attribute__((target("avx512f"))) void beamFormerBlockAVX512(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int firstStation, const unsigned int nrTileStations, float * const accumulators) {
+  const __m512 sign = _mm512_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+  const I * const channelSamples = &(samples[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (firstSample * 4)]);
+  const float * const channelWeights = &(weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (firstBeam * 2)]);
+  unsigned int sample = 0;
+
+  for ( ; sample + 4 <= nrTileSamples; sample += 4 ) {
+    __m512 beams[nrBlockBeams];
+
+    for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+      beams[beam] = _mm512_loadu_ps(&(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]));
+    }
+    for ( unsigned int station = firstStation; station < firstStation + nrTileStations; station++ ) {
+      const __m512 item = loadAVX512(&(channelSamples[(station * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4)]));
+      const __m512 itemSwap = _mm512_shuffle_ps(item, item, 0xB1);
+      const float * const weightPointer = &(channelWeights[station * observation.getNrPaddedBeams() * 2]);
+
+      for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+        beams[beam] = _mm512_fmadd_ps(item, _mm512_set1_ps(weightPointer[(beam * 2)]), beams[beam]);
+        beams[beam] = _mm512_fmadd_ps(itemSwap, _mm512_mul_ps(_mm512_set1_ps(weightPointer[(beam * 2) + 1]), sign), beams[beam]);
+      }
+    }
+    for ( unsigned int beam = 0; beam < nrBlockBeams; beam++ ) {
+      _mm512_storeu_ps(&(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]), beams[beam]);
+    }
+  }
+  beamFormerBlockRemainder(observation, channelSamples, channelWeights, sample, nrTileSamples, nrBlockBeams, firstStation, nrTileStations, accumulators);
+}
+
+template< typename I > void beamFormerTileAVX2(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, float * const accumulators) {
+  std::fill(accumulators, accumulators + (nrTileBeams * nrTileSamples * 4), 0);
+
+  for ( unsigned int firstStation = 0; firstStation < observation.getNrStations(); firstStation += nrStationsPerTile ) {
+    const unsigned int nrTileStations = std::min(nrStationsPerTile, observation.getNrStations() - firstStation);
+    unsigned int beam = 0;
+
+    for ( ; beam + 4 <= nrTileBeams; beam += 4 ) {
+      beamFormerBlockAVX2< I, 4 >(observation, samples, weights, channel, firstSample, nrTileSamples, firstBeam + beam, firstStation, nrTileStations, &(accumulators[beam * nrTileSamples * 4]));
+    }
+    for ( ; beam < nrTileBeams; beam++ ) {
+      beamFormerBlockAVX2< I, 1 >(observation, samples, weights, channel, firstSample, nrTileSamples, firstBeam + beam, firstStation, nrTileStations, &(accumulators[beam * nrTileSamples * 4]));
+    }
+  }
+}
+
+template< typename I > void beamFormerTileAVX512(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, float * const accumulators) {
+  std::fill(accumulators, accumulators + (nrTileBeams * nrTileSamples * 4), 0);
+
+  for ( unsigned int firstStation = 0; firstStation < observation.getNrStations(); firstStation += nrStationsPerTile ) {
+    const unsigned int nrTileStations = std::min(nrStationsPerTile, observation.getNrStations() - firstStation);
+    unsigned int beam = 0;
+
+    for ( ; beam + 8 <= nrTileBeams; beam += 8 ) {
+      beamFormerBlockAVX512< I, 8 >(observation, samples, weights, channel, firstSample, nrTileSamples, firstBeam + beam, firstStation, nrTileStations, &(accumulators[beam * nrTileSamples * 4]));
+    }
+    for ( ; beam < nrTileBeams; beam++ ) {
+      beamFormerBlockAVX512< I, 1 >(observation, samples, weights, channel, firstSample, nrTileSamples, firstBeam + beam, firstStation, nrTileStations, &(accumulators[beam * nrTileSamples * 4]));
+    }
+  }
+}
+#endif // BEAM_FORMER_X86
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_SIMD_HPP
+
@@ -0,0 +1,261 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <Observation.hpp>
+#include <Timer.hpp>
+#include <BeamFormer.hpp>
+
+
+#ifndef BEAM_FORMER_STREAM_HPP
+#define BEAM_FORMER_STREAM_HPP
+
+namespace RadioAstronomy {
+
+// Statistics of a stream: seconds of data processed per second of wall time, while at least one second is in flight
+class StreamStatistics {
+public:
+  StreamStatistics(const double inputBytesPerSecond, const double outputBytesPerSecond);
+  ~StreamStatistics();
+  // Get
+  unsigned int getNrSeconds() const;
+  double getElapsedTime() const;
+  // Data seconds processed per wall-clock second; the stream keeps up with the instrument if this is at least one
+  double getRealTimeFactor() const;
+  // Input plus output GB/s
+  double getThroughput() const;
+  // Utils
+  void start();
+  void stop();
+  void addSecond();
+
+private:
+  unsigned int nrSeconds;
+  double inputBytesPerSecond;
+  double outputBytesPerSecond;
+  isa::utils::Timer timer;
+};
+
+// Beam forms a stream of seconds on a worker thread, using one of the tiled CPU engines;
+// the caller fills second N + 1 and consumes second N - 1 while the worker computes second N
+template< typename I, typename T > class BeamFormerStreamCPU {
+public:
+  BeamFormerStreamCPU(const AstroData::Observation & observation, const std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, typename TileFunction< I, T >::type tileFunction = beamFormerTile< I, T >, const unsigned int nrBuffers = 3);
+  ~BeamFormerStreamCPU();
+  // Queues a second of samples, swapping them with a free buffer of the same size
+  // If all the buffers are in flight, the oldest second is first completed and swapped into output, and true is returned
+  bool push(std::vector< I > & samples, std::vector< T > & output);
+  // Queues a second of samples without copying them, e.g. from a StationDataFile; they must not change until the second is popped
+  bool push(const I * const samples, std::vector< T > & output);
+  // Completes the oldest second in flight and swaps it into output; returns false if there are no seconds in flight
+  bool pop(std::vector< T > & output);
+  // Weights are used by the seconds queued after the update
+  void setWeights(const std::vector< float > & weights);
+  const StreamStatistics & getStatistics() const;
+
+private:
+  void worker();
+
+  AstroData::Observation observation;
+  // Weights are versioned, and a version is kept until no second in flight uses it
+  std::deque< std::vector< float > > weights;
+  unsigned int nrSamplesPerTile;
+  unsigned int nrBeamsPerTile;
+  unsigned int nrStationsPerTile;
+  OutputMode outputMode;
+  unsigned int nrSamplesPerIntegration;
+  typename TileFunction< I, T >::type tileFunction;
+  // Ring of buffers: nrInFlight seconds starting from first, the oldest nrComputed of which are done
+  std::vector< std::vector< I > > samples;
+  // Samples of the seconds in flight, either in samples or in the memory of the caller
+  std::vector< const I * > samplesPointer;
+  std::vector< std::vector< T > > output;
+  std::vector< unsigned int > weightsIndex;
+  unsigned int first;
+  unsigned int nrInFlight;
+  unsigned int nrComputed;
+  bool stopWorker;
+  std::mutex lock;
+  std::condition_variable changed;
+  std::thread workerThread;
+  StreamStatistics statistics;
+};
+
+// Implementations
+StreamStatistics::StreamStatistics(const double inputBytesPerSecond, const double outputBytesPerSecond) : nrSeconds(0), inputBytesPerSecond(inputBytesPerSecond), outputBytesPerSecond(outputBytesPerSecond) {}
+
+StreamStatistics::~StreamStatistics() {}
+
+void StreamStatistics::start() {
+  timer.start();
+}
+
+void StreamStatistics::stop() {
+  timer.stop();
+}
+
+void StreamStatistics::addSecond() {
+  nrSeconds++;
+}
+
+inline unsigned int StreamStatistics::getNrSeconds() const {
+  return nrSeconds;
+}
+
+inline double StreamStatistics::getElapsedTime() const {
+  return timer.getTotalTime();
+}
+
+double StreamStatistics::getRealTimeFactor() const {
+  if ( timer.getTotalTime() == 0.0 ) {
+    return 0.0;
+  }
+  return nrSeconds / timer.getTotalTime();
+}
+
+double StreamStatistics::getThroughput() const {
+  if ( timer.getTotalTime() == 0.0 ) {
+    return 0.0;
+  }
+  return isa::utils::giga(nrSeconds * (inputBytesPerSecond + outputBytesPerSecond)) / timer.getTotalTime();
+}
+
+template< typename I, typename T > BeamFormerStreamCPU< I, T >::BeamFormerStreamCPU(const AstroData::Observation & observation, const std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, typename TileFunction< I, T >::type tileFunction, const unsigned int nrBuffers) : observation(observation), weights(1, weights), nrSamplesPerTile(nrSamplesPerTile), nrBeamsPerTile(nrBeamsPerTile), nrStationsPerTile(nrStationsPerTile), outputMode(outputMode), nrSamplesPerIntegration(nrSamplesPerIntegration), tileFunction(tileFunction), samples(nrBuffers, std::vector< I >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4)), samplesPointer(nrBuffers, 0), output(nrBuffers, std::vector< T >(observation.getNrBeams() * observation.getNrChannels() * getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration) * getNrOutputValues(outputMode))), weightsIndex(nrBuffers, 0), first(0), nrInFlight(0), nrComputed(0), stopWorker(false), statistics(samples[0].size() * sizeof(I), output[0].size() * sizeof(T)) {
+  checkIntegration(observation, outputMode, nrSamplesPerIntegration);
+  workerThread = std::thread(&BeamFormerStreamCPU< I, T >::worker, this);
+}
+
+template< typename I, typename T > BeamFormerStreamCPU< I, T >::~BeamFormerStreamCPU() {
+  {
+    std::unique_lock< std::mutex > guard(lock);
+
+    stopWorker = true;
+  }
+  changed.notify_all();
+  workerThread.join();
+}
+
+template< typename I, typename T > bool BeamFormerStreamCPU< I, T >::push(std::vector< I > & samples, std::vector< T > & output) {
+  bool popped = false;
+
+  if ( nrInFlight == this->samples.size() ) {
+    popped = pop(output);
+  }
+  const unsigned int buffer = (first + nrInFlight) % this->samples.size();
+
+  this->samples[buffer].swap(samples);
+  push(static_cast< const I * >(this->samples[buffer].data()), output);
+  return popped;
+}
+
+template< typename I, typename T > bool BeamFormerStreamCPU< I, T >::push(const I * const samples, std::vector< T > & output) {
+  bool popped = false;
+
+  if ( nrInFlight == this->samples.size() ) {
+    popped = pop(output);
+  }
+  const unsigned int buffer = (first + nrInFlight) % this->samples.size();
+
+  samplesPointer[buffer] = samples;
+  {
+    std::unique_lock< std::mutex > guard(lock);
+
+    weightsIndex[buffer] = weights.size() - 1;
+    if ( nrInFlight == 0 ) {
+      statistics.start();
+    }
+    nrInFlight++;
+  }
+  changed.notify_all();
+  return popped;
+}
+
+template< typename I, typename T > bool BeamFormerStreamCPU< I, T >::pop(std::vector< T > & output) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  if ( nrInFlight == 0 ) {
+    return false;
+  }
+  while ( nrComputed == 0 ) {
+    changed.wait(guard);
+  }
+  this->output[first].swap(output);
+  if ( this->output[first].size() != output.size() ) {
+    this->output[first].resize(output.size());
+  }
+  first = (first + 1) % samples.size();
+  nrInFlight--;
+  nrComputed--;
+  statistics.addSecond();
+  if ( nrInFlight == 0 ) {
+    statistics.stop();
+  }
+  // Seconds use the weights in the order they are pushed, so the versions older than those of the oldest second in flight are not used anymore
+  const unsigned int nrUnusedWeights = (nrInFlight == 0) ? weights.size() - 1 : weightsIndex[first];
+
+  if ( nrUnusedWeights > 0 ) {
+    weights.erase(weights.begin(), weights.begin() + nrUnusedWeights);
+    for ( unsigned int second = 0; second < nrInFlight; second++ ) {
+      weightsIndex[(first + second) % samples.size()] -= nrUnusedWeights;
+    }
+  }
+  return true;
+}
+
+template< typename I, typename T > void BeamFormerStreamCPU< I, T >::setWeights(const std::vector< float > & weights) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  this->weights.push_back(weights);
+}
+
+template< typename I, typename T > inline const StreamStatistics & BeamFormerStreamCPU< I, T >::getStatistics() const {
+  return statistics;
+}
+
+template< typename I, typename T > void BeamFormerStreamCPU< I, T >::worker() {
+  while ( true ) {
+    unsigned int buffer = 0;
+    std::vector< float > * bufferWeights = 0;
+
+    {
+      std::unique_lock< std::mutex > guard(lock);
+
+      while ( !stopWorker && (nrComputed == nrInFlight) ) {
+        changed.wait(guard);
+      }
+      if ( stopWorker ) {
+        return;
+      }
+      buffer = (first + nrComputed) % samples.size();
+      bufferWeights = &(weights[weightsIndex[buffer]]);
+    }
+    // The buffers of a second in flight are not touched by the caller until the second is computed
+    beamFormerTiled< I, T >(observation, samplesPointer[buffer], output[buffer], *bufferWeights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, LAYOUT_BEAM_CHANNEL_SAMPLE, tileFunction);
+    {
+      std::unique_lock< std::mutex > guard(lock);
+
+      nrComputed++;
+    }
+    changed.notify_all();
+  }
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_STREAM_HPP
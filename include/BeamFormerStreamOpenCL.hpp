@@ -0,0 +1,160 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include <Kernel.hpp>
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+#include <BeamFormerStream.hpp>
+#include <BeamFormerKernelPolicy.hpp>
+
+
+#ifndef BEAM_FORMER_STREAM_OPENCL_HPP
+#define BEAM_FORMER_STREAM_OPENCL_HPP
+
+namespace RadioAstronomy {
+
+// Beam forms a stream of seconds on an OpenCL device, with one command queue per stage;
+// the H2D copy of second N + 1, the computation of second N and the D2H copy of second N - 1 overlap
+// The first seconds are computed by the generic kernel, while the specialized one is compiled
+template< typename I, typename T > class BeamFormerStreamOpenCL {
+public:
+  BeamFormerStreamOpenCL(const AstroData::Observation & observation, const std::vector< float > & weights, const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::string & inputDataType, const std::string & dataType, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory = std::string(), const unsigned int nrBuffers = 3);
+  ~BeamFormerStreamOpenCL();
+  // Same interface as BeamFormerStreamCPU
+  bool push(std::vector< I > & samples, std::vector< T > & output);
+  // The samples are uploaded straight from the memory of the caller, e.g. a StationDataFile; they must not change until the second is popped
+  bool push(const I * const samples, std::vector< T > & output);
+  bool pop(std::vector< T > & output);
+  // The update is ordered after the seconds already queued, and waits for them to be computed
+  void setWeights(const std::vector< float > & weights);
+  const StreamStatistics & getStatistics() const;
+
+private:
+  AstroData::Observation observation;
+  BeamFormerConf conf;
+  cl::CommandQueue uploadQueue;
+  cl::CommandQueue computeQueue;
+  cl::CommandQueue downloadQueue;
+  BeamFormerKernelPolicy kernels;
+  std::vector< float > weights;
+  cl::Buffer weights_d;
+  // Ring of buffers: nrInFlight seconds starting from first
+  std::vector< std::vector< I > > samples;
+  std::vector< std::vector< T > > output;
+  std::vector< cl::Buffer > samples_d;
+  std::vector< cl::Buffer > output_d;
+  std::vector< cl::Event > uploaded;
+  std::vector< cl::Event > computed;
+  std::vector< cl::Event > downloaded;
+  unsigned int first;
+  unsigned int nrInFlight;
+  StreamStatistics statistics;
+};
+
+// Implementations
+template< typename I, typename T > BeamFormerStreamOpenCL< I, T >::BeamFormerStreamOpenCL(const AstroData::Observation & observation, const std::vector< float > & weights, const BeamFormerConf & conf, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::string & inputDataType, const std::string & dataType, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory, const unsigned int nrBuffers) : observation(observation), conf(conf), uploadQueue(clContext, clDevice), computeQueue(clContext, clDevice), downloadQueue(clContext, clDevice), kernels(conf, outputMode, nrSamplesPerIntegration, LAYOUT_BEAM_CHANNEL_SAMPLE, false, inputDataType, dataType, observation, clContext, clDevice, cacheDirectory), weights(weights), samples(nrBuffers, std::vector< I >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4)), output(nrBuffers, std::vector< T >(observation.getNrBeams() * observation.getNrChannels() * getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration) * getNrOutputValues(outputMode))), samples_d(nrBuffers), output_d(nrBuffers), uploaded(nrBuffers), computed(nrBuffers), downloaded(nrBuffers), first(0), nrInFlight(0), statistics(samples[0].size() * sizeof(I), output[0].size() * sizeof(T)) {
+  weights_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, this->weights.size() * sizeof(float), 0, 0);
+  for ( unsigned int buffer = 0; buffer < nrBuffers; buffer++ ) {
+    samples_d[buffer] = cl::Buffer(clContext, CL_MEM_READ_ONLY, samples[buffer].size() * sizeof(I), 0, 0);
+    output_d[buffer] = cl::Buffer(clContext, CL_MEM_WRITE_ONLY, output[buffer].size() * sizeof(T), 0, 0);
+  }
+  computeQueue.enqueueWriteBuffer(weights_d, CL_TRUE, 0, this->weights.size() * sizeof(float), reinterpret_cast< void * >(this->weights.data()));
+}
+
+template< typename I, typename T > BeamFormerStreamOpenCL< I, T >::~BeamFormerStreamOpenCL() {
+  uploadQueue.finish();
+  computeQueue.finish();
+  downloadQueue.finish();
+}
+
+template< typename I, typename T > bool BeamFormerStreamOpenCL< I, T >::push(std::vector< I > & samples, std::vector< T > & output) {
+  bool popped = false;
+
+  if ( nrInFlight == this->samples.size() ) {
+    popped = pop(output);
+  }
+  const unsigned int buffer = (first + nrInFlight) % this->samples.size();
+
+  this->samples[buffer].swap(samples);
+  push(static_cast< const I * >(this->samples[buffer].data()), output);
+  return popped;
+}
+
+template< typename I, typename T > bool BeamFormerStreamOpenCL< I, T >::push(const I * const samples, std::vector< T > & output) {
+  bool popped = false;
+
+  if ( nrInFlight == this->samples.size() ) {
+    popped = pop(output);
+  }
+  const unsigned int buffer = (first + nrInFlight) % this->samples.size();
+  std::vector< cl::Event > waitUpload(1);
+  std::vector< cl::Event > waitCompute(1);
+  cl::Kernel & kernel = kernels.getKernel(observation);
+  const BeamFormerConf & kernelConf = kernels.getConf();
+  cl::NDRange global(observation.getNrSamplesPerPaddedSecond() / kernelConf.getNrSamplesPerThread(), observation.getNrBeams() / kernelConf.getNrBeamsPerThread(), observation.getNrChannels() * kernelConf.getNrStationGroups(observation));
+  cl::NDRange local(kernelConf.getNrSamplesPerBlock(), kernelConf.getNrBeamsPerBlock(), kernelConf.getNrChannelsPerBlock() * kernelConf.getNrStationGroups(observation));
+
+  if ( nrInFlight == 0 ) {
+    statistics.start();
+  }
+  uploadQueue.enqueueWriteBuffer(samples_d[buffer], CL_FALSE, 0, this->samples[buffer].size() * sizeof(I), reinterpret_cast< const void * >(samples), 0, &(uploaded[buffer]));
+  waitUpload[0] = uploaded[buffer];
+  // Kernel arguments are captured at enqueue time, so the same kernel serves all buffers
+  kernel.setArg(0, samples_d[buffer]);
+  kernel.setArg(1, output_d[buffer]);
+  kernel.setArg(2, weights_d);
+  computeQueue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, &waitUpload, &(computed[buffer]));
+  waitCompute[0] = computed[buffer];
+  downloadQueue.enqueueReadBuffer(output_d[buffer], CL_FALSE, 0, this->output[buffer].size() * sizeof(T), reinterpret_cast< void * >(this->output[buffer].data()), &waitCompute, &(downloaded[buffer]));
+  uploadQueue.flush();
+  computeQueue.flush();
+  downloadQueue.flush();
+  nrInFlight++;
+
+  return popped;
+}
+
+template< typename I, typename T > bool BeamFormerStreamOpenCL< I, T >::pop(std::vector< T > & output) {
+  if ( nrInFlight == 0 ) {
+    return false;
+  }
+  downloaded[first].wait();
+  this->output[first].swap(output);
+  if ( this->output[first].size() != output.size() ) {
+    this->output[first].resize(output.size());
+  }
+  first = (first + 1) % samples.size();
+  nrInFlight--;
+  statistics.addSecond();
+  if ( nrInFlight == 0 ) {
+    statistics.stop();
+  }
+  return true;
+}
+
+template< typename I, typename T > void BeamFormerStreamOpenCL< I, T >::setWeights(const std::vector< float > & weights) {
+  this->weights = weights;
+  computeQueue.enqueueWriteBuffer(weights_d, CL_TRUE, 0, this->weights.size() * sizeof(float), reinterpret_cast< void * >(this->weights.data()));
+}
+
+template< typename I, typename T > inline const StreamStatistics & BeamFormerStreamOpenCL< I, T >::getStatistics() const {
+  return statistics;
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_STREAM_OPENCL_HPP
@@ -0,0 +1,218 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <utils.hpp>
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+
+
+#ifndef BEAM_FORMER_UNROLLED_HPP
+#define BEAM_FORMER_UNROLLED_HPP
+
+namespace RadioAstronomy {
+
+// Instantiation of the unrolled CPU kernel: every iteration keeps the accumulators of nrSamplesPerIteration samples of nrBeamsPerIteration beams
+// in registers, as nrSamplesPerThread and nrBeamsPerThread do in the OpenCL kernel; with nrStations different from zero, the number of stations is fixed at compile time
+template< typename I, typename T > struct BeamFormerUnrolledKernel {
+  unsigned int nrSamplesPerIteration;
+  unsigned int nrBeamsPerIteration;
+  unsigned int nrStations;
+  typename TileFunction< I, T >::type tileFunction;
+
+  std::string print() const;
+};
+
+// Parallel, cache-blocked beam forming algorithm with the tiles computed by an instantiation of the unrolled kernel;
+// with fixedStations, the instantiation has the number of stations of the observation fixed at compile time
+template< typename I, typename T > void beamFormerUnrolled(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode = OUTPUT_VOLTAGES, const unsigned int nrSamplesPerIntegration = 1, const OutputLayout outputLayout = LAYOUT_BEAM_CHANNEL_SAMPLE, const unsigned int nrSamplesPerIteration = 4, const unsigned int nrBeamsPerIteration = 4, const bool fixedStations = false, Profiler * profiler = 0);
+// Computes a tile like beamFormerTile, in blocks of nrSamplesPerIteration samples and nrBeamsPerIteration beams; the remainders of the tile are computed in smaller blocks
+// With nrStations different from zero, all the stations are summed in a single pass, ignoring nrStationsPerTile; observations with a different number of stations,
+// e.g. the station groups of beamFormerParallelStations, are computed as with nrStations equal to zero
+template< typename I, typename T, unsigned int nrSamplesPerIteration, unsigned int nrBeamsPerIteration, unsigned int nrStations > void beamFormerTileUnrolled(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, T * const accumulators);
+// Sums the stations of a station tile in a block of the accumulators; samples and weights point to the first sample and beam of the block in the channel
+template< typename I, typename T, unsigned int nrSamplesPerIteration, unsigned int nrBeamsPerIteration, unsigned int nrStations > void beamFormerBlockUnrolled(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int firstStation, const unsigned int nrTileStations, const unsigned int nrTileSamples, T * const accumulators);
+// All the instantiations of the unrolled kernel: every combination of 1, 2, 4 and 8 samples and beams per iteration,
+// and the most common of them with the stations of the reference geometries fixed at compile time
+template< typename I, typename T > const std::vector< BeamFormerUnrolledKernel< I, T > > & getBeamFormerUnrolledKernels();
+// Instantiations that can compute the observation
+template< typename I, typename T > void getBeamFormerUnrolledKernels(const AstroData::Observation & observation, std::vector< BeamFormerUnrolledKernel< I, T > > & kernels);
+// Throws std::out_of_range if the combination is not instantiated
+template< typename I, typename T > typename TileFunction< I, T >::type getBeamFormerTileUnrolled(const unsigned int nrSamplesPerIteration, const unsigned int nrBeamsPerIteration, const unsigned int nrStations = 0);
+
+// Implementations
+template< typename I, typename T > std::string BeamFormerUnrolledKernel< I, T >::print() const {
+  return isa::utils::toString(nrSamplesPerIteration) + " " + isa::utils::toString(nrBeamsPerIteration) + " " + isa::utils::toString(nrStations);
+}
+
+template< typename I, typename T > void beamFormerUnrolled(const AstroData::Observation & observation, std::vector< I > & samples, std::vector< T > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const OutputLayout outputLayout, const unsigned int nrSamplesPerIteration, const unsigned int nrBeamsPerIteration, const bool fixedStations, Profiler * profiler) {
+  typename TileFunction< I, T >::type tileFunction = getBeamFormerTileUnrolled< I, T >(nrSamplesPerIteration, nrBeamsPerIteration, fixedStations ? observation.getNrStations() : 0);
+
+  beamFormerTiled< I, T >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, tileFunction, 0, profiler);
+}
+
+template< typename I, typename T, unsigned int nrSamplesPerIteration, unsigned int nrBeamsPerIteration, unsigned int nrStations > void beamFormerTileUnrolled(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int channel, const unsigned int firstSample, const unsigned int nrTileSamples, const unsigned int firstBeam, const unsigned int nrTileBeams, const unsigned int nrStationsPerTile, T * const accumulators) {
+  const I * const channelSamples = &(samples[(channel * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4) + (firstSample * 4)]);
+  const float * const channelWeights = &(weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (firstBeam * 2)]);
+  const unsigned int nrStationsPerPass = (nrStations > 0) ? nrStations : nrStationsPerTile;
+
+  if ( (nrStations > 0) && (observation.getNrStations() != nrStations) ) {
+    beamFormerTileUnrolled< I, T, nrSamplesPerIteration, nrBeamsPerIteration, 0 >(observation, samples, weights, channel, firstSample, nrTileSamples, firstBeam, nrTileBeams, nrStationsPerTile, accumulators);
+    return;
+  }
+  std::fill(accumulators, accumulators + (nrTileBeams * nrTileSamples * 4), 0);
+  for ( unsigned int firstStation = 0; firstStation < observation.getNrStations(); firstStation += nrStationsPerPass ) {
+    const unsigned int nrTileStations = std::min(nrStationsPerPass, observation.getNrStations() - firstStation);
+    unsigned int beam = 0;
+
+    for ( ; beam + nrBeamsPerIteration <= nrTileBeams; beam += nrBeamsPerIteration ) {
+      unsigned int sample = 0;
+
+      for ( ; sample + nrSamplesPerIteration <= nrTileSamples; sample += nrSamplesPerIteration ) {
+        beamFormerBlockUnrolled< I, T, nrSamplesPerIteration, nrBeamsPerIteration, nrStations >(observation, &(channelSamples[sample * 4]), &(channelWeights[beam * 2]), firstStation, nrTileStations, nrTileSamples, &(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]));
+      }
+      for ( ; sample < nrTileSamples; sample++ ) {
+        beamFormerBlockUnrolled< I, T, 1, nrBeamsPerIteration, nrStations >(observation, &(channelSamples[sample * 4]), &(channelWeights[beam * 2]), firstStation, nrTileStations, nrTileSamples, &(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]));
+      }
+    }
+    for ( ; beam < nrTileBeams; beam++ ) {
+      unsigned int sample = 0;
+
+      for ( ; sample + nrSamplesPerIteration <= nrTileSamples; sample += nrSamplesPerIteration ) {
+        beamFormerBlockUnrolled< I, T, nrSamplesPerIteration, 1, nrStations >(observation, &(channelSamples[sample * 4]), &(channelWeights[beam * 2]), firstStation, nrTileStations, nrTileSamples, &(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]));
+      }
+      for ( ; sample < nrTileSamples; sample++ ) {
+        beamFormerBlockUnrolled< I, T, 1, 1, nrStations >(observation, &(channelSamples[sample * 4]), &(channelWeights[beam * 2]), firstStation, nrTileStations, nrTileSamples, &(accumulators[(beam * nrTileSamples * 4) + (sample * 4)]));
+      }
+    }
+  }
+}
+
+template< typename I, typename T, unsigned int nrSamplesPerIteration, unsigned int nrBeamsPerIteration, unsigned int nrStations > inline void beamFormerBlockUnrolled(const AstroData::Observation & observation, const I * const samples, const float * const weights, const unsigned int firstStation, const unsigned int nrTileStations, const unsigned int nrTileSamples, T * const accumulators) {
+  // The bounds of the loops on the block are known at compile time, so the loops are unrolled and the sums stay in registers
+  T sums[nrBeamsPerIteration][nrSamplesPerIteration][4];
+  const unsigned int lastStation = (nrStations > 0) ? nrStations : firstStation + nrTileStations;
+
+  for ( unsigned int beam = 0; beam < nrBeamsPerIteration; beam++ ) {
+    for ( unsigned int sample = 0; sample < nrSamplesPerIteration; sample++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        sums[beam][sample][item] = accumulators[(beam * nrTileSamples * 4) + (sample * 4) + item];
+      }
+    }
+  }
+  for ( unsigned int station = (nrStations > 0) ? 0 : firstStation; station < lastStation; station++ ) {
+    const I * const samplePointer = &(samples[station * observation.getNrSamplesPerPaddedSecond() * 4]);
+    const float * const weightPointer = &(weights[station * observation.getNrPaddedBeams() * 2]);
+    T stationSamples[nrSamplesPerIteration][4];
+
+    for ( unsigned int sample = 0; sample < nrSamplesPerIteration; sample++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        stationSamples[sample][item] = samplePointer[(sample * 4) + item];
+      }
+    }
+    for ( unsigned int beam = 0; beam < nrBeamsPerIteration; beam++ ) {
+      const float weight_r = weightPointer[(beam * 2)];
+      const float weight_i = weightPointer[(beam * 2) + 1];
+
+      for ( unsigned int sample = 0; sample < nrSamplesPerIteration; sample++ ) {
+        sums[beam][sample][0] += (stationSamples[sample][0] * weight_r) - (stationSamples[sample][1] * weight_i);
+        sums[beam][sample][1] += (stationSamples[sample][0] * weight_i) + (stationSamples[sample][1] * weight_r);
+        sums[beam][sample][2] += (stationSamples[sample][2] * weight_r) - (stationSamples[sample][3] * weight_i);
+        sums[beam][sample][3] += (stationSamples[sample][2] * weight_i) + (stationSamples[sample][3] * weight_r);
+      }
+    }
+  }
+  for ( unsigned int beam = 0; beam < nrBeamsPerIteration; beam++ ) {
+    for ( unsigned int sample = 0; sample < nrSamplesPerIteration; sample++ ) {
+      for ( unsigned int item = 0; item < 4; item++ ) {
+        accumulators[(beam * nrTileSamples * 4) + (sample * 4) + item] = sums[beam][sample][item];
+      }
+    }
+  }
+}
+
+template< typename I, typename T, unsigned int nrSamplesPerIteration, unsigned int nrBeamsPerIteration, unsigned int nrStations > inline void addBeamFormerUnrolledKernel(std::vector< BeamFormerUnrolledKernel< I, T > > & kernels) {
+  BeamFormerUnrolledKernel< I, T > kernel;
+
+  kernel.nrSamplesPerIteration = nrSamplesPerIteration;
+  kernel.nrBeamsPerIteration = nrBeamsPerIteration;
+  kernel.nrStations = nrStations;
+  kernel.tileFunction = beamFormerTileUnrolled< I, T, nrSamplesPerIteration, nrBeamsPerIteration, nrStations >;
+  kernels.push_back(kernel);
+}
+
+template< typename I, typename T > std::vector< BeamFormerUnrolledKernel< I, T > > instantiateBeamFormerUnrolledKernels() {
+  std::vector< BeamFormerUnrolledKernel< I, T > > kernels;
+
+  addBeamFormerUnrolledKernel< I, T, 1, 1, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 1, 2, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 1, 4, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 1, 8, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 2, 1, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 2, 2, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 2, 4, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 2, 8, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 1, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 2, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 4, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 8, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 8, 1, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 8, 2, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 8, 4, 0 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 8, 8, 0 >(kernels);
+  // Apertif-like and LOFAR-like arrays
+  addBeamFormerUnrolledKernel< I, T, 2, 4, 12 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 2, 12 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 4, 12 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 2, 4, 48 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 2, 48 >(kernels);
+  addBeamFormerUnrolledKernel< I, T, 4, 4, 48 >(kernels);
+  return kernels;
+}
+
+template< typename I, typename T > const std::vector< BeamFormerUnrolledKernel< I, T > > & getBeamFormerUnrolledKernels() {
+  static const std::vector< BeamFormerUnrolledKernel< I, T > > kernels = instantiateBeamFormerUnrolledKernels< I, T >();
+
+  return kernels;
+}
+
+template< typename I, typename T > void getBeamFormerUnrolledKernels(const AstroData::Observation & observation, std::vector< BeamFormerUnrolledKernel< I, T > > & kernels) {
+  const std::vector< BeamFormerUnrolledKernel< I, T > > & allKernels = getBeamFormerUnrolledKernels< I, T >();
+
+  kernels.clear();
+  for ( typename std::vector< BeamFormerUnrolledKernel< I, T > >::const_iterator kernel = allKernels.begin(); kernel != allKernels.end(); ++kernel ) {
+    if ( (kernel->nrStations == 0) || (kernel->nrStations == observation.getNrStations()) ) {
+      kernels.push_back(*kernel);
+    }
+  }
+}
+
+template< typename I, typename T > typename TileFunction< I, T >::type getBeamFormerTileUnrolled(const unsigned int nrSamplesPerIteration, const unsigned int nrBeamsPerIteration, const unsigned int nrStations) {
+  const std::vector< BeamFormerUnrolledKernel< I, T > > & kernels = getBeamFormerUnrolledKernels< I, T >();
+
+  for ( typename std::vector< BeamFormerUnrolledKernel< I, T > >::const_iterator kernel = kernels.begin(); kernel != kernels.end(); ++kernel ) {
+    if ( (kernel->nrSamplesPerIteration == nrSamplesPerIteration) && (kernel->nrBeamsPerIteration == nrBeamsPerIteration) && (kernel->nrStations == nrStations) ) {
+      return kernel->tileFunction;
+    }
+  }
+  throw std::out_of_range("No unrolled kernel with " + isa::utils::toString(nrSamplesPerIteration) + " samples, " + isa::utils::toString(nrBeamsPerIteration) + " beams and " + isa::utils::toString(nrStations) + " stations.");
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_UNROLLED_HPP
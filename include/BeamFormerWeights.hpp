@@ -0,0 +1,113 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <cmath>
+
+#include <Observation.hpp>
+
+
+#ifndef BEAM_FORMER_WEIGHTS_HPP
+#define BEAM_FORMER_WEIGHTS_HPP
+
+namespace RadioAstronomy {
+
+const double SPEED_OF_LIGHT = 299792458.0;
+
+// Station positions are organized as [station][3] (x, y, z) in meters, beam directions as [beam][3] unit vectors in the same frame
+// The weight of a station compensates its geometric delay in the direction of the beam: w = exp(-2 pi i f (direction . position) / c)
+// Frequencies are in MHz, as in AstroData::Observation: f = minFreq + (channel * channelBandwidth)
+double getChannelFrequency(const AstroData::Observation & observation, const unsigned int channel);
+// Geometric delay of a station in the direction of a beam, in meters
+double getDelay(const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, const unsigned int station, const unsigned int beam);
+void generateWeights(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, std::vector< float > & weights);
+// Recomputes only the weights of the changed stations, for every beam, and of the changed beams, for every station
+void updateWeights(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, const std::vector< unsigned int > & changedStations, const std::vector< unsigned int > & changedBeams, std::vector< float > & weights);
+// Compact geometry for the kernels that generate their weights, organized as [station][nrPaddedBeams] float4; the delays are in turns, reduced in double precision:
+// x is the fractional turns at minFreq, y + z the fractional turns per channel split in a high and a low float, and w = 0
+void getGeometryTable(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, std::vector< float > & geometry);
+void computeWeight(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, const unsigned int channel, const unsigned int station, const unsigned int beam, std::vector< float > & weights);
+
+// Implementations
+double getChannelFrequency(const AstroData::Observation & observation, const unsigned int channel) {
+  return (observation.getMinFreq() + (channel * static_cast< double >(observation.getChannelBandwidth()))) * 1.0e6;
+}
+
+void generateWeights(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, std::vector< float > & weights) {
+  #pragma omp parallel for schedule(static)
+  for ( int channel = 0; channel < static_cast< int >(observation.getNrChannels()); channel++ ) {
+    for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+      for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+        computeWeight(observation, stationPositions, beamDirections, channel, station, beam, weights);
+      }
+    }
+  }
+}
+
+void updateWeights(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, const std::vector< unsigned int > & changedStations, const std::vector< unsigned int > & changedBeams, std::vector< float > & weights) {
+  #pragma omp parallel for schedule(static)
+  for ( int channel = 0; channel < static_cast< int >(observation.getNrChannels()); channel++ ) {
+    for ( std::vector< unsigned int >::const_iterator station = changedStations.begin(); station != changedStations.end(); ++station ) {
+      for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+        computeWeight(observation, stationPositions, beamDirections, channel, *station, beam, weights);
+      }
+    }
+    for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+      for ( std::vector< unsigned int >::const_iterator beam = changedBeams.begin(); beam != changedBeams.end(); ++beam ) {
+        computeWeight(observation, stationPositions, beamDirections, channel, station, *beam, weights);
+      }
+    }
+  }
+}
+
+double getDelay(const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, const unsigned int station, const unsigned int beam) {
+  double delay = 0.0;
+
+  for ( unsigned int item = 0; item < 3; item++ ) {
+    delay += static_cast< double >(beamDirections[(beam * 3) + item]) * stationPositions[(station * 3) + item];
+  }
+  return delay;
+}
+
+void getGeometryTable(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, std::vector< float > & geometry) {
+  const double minTurns = getChannelFrequency(observation, 0) / SPEED_OF_LIGHT;
+  const double channelTurns = (observation.getChannelBandwidth() * 1.0e6) / SPEED_OF_LIGHT;
+
+  geometry.assign(observation.getNrStations() * observation.getNrPaddedBeams() * 4, 0.0f);
+  for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+    for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+      const double delay = getDelay(stationPositions, beamDirections, station, beam);
+      const double turns = (minTurns * delay) - std::floor(minTurns * delay);
+      const double turnsPerChannel = (channelTurns * delay) - std::floor(channelTurns * delay);
+      const unsigned int index = ((station * observation.getNrPaddedBeams()) + beam) * 4;
+
+      geometry[index] = static_cast< float >(turns);
+      geometry[index + 1] = static_cast< float >(turnsPerChannel);
+      geometry[index + 2] = static_cast< float >(turnsPerChannel - geometry[index + 1]);
+    }
+  }
+}
+
+void computeWeight(const AstroData::Observation & observation, const std::vector< float > & stationPositions, const std::vector< float > & beamDirections, const unsigned int channel, const unsigned int station, const unsigned int beam, std::vector< float > & weights) {
+  const double delay = getDelay(stationPositions, beamDirections, station, beam);
+  // Phase in turns, reduced before the conversion to radians
+  double phase = (getChannelFrequency(observation, channel) * delay) / SPEED_OF_LIGHT;
+  phase = -2.0 * M_PI * (phase - std::floor(phase));
+  weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (station * observation.getNrPaddedBeams() * 2) + (beam * 2)] = std::cos(phase);
+  weights[(channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (station * observation.getNrPaddedBeams() * 2) + (beam * 2) + 1] = std::sin(phase);
+}
+
+} // RadioAstronomy
+
+#endif // BEAM_FORMER_WEIGHTS_HPP
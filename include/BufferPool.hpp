@@ -0,0 +1,185 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+namespace RadioAstronomy {
+
+// Alignment of the host buffers: a cache line, enough for any SIMD load
+const std::size_t BUFFER_ALIGNMENT = 64;
+
+// Host memory aligned to alignment bytes, with the capacity rounded up to whole alignments, so that vector code can always read whole lines
+// The memory is zeroed by the allocating thread, so that its pages are on the NUMA node of that thread; pageLocked memory is also locked in RAM
+// Without zero the memory is not written, and the threads that first write it decide where its pages are
+template< typename T > class AlignedBuffer {
+public:
+  AlignedBuffer(const std::size_t nrElements, const std::size_t alignment = BUFFER_ALIGNMENT, const bool pageLocked = false, const bool zero = true);
+  ~AlignedBuffer();
+  AlignedBuffer(const AlignedBuffer< T > & buffer) = delete;
+  AlignedBuffer< T > & operator=(const AlignedBuffer< T > & buffer) = delete;
+  // Get
+  T * data();
+  const T * data() const;
+  std::size_t size() const;
+  std::size_t capacity() const;
+  // The lock fails, without errors, if the process is over its limit of locked memory
+  bool isPageLocked() const;
+  // Set
+  // Throws std::bad_alloc if nrElements is more than the capacity
+  void resize(const std::size_t nrElements);
+
+private:
+  T * buffer;
+  std::size_t nrElements;
+  std::size_t nrAllocatedElements;
+  bool pageLocked;
+};
+
+// Aligned buffers that are handed out again once released, so that steady-state processing does not allocate
+// A request is served by the smallest released buffer with enough capacity; the content of a reused buffer is not defined
+template< typename T > class BufferPool {
+public:
+  BufferPool(const std::size_t alignment = BUFFER_ALIGNMENT, const bool pageLocked = false);
+  ~BufferPool();
+  BufferPool(const BufferPool< T > & pool) = delete;
+  BufferPool< T > & operator=(const BufferPool< T > & pool) = delete;
+  // Get
+  // Number of buffers allocated by the pool since its creation
+  unsigned int getNrAllocations() const;
+  // Utils
+  // The buffer, of exactly nrElements elements, belongs to the pool
+  AlignedBuffer< T > * acquire(const std::size_t nrElements);
+  void release(AlignedBuffer< T > * buffer);
+
+private:
+  std::size_t alignment;
+  bool pageLocked;
+  std::vector< AlignedBuffer< T > * > buffers;
+  // Released buffers by capacity
+  std::multimap< std::size_t, AlignedBuffer< T > * > freeBuffers;
+  unsigned int nrAllocations;
+  std::mutex lock;
+};
+
+// Pool of the scratch buffers of the calling thread, e.g. the accumulators of the CPU beam formers
+template< typename T > BufferPool< T > & getScratchPool();
+
+// Implementations
+template< typename T > AlignedBuffer< T >::AlignedBuffer(const std::size_t nrElements, const std::size_t alignment, const bool pageLocked, const bool zero) : buffer(0), nrElements(nrElements), pageLocked(false) {
+  const std::size_t nrBytes = ((std::max(nrElements * sizeof(T), static_cast< std::size_t >(1)) + alignment - 1) / alignment) * alignment;
+  void * memory = 0;
+
+  if ( posix_memalign(&memory, alignment, nrBytes) != 0 ) {
+    throw std::bad_alloc();
+  }
+  buffer = reinterpret_cast< T * >(memory);
+  nrAllocatedElements = nrBytes / sizeof(T);
+  if ( zero ) {
+    std::memset(memory, 0, nrBytes);
+  }
+  if ( pageLocked ) {
+    this->pageLocked = (mlock(memory, nrBytes) == 0);
+  }
+}
+
+template< typename T > AlignedBuffer< T >::~AlignedBuffer() {
+  if ( pageLocked ) {
+    munlock(buffer, nrAllocatedElements * sizeof(T));
+  }
+  free(buffer);
+}
+
+template< typename T > inline T * AlignedBuffer< T >::data() {
+  return buffer;
+}
+
+template< typename T > inline const T * AlignedBuffer< T >::data() const {
+  return buffer;
+}
+
+template< typename T > inline std::size_t AlignedBuffer< T >::size() const {
+  return nrElements;
+}
+
+template< typename T > inline std::size_t AlignedBuffer< T >::capacity() const {
+  return nrAllocatedElements;
+}
+
+template< typename T > inline bool AlignedBuffer< T >::isPageLocked() const {
+  return pageLocked;
+}
+
+template< typename T > inline void AlignedBuffer< T >::resize(const std::size_t nrElements) {
+  if ( nrElements > nrAllocatedElements ) {
+    throw std::bad_alloc();
+  }
+  this->nrElements = nrElements;
+}
+
+template< typename T > BufferPool< T >::BufferPool(const std::size_t alignment, const bool pageLocked) : alignment(alignment), pageLocked(pageLocked), nrAllocations(0) {}
+
+template< typename T > BufferPool< T >::~BufferPool() {
+  for ( typename std::vector< AlignedBuffer< T > * >::iterator buffer = buffers.begin(); buffer != buffers.end(); ++buffer ) {
+    delete *buffer;
+  }
+}
+
+template< typename T > inline unsigned int BufferPool< T >::getNrAllocations() const {
+  return nrAllocations;
+}
+
+template< typename T > AlignedBuffer< T > * BufferPool< T >::acquire(const std::size_t nrElements) {
+  std::unique_lock< std::mutex > guard(lock);
+  typename std::multimap< std::size_t, AlignedBuffer< T > * >::iterator item = freeBuffers.lower_bound(nrElements);
+
+  if ( item != freeBuffers.end() ) {
+    AlignedBuffer< T > * buffer = item->second;
+
+    freeBuffers.erase(item);
+    buffer->resize(nrElements);
+    return buffer;
+  }
+  buffers.push_back(new AlignedBuffer< T >(nrElements, alignment, pageLocked));
+  nrAllocations++;
+  return buffers.back();
+}
+
+template< typename T > void BufferPool< T >::release(AlignedBuffer< T > * buffer) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  freeBuffers.insert(std::make_pair(buffer->capacity(), buffer));
+}
+
+template< typename T > BufferPool< T > & getScratchPool() {
+  // One pool per thread: no contention, and the buffers stay local to the thread that uses them
+  static thread_local BufferPool< T > pool;
+
+  return pool;
+}
+
+} // RadioAstronomy
+
+#endif // BUFFER_POOL_HPP
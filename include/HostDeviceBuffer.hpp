@@ -0,0 +1,121 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <Kernel.hpp>
+#include <BufferPool.hpp>
+
+
+#ifndef HOST_DEVICE_BUFFER_HPP
+#define HOST_DEVICE_BUFFER_HPP
+
+namespace RadioAstronomy {
+
+// Host buffer paired with a persistent device buffer of the same size, allocated once and reused for every transfer
+// If the device shares the host memory (CPU runtimes, integrated GPUs) the device buffer is the page-aligned host buffer itself (CL_MEM_USE_HOST_PTR),
+// and transfers do not copy; otherwise the host buffer is pinned memory of the runtime (CL_MEM_ALLOC_HOST_PTR), mapped for the lifetime of the object
+template< typename T > class HostDeviceBuffer {
+public:
+  HostDeviceBuffer(const std::size_t nrElements, const cl_mem_flags flags, cl::Context & clContext, cl::Device & clDevice, cl::CommandQueue & clQueue);
+  ~HostDeviceBuffer();
+  HostDeviceBuffer(const HostDeviceBuffer< T > & buffer) = delete;
+  HostDeviceBuffer< T > & operator=(const HostDeviceBuffer< T > & buffer) = delete;
+  // Get
+  T * data();
+  std::size_t size() const;
+  cl::Buffer & getDeviceBuffer();
+  bool isZeroCopy() const;
+  // Utils
+  // Transfers on the queue of the buffer; without a copy they only make the two sides consistent
+  // With event, the event of the transfer is returned, e.g. to profile it
+  void upload(const bool blocking = false, cl::Event * event = 0);
+  void download(const bool blocking = true, cl::Event * event = 0);
+
+private:
+  std::size_t nrElements;
+  bool zeroCopy;
+  AlignedBuffer< T > * host;
+  cl::Buffer pinned;
+  T * hostPointer;
+  cl::Buffer device;
+  cl::CommandQueue clQueue;
+};
+
+// Implementations
+template< typename T > HostDeviceBuffer< T >::HostDeviceBuffer(const std::size_t nrElements, const cl_mem_flags flags, cl::Context & clContext, cl::Device & clDevice, cl::CommandQueue & clQueue) : nrElements(nrElements), zeroCopy(false), host(0), hostPointer(0), clQueue(clQueue) {
+  zeroCopy = (clDevice.getInfo< CL_DEVICE_HOST_UNIFIED_MEMORY >() == CL_TRUE);
+  if ( zeroCopy ) {
+    // The runtimes can use the host memory directly only if it is page aligned and a whole number of cache lines
+    host = new AlignedBuffer< T >(nrElements, sysconf(_SC_PAGESIZE));
+    hostPointer = host->data();
+    device = cl::Buffer(clContext, flags | CL_MEM_USE_HOST_PTR, host->capacity() * sizeof(T), reinterpret_cast< void * >(hostPointer), 0);
+  } else {
+    pinned = cl::Buffer(clContext, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, nrElements * sizeof(T), 0, 0);
+    hostPointer = reinterpret_cast< T * >(this->clQueue.enqueueMapBuffer(pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, nrElements * sizeof(T)));
+    device = cl::Buffer(clContext, flags, nrElements * sizeof(T), 0, 0);
+  }
+}
+
+template< typename T > HostDeviceBuffer< T >::~HostDeviceBuffer() {
+  if ( zeroCopy ) {
+    // Transfers and kernels in flight can still use the memory, and the device buffer has to be released before it
+    clQueue.finish();
+    device = cl::Buffer();
+    delete host;
+  } else {
+    clQueue.enqueueUnmapMemObject(pinned, reinterpret_cast< void * >(hostPointer));
+    clQueue.finish();
+  }
+}
+
+template< typename T > inline T * HostDeviceBuffer< T >::data() {
+  return hostPointer;
+}
+
+template< typename T > inline std::size_t HostDeviceBuffer< T >::size() const {
+  return nrElements;
+}
+
+template< typename T > inline cl::Buffer & HostDeviceBuffer< T >::getDeviceBuffer() {
+  return device;
+}
+
+template< typename T > inline bool HostDeviceBuffer< T >::isZeroCopy() const {
+  return zeroCopy;
+}
+
+template< typename T > void HostDeviceBuffer< T >::upload(const bool blocking, cl::Event * event) {
+  if ( zeroCopy ) {
+    void * pointer = clQueue.enqueueMapBuffer(device, blocking ? CL_TRUE : CL_FALSE, CL_MAP_WRITE, 0, nrElements * sizeof(T));
+
+    clQueue.enqueueUnmapMemObject(device, pointer, 0, event);
+  } else {
+    clQueue.enqueueWriteBuffer(device, blocking ? CL_TRUE : CL_FALSE, 0, nrElements * sizeof(T), reinterpret_cast< void * >(hostPointer), 0, event);
+  }
+}
+
+template< typename T > void HostDeviceBuffer< T >::download(const bool blocking, cl::Event * event) {
+  if ( zeroCopy ) {
+    void * pointer = clQueue.enqueueMapBuffer(device, blocking ? CL_TRUE : CL_FALSE, CL_MAP_READ, 0, nrElements * sizeof(T));
+
+    clQueue.enqueueUnmapMemObject(device, pointer, 0, event);
+  } else {
+    clQueue.enqueueReadBuffer(device, blocking ? CL_TRUE : CL_FALSE, 0, nrElements * sizeof(T), reinterpret_cast< void * >(hostPointer), 0, event);
+  }
+}
+
+} // RadioAstronomy
+
+#endif // HOST_DEVICE_BUFFER_HPP
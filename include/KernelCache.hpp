@@ -0,0 +1,147 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Kernel.hpp>
+#include <utils.hpp>
+
+
+#ifndef KERNEL_CACHE_HPP
+#define KERNEL_CACHE_HPP
+
+namespace RadioAstronomy {
+
+// 64 bit FNV-1a hash
+unsigned long long int hashString(const std::string & text, unsigned long long int hash = 14695981039346656037ULL);
+// Identifies a compiled program: hash of source, build options and device name, version and driver
+std::string getProgramKey(const std::string & code, const std::string & flags, cl::Device & clDevice);
+// Same interface as isa::OpenCL::compile, but programs are built at most once per process and, if cacheDirectory is not empty,
+// their binaries are stored in and reloaded from cacheDirectory; the directory is created if it does not exist
+// It can be called by more threads at the same time
+cl::Kernel * compileCached(const std::string & name, const std::string & code, const std::string & flags, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory);
+
+// Implementations
+unsigned long long int hashString(const std::string & text, unsigned long long int hash) {
+  for ( unsigned int item = 0; item < text.size(); item++ ) {
+    hash ^= static_cast< unsigned char >(text[item]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string getProgramKey(const std::string & code, const std::string & flags, cl::Device & clDevice) {
+  std::ostringstream key;
+  unsigned long long int hash = hashString(code);
+
+  hash = hashString(std::string(1, '\0') + flags, hash);
+  hash = hashString(std::string(1, '\0') + clDevice.getInfo< CL_DEVICE_NAME >(), hash);
+  hash = hashString(std::string(1, '\0') + clDevice.getInfo< CL_DEVICE_VERSION >(), hash);
+  hash = hashString(std::string(1, '\0') + clDevice.getInfo< CL_DRIVER_VERSION >(), hash);
+  key << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return key.str();
+}
+
+cl::Kernel * compileCached(const std::string & name, const std::string & code, const std::string & flags, cl::Context & clContext, cl::Device & clDevice, const std::string & cacheDirectory) {
+  // Programs are specific to a context
+  static std::map< std::string, cl::Program > programs;
+  const std::string key = getProgramKey(code, flags, clDevice);
+  // Copies of the same context share their programs
+  const std::string memoKey = key + "_" + isa::utils::toString(clContext());
+  const std::string filename = cacheDirectory + "/" + key + ".bin";
+  std::vector< cl::Device > devices(1, clDevice);
+  cl::Program program;
+  bool memoized = false;
+
+  #pragma omp critical (kernelCache)
+  {
+    if ( programs.find(memoKey) != programs.end() ) {
+      program = programs[memoKey];
+      memoized = true;
+    }
+  }
+  if ( memoized ) {
+    return new cl::Kernel(program, name.c_str());
+  }
+  // Try the binary in the cache, and fall back to the source if it is missing or the device rejects it
+  bool built = false;
+  std::ifstream binaryFile;
+  if ( !cacheDirectory.empty() ) {
+    binaryFile.open(filename.c_str(), std::ios::binary);
+  }
+  if ( binaryFile ) {
+    std::string binary((std::istreambuf_iterator< char >(binaryFile)), std::istreambuf_iterator< char >());
+
+    try {
+      cl::Program::Binaries binaries(1, std::make_pair(reinterpret_cast< const void * >(binary.data()), binary.size()));
+
+      program = cl::Program(clContext, devices, binaries);
+      program.build(devices, flags.c_str());
+      built = true;
+    } catch ( cl::Error & err ) {
+      built = false;
+    }
+  }
+  if ( !built ) {
+    try {
+      cl::Program::Sources sources(1, std::make_pair(code.c_str(), code.size()));
+
+      program = cl::Program(clContext, sources);
+      program.build(devices, flags.c_str());
+    } catch ( cl::Error & err ) {
+      throw isa::OpenCL::OpenCLError("Error building " + name + ": " + isa::utils::toString(err.err()) + ".\n" + program.getBuildInfo< CL_PROGRAM_BUILD_LOG >(clDevice));
+    }
+    if ( !cacheDirectory.empty() ) {
+      // A failure to store the binary is not an error, the program is simply built again next time
+      std::vector< size_t > sizes = program.getInfo< CL_PROGRAM_BINARY_SIZES >();
+
+      if ( (sizes.size() == 1) && (sizes[0] > 0) ) {
+        std::vector< char > binary(sizes[0]);
+        char * binaryPointer = binary.data();
+        const std::string temporaryFilename = filename + "." + isa::utils::toString(getpid());
+
+        if ( clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(char *), &binaryPointer, 0) == CL_SUCCESS ) {
+          mkdir(cacheDirectory.c_str(), 0755);
+          std::ofstream output(temporaryFilename.c_str(), std::ios::binary);
+
+          output.write(binary.data(), binary.size());
+          output.close();
+          // Concurrent writers of the same program produce the same file, the rename makes the update atomic
+          if ( !output || (std::rename(temporaryFilename.c_str(), filename.c_str()) != 0) ) {
+            std::remove(temporaryFilename.c_str());
+          }
+        }
+      }
+    }
+  }
+  #pragma omp critical (kernelCache)
+  {
+    programs[memoKey] = program;
+  }
+
+  return new cl::Kernel(program, name.c_str());
+}
+
+} // RadioAstronomy
+
+#endif // KERNEL_CACHE_HPP
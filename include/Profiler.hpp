@@ -0,0 +1,200 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+
+#include <utils.hpp>
+
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+namespace RadioAstronomy {
+
+// A timed stage: a kernel, a transfer, or a phase of a CPU engine; times are in seconds
+// OpenCL stages have the queued, submitted, started and ended times of their event, in the clock of the device, and time is ended - started;
+// for a phase of a CPU engine, the timestamps are those of the whole run and time is the busy time of the phase, averaged over the threads
+struct ProfilingRecord {
+  std::string stage;
+  std::string configuration;
+  double queued;
+  double submitted;
+  double started;
+  double ended;
+  double time;
+  // Work done by the stage, for its rates
+  double flop;
+  double bytes;
+};
+
+// Collects the records of the instrumented stages, from any thread, and exports them with their rates
+// Given the peaks of the machine, every record also has the attained fraction of its roofline, min(peak GFLOP/s, flop/bytes * peak GB/s)
+class Profiler {
+public:
+  Profiler(const double peakGFLOPs = 0.0, const double peakGBs = 0.0);
+  ~Profiler();
+  // Get
+  std::vector< ProfilingRecord > getRecords();
+  double getGFLOPs(const ProfilingRecord & record) const;
+  double getGBs(const ProfilingRecord & record) const;
+  // Zero without the peaks of the machine
+  double getRooflineFraction(const ProfilingRecord & record) const;
+  // Seconds since the creation of the profiler, the clock of the CPU records
+  double now() const;
+  // Utils
+  void record(const ProfilingRecord & record);
+  void record(const std::string & stage, const std::string & configuration, const double started, const double ended, const double time, const double flop, const double bytes);
+  void clear();
+  // One line per record, with a header
+  void writeCSV(std::ostream & output);
+  // An array of objects, one per record
+  void writeJSON(std::ostream & output);
+
+private:
+  double peakGFLOPs;
+  double peakGBs;
+  std::vector< ProfilingRecord > records;
+  std::chrono::steady_clock::time_point origin;
+  std::mutex lock;
+};
+
+// CSV if the name of the file ends in .csv, JSON otherwise; throws std::runtime_error if the file cannot be written
+void writeProfile(Profiler & profiler, const std::string & filename);
+
+// Implementations
+Profiler::Profiler(const double peakGFLOPs, const double peakGBs) : peakGFLOPs(peakGFLOPs), peakGBs(peakGBs), origin(std::chrono::steady_clock::now()) {}
+
+Profiler::~Profiler() {}
+
+std::vector< ProfilingRecord > Profiler::getRecords() {
+  std::unique_lock< std::mutex > guard(lock);
+
+  return records;
+}
+
+double Profiler::getGFLOPs(const ProfilingRecord & record) const {
+  if ( record.time <= 0.0 ) {
+    return 0.0;
+  }
+  return isa::utils::giga(record.flop) / record.time;
+}
+
+double Profiler::getGBs(const ProfilingRecord & record) const {
+  if ( record.time <= 0.0 ) {
+    return 0.0;
+  }
+  return isa::utils::giga(record.bytes) / record.time;
+}
+
+double Profiler::getRooflineFraction(const ProfilingRecord & record) const {
+  double roofline = 0.0;
+
+  if ( (peakGFLOPs <= 0.0) || (peakGBs <= 0.0) ) {
+    return 0.0;
+  }
+  // Transfers do no operations, and are bound by the bandwidth only
+  if ( record.flop <= 0.0 ) {
+    return getGBs(record) / peakGBs;
+  } else if ( record.bytes <= 0.0 ) {
+    return getGFLOPs(record) / peakGFLOPs;
+  }
+  roofline = std::min(peakGFLOPs, (record.flop / record.bytes) * peakGBs);
+  return getGFLOPs(record) / roofline;
+}
+
+inline double Profiler::now() const {
+  return std::chrono::duration< double >(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Profiler::record(const ProfilingRecord & record) {
+  std::unique_lock< std::mutex > guard(lock);
+
+  records.push_back(record);
+}
+
+void Profiler::record(const std::string & stage, const std::string & configuration, const double started, const double ended, const double time, const double flop, const double bytes) {
+  ProfilingRecord item;
+
+  item.stage = stage;
+  item.configuration = configuration;
+  item.queued = started;
+  item.submitted = started;
+  item.started = started;
+  item.ended = ended;
+  item.time = time;
+  item.flop = flop;
+  item.bytes = bytes;
+  record(item);
+}
+
+void Profiler::clear() {
+  std::unique_lock< std::mutex > guard(lock);
+
+  records.clear();
+}
+
+void Profiler::writeCSV(std::ostream & output) {
+  std::vector< ProfilingRecord > records = getRecords();
+
+  output << "stage,configuration,queued,submitted,started,ended,time,flop,bytes,GFLOPs,GBs,roofline" << std::endl;
+  output << std::setprecision(9);
+  for ( std::vector< ProfilingRecord >::const_iterator record = records.begin(); record != records.end(); ++record ) {
+    output << record->stage << ",\"" << record->configuration << "\",";
+    output << record->queued << "," << record->submitted << "," << record->started << "," << record->ended << "," << record->time << ",";
+    output << record->flop << "," << record->bytes << ",";
+    output << getGFLOPs(*record) << "," << getGBs(*record) << "," << getRooflineFraction(*record) << std::endl;
+  }
+}
+
+void Profiler::writeJSON(std::ostream & output) {
+  std::vector< ProfilingRecord > records = getRecords();
+
+  output << "[" << std::endl;
+  output << std::setprecision(9);
+  for ( std::vector< ProfilingRecord >::const_iterator record = records.begin(); record != records.end(); ++record ) {
+    output << "  {\"stage\": \"" << record->stage << "\", \"configuration\": \"" << record->configuration << "\", ";
+    output << "\"queued\": " << record->queued << ", \"submitted\": " << record->submitted << ", \"started\": " << record->started << ", \"ended\": " << record->ended << ", \"time\": " << record->time << ", ";
+    output << "\"flop\": " << record->flop << ", \"bytes\": " << record->bytes << ", ";
+    output << "\"GFLOPs\": " << getGFLOPs(*record) << ", \"GBs\": " << getGBs(*record) << ", \"roofline\": " << getRooflineFraction(*record) << "}";
+    if ( record + 1 != records.end() ) {
+      output << ",";
+    }
+    output << std::endl;
+  }
+  output << "]" << std::endl;
+}
+
+void writeProfile(Profiler & profiler, const std::string & filename) {
+  std::ofstream output(filename.c_str());
+
+  if ( !output ) {
+    throw std::runtime_error("Impossible to write the profile " + filename + ".");
+  }
+  if ( (filename.size() >= 4) && (filename.compare(filename.size() - 4, 4, ".csv") == 0) ) {
+    profiler.writeCSV(output);
+  } else {
+    profiler.writeJSON(output);
+  }
+}
+
+} // RadioAstronomy
+
+#endif // PROFILER_HPP
@@ -0,0 +1,54 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include <Kernel.hpp>
+#include <Profiler.hpp>
+
+
+#ifndef PROFILER_OPENCL_HPP
+#define PROFILER_OPENCL_HPP
+
+namespace RadioAstronomy {
+
+// The events must be complete, and come from a queue created with CL_QUEUE_PROFILING_ENABLE
+// Time, in seconds, the device spent executing the command of an event, without queueing and synchronization
+double getEventTime(cl::Event & event);
+// Records the queued, submitted, started and ended times of the command of an event
+void recordEvent(Profiler & profiler, const std::string & stage, const std::string & configuration, cl::Event & event, const double flop, const double bytes);
+
+// Implementations
+double getEventTime(cl::Event & event) {
+  return (event.getProfilingInfo< CL_PROFILING_COMMAND_END >() - event.getProfilingInfo< CL_PROFILING_COMMAND_START >()) * 1.0e-09;
+}
+
+void recordEvent(Profiler & profiler, const std::string & stage, const std::string & configuration, cl::Event & event, const double flop, const double bytes) {
+  ProfilingRecord record;
+
+  record.stage = stage;
+  record.configuration = configuration;
+  record.queued = event.getProfilingInfo< CL_PROFILING_COMMAND_QUEUED >() * 1.0e-09;
+  record.submitted = event.getProfilingInfo< CL_PROFILING_COMMAND_SUBMIT >() * 1.0e-09;
+  record.started = event.getProfilingInfo< CL_PROFILING_COMMAND_START >() * 1.0e-09;
+  record.ended = event.getProfilingInfo< CL_PROFILING_COMMAND_END >() * 1.0e-09;
+  record.time = record.ended - record.started;
+  record.flop = flop;
+  record.bytes = bytes;
+  profiler.record(record);
+}
+
+} // RadioAstronomy
+
+#endif // PROFILER_OPENCL_HPP
@@ -0,0 +1,146 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <Observation.hpp>
+#include <utils.hpp>
+
+
+#ifndef STATION_DATA_HPP
+#define STATION_DATA_HPP
+
+namespace RadioAstronomy {
+
+// Recorded station data, memory-mapped: after a header of headerSize bytes, the file contains consecutive seconds,
+// each already in the layout of the samples of the beam formers, [channel][station][paddedSample][4] of type I; headerSize is a multiple of sizeof(I)
+// Seconds are read by the kernel ahead of their use, so that reading the file overlaps with beam forming
+template< typename I > class StationDataFile {
+public:
+  StationDataFile(const std::string & filename, const AstroData::Observation & observation, const unsigned int nrSecondsAhead = 2, const std::size_t headerSize = 0);
+  ~StationDataFile();
+  // Get
+  // An incomplete last second is not counted
+  unsigned int getNrSeconds() const;
+  // Number of values of type I in a second
+  std::size_t getNrSamplesPerSecond() const;
+  // Utils
+  // Samples of a second, valid until the file is closed; the following nrSecondsAhead seconds are read ahead
+  // Throws std::out_of_range if second is not in the file
+  const I * getSecond(const unsigned int second);
+  // The pages of a second that is not used anymore can be dropped from memory
+  void release(const unsigned int second);
+
+private:
+  void advise(const unsigned int firstSecond, const unsigned int nrSeconds, const int advice);
+
+  std::string filename;
+  int file;
+  unsigned char * data;
+  std::size_t fileSize;
+  std::size_t headerSize;
+  std::size_t secondSize;
+  unsigned int nrSeconds;
+  unsigned int nrSecondsAhead;
+};
+
+// Implementations
+template< typename I > StationDataFile< I >::StationDataFile(const std::string & filename, const AstroData::Observation & observation, const unsigned int nrSecondsAhead, const std::size_t headerSize) : filename(filename), file(-1), data(0), fileSize(0), headerSize(headerSize), nrSeconds(0), nrSecondsAhead(nrSecondsAhead) {
+  struct stat fileStatus;
+
+  secondSize = static_cast< std::size_t >(observation.getNrChannels()) * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4 * sizeof(I);
+  file = open(filename.c_str(), O_RDONLY);
+  if ( file < 0 ) {
+    throw std::runtime_error("Impossible to open station data file " + filename + ": " + std::strerror(errno));
+  }
+  if ( fstat(file, &fileStatus) != 0 ) {
+    close(file);
+    throw std::runtime_error("Impossible to read the size of station data file " + filename + ": " + std::strerror(errno));
+  }
+  fileSize = fileStatus.st_size;
+  if ( fileSize > headerSize ) {
+    nrSeconds = (fileSize - headerSize) / secondSize;
+  }
+  if ( nrSeconds == 0 ) {
+    close(file);
+    throw std::runtime_error("Station data file " + filename + " does not contain a whole second.");
+  }
+  data = reinterpret_cast< unsigned char * >(mmap(0, fileSize, PROT_READ, MAP_SHARED, file, 0));
+  if ( data == MAP_FAILED ) {
+    close(file);
+    throw std::runtime_error("Impossible to map station data file " + filename + ": " + std::strerror(errno));
+  }
+  // Seconds are read in order, and the first ones are needed immediately
+  madvise(data, fileSize, MADV_SEQUENTIAL);
+  advise(0, nrSecondsAhead + 1, MADV_WILLNEED);
+}
+
+template< typename I > StationDataFile< I >::~StationDataFile() {
+  munmap(data, fileSize);
+  close(file);
+}
+
+template< typename I > inline unsigned int StationDataFile< I >::getNrSeconds() const {
+  return nrSeconds;
+}
+
+template< typename I > inline std::size_t StationDataFile< I >::getNrSamplesPerSecond() const {
+  return secondSize / sizeof(I);
+}
+
+template< typename I > const I * StationDataFile< I >::getSecond(const unsigned int second) {
+  if ( second >= nrSeconds ) {
+    throw std::out_of_range("Second " + isa::utils::toString(second) + " is not in station data file " + filename + ".");
+  }
+  advise(second + 1, nrSecondsAhead, MADV_WILLNEED);
+  return reinterpret_cast< const I * >(data + headerSize + (second * secondSize));
+}
+
+template< typename I > void StationDataFile< I >::release(const unsigned int second) {
+  if ( second < nrSeconds ) {
+    advise(second, 1, MADV_DONTNEED);
+  }
+}
+
+template< typename I > void StationDataFile< I >::advise(const unsigned int firstSecond, const unsigned int nrSeconds, const int advice) {
+  if ( firstSecond >= this->nrSeconds ) {
+    return;
+  }
+  // The advice is given on whole pages; a page shared with a neighbouring second is never dropped
+  const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+  std::size_t begin = headerSize + (firstSecond * secondSize);
+  std::size_t end = headerSize + (std::min(firstSecond + nrSeconds, this->nrSeconds) * secondSize);
+
+  if ( advice == MADV_DONTNEED ) {
+    begin = ((begin + pageSize - 1) / pageSize) * pageSize;
+    end = (end / pageSize) * pageSize;
+  } else {
+    begin = (begin / pageSize) * pageSize;
+  }
+  if ( begin < end ) {
+    madvise(data + begin, end - begin, advice);
+  }
+}
+
+} // RadioAstronomy
+
+#endif // STATION_DATA_HPP
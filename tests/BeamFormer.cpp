@@ -19,6 +19,7 @@
 #include <fstream>
 #include <iomanip>
 #include <limits>
+#include <cmath>
 #include <ctime>
 
 #include <ArgumentList.hpp>
@@ -27,7 +28,23 @@
 #include <Kernel.hpp>
 #include <utils.hpp>
 #include <BeamFormer.hpp>
+#include <BeamFormerDatabase.hpp>
+#include <BeamFormerWeights.hpp>
+#include <KernelCache.hpp>
+#include <BeamFormerKernelPolicy.hpp>
+#include <BeamFormerMultiDevice.hpp>
+#include <BeamFormerMultiDeviceOpenCL.hpp>
 
+#if defined(BEAM_FORMER_INPUT_CHAR)
+typedef char inputDataType;
+std::string inputTypeName("char");
+#elif defined(BEAM_FORMER_INPUT_SHORT)
+typedef short inputDataType;
+std::string inputTypeName("short");
+#else
+typedef float inputDataType;
+std::string inputTypeName("float");
+#endif
 typedef float dataType;
 std::string typeName("float");
 
@@ -35,67 +52,260 @@ std::string typeName("float");
 int main(int argc, char *argv[]) {
   bool print = false;
   bool random = false;
-  bool localMem = false;
+  bool generateWeights = false;
+  bool generic = false;
+  bool incoherent = false;
+  bool splitDevices = false;
+  bool allDevices = false;
+  unsigned int nrSamplesPerIntegration = 1;
+  unsigned int nrFlaggedStations = 0;
+  unsigned int nrChannelsPerChunk = 0;
 	unsigned int clPlatformID = 0;
 	unsigned int clDeviceID = 0;
-	unsigned int nrSamplesPerBlock = 0;
-	unsigned int nrBeamsPerBlock = 0;
-  unsigned int nrSamplesPerThread = 0;
-  unsigned int nrBeamsPerThread = 0;
   long long unsigned int wrongSamples = 0;
+  std::string databaseFilename;
+  std::string cacheDirectory;
+  RadioAstronomy::BeamFormerConf conf;
+  RadioAstronomy::OutputMode outputMode = RadioAstronomy::OUTPUT_VOLTAGES;
+  RadioAstronomy::OutputLayout outputLayout = RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE;
   AstroData::Observation observation;
 
   try {
     isa::utils::ArgumentList args(argc, argv);
     print = args.getSwitch("-print");
     random = args.getSwitch("-random");
-    localMem = args.getSwitch("-local");
+    generateWeights = args.getSwitch("-generate_weights");
+    generic = args.getSwitch("-generic");
+    incoherent = args.getSwitch("-incoherent");
+    try {
+      nrFlaggedStations = args.getSwitchArgument< unsigned int >("-flagged");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // No station is flagged by default
+    }
+    try {
+      nrChannelsPerChunk = args.getSwitchArgument< unsigned int >("-chunk_channels");
+      splitDevices = args.getSwitch("-sub_devices");
+      allDevices = args.getSwitch("-all_devices");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The channels are partitioned over devices only on request
+    }
+    if ( (nrChannelsPerChunk > 0) && (generateWeights || generic || incoherent || (nrFlaggedStations > 0)) ) {
+      std::cerr << "The multi-device run supports neither generated weights, nor the generic, flagging or incoherent kernels." << std::endl;
+      return 1;
+    }
+    conf.setLocalMem(args.getSwitch("-local"));
+    if ( args.getSwitch("-stokes_i") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_I;
+    } else if ( args.getSwitch("-stokes_iquv") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_IQUV;
+    }
+    if ( outputMode != RadioAstronomy::OUTPUT_VOLTAGES ) {
+      nrSamplesPerIntegration = args.getSwitchArgument< unsigned int >("-integration");
+    }
+    if ( args.getSwitch("-channel_beam_sample") ) {
+      outputLayout = RadioAstronomy::LAYOUT_CHANNEL_BEAM_SAMPLE;
+    } else if ( args.getSwitch("-beam_sample_channel") ) {
+      outputLayout = RadioAstronomy::LAYOUT_BEAM_SAMPLE_CHANNEL;
+    }
 		clPlatformID = args.getSwitchArgument< unsigned int >("-opencl_platform");
 		clDeviceID = args.getSwitchArgument< unsigned int >("-opencl_device");
     observation.setPadding(args.getSwitchArgument< unsigned int >("-padding"));
-		nrSamplesPerBlock = args.getSwitchArgument< unsigned int >("-sb");
-		nrBeamsPerBlock = args.getSwitchArgument< unsigned int >("-bb");
-		nrSamplesPerThread = args.getSwitchArgument< unsigned int >("-st");
-		nrBeamsPerThread = args.getSwitchArgument< unsigned int >("-bt");
+    try {
+      databaseFilename = args.getSwitchArgument< std::string >("-database");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // Without a tuning database the configuration is on the command line
+    }
+    try {
+      cacheDirectory = args.getSwitchArgument< std::string >("-kernel_cache");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // Without a cache directory kernels are only cached in memory
+    }
+    if ( databaseFilename.empty() ) {
+      conf.setNrSamplesPerBlock(args.getSwitchArgument< unsigned int >("-sb"));
+      conf.setNrBeamsPerBlock(args.getSwitchArgument< unsigned int >("-bb"));
+      conf.setNrSamplesPerThread(args.getSwitchArgument< unsigned int >("-st"));
+      conf.setNrBeamsPerThread(args.getSwitchArgument< unsigned int >("-bt"));
+      try {
+        conf.setNrChannelsPerBlock(args.getSwitchArgument< unsigned int >("-cb"));
+      } catch ( isa::utils::SwitchNotFound & err ) {
+        // One channel per work-group by default
+      }
+      try {
+        conf.setNrStationsPerThread(args.getSwitchArgument< unsigned int >("-spt"));
+      } catch ( isa::utils::SwitchNotFound & err ) {
+        // Every work-item sums all the stations by default
+      }
+      try {
+        conf.setNrStationsPerBlock(args.getSwitchArgument< unsigned int >("-spb"));
+      } catch ( isa::utils::SwitchNotFound & err ) {
+        // Weights are read from global memory by default
+      }
+      conf.setDoubleBuffer(args.getSwitch("-double_buffer"));
+    }
     observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
     observation.setNrStations(args.getSwitchArgument< unsigned int >("-stations"));
-    observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    if ( generateWeights ) {
+      unsigned int nrChannels = args.getSwitchArgument< unsigned int >("-channels");
+      float minFreq = args.getSwitchArgument< float >("-min_freq");
+
+      observation.setFrequencyRange(nrChannels, minFreq, args.getSwitchArgument< float >("-channel_bandwidth"));
+    } else {
+      observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    }
 		observation.setNrSamplesPerSecond(args.getSwitchArgument< unsigned int >("-samples"));
 	} catch  ( isa::utils::SwitchNotFound &err ) {
     std::cerr << err.what() << std::endl;
     return 1;
   }catch ( std::exception &err ) {
-    std::cerr << "Usage: " << argv[0] << " [-print] [-random] [-local] -opencl_platform ... -opencl_device ... -padding ... -sb ... -bb ... -st ... -bt ... -beams ... -stations ... -samples ... -channels ..." << std::endl;
+    std::cerr << "Usage: " << argv[0] << " [-print] [-random] [-generic | -flagged ...] [-incoherent] [-generate_weights -min_freq ... -channel_bandwidth ...] [-stokes_i | -stokes_iquv -integration ...] [-channel_beam_sample | -beam_sample_channel] -opencl_platform ... -opencl_device ... [-chunk_channels ... [-sub_devices] [-all_devices]] -padding ... [-kernel_cache ...] [-database ... | [-local] -sb ... -bb ... -st ... -bt ... [-cb ...] [-spt ...] [-spb ...] [-double_buffer]] -beams ... -stations ... -samples ... -channels ..." << std::endl;
 		return 1;
 	}
 
+  if ( !RadioAstronomy::isIntegrationValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    std::cerr << "The integration of " << nrSamplesPerIntegration << " samples does not divide the " << observation.getNrSamplesPerSecond() << " samples of a second." << std::endl;
+    return 1;
+  }
+
 	// Initialize OpenCL
-	cl::Context * clContext = new cl::Context();
-	std::vector< cl::Platform > * clPlatforms = new std::vector< cl::Platform >();
-	std::vector< cl::Device > * clDevices = new std::vector< cl::Device >();
-	std::vector< std::vector< cl::CommandQueue > > * clQueues = new std::vector< std::vector < cl::CommandQueue > >();
+	cl::Context clContext;
+	std::vector< cl::Platform > clPlatforms;
+	std::vector< cl::Device > clDevices;
+	std::vector< std::vector< cl::CommandQueue > > clQueues;
 
-  isa::OpenCL::initializeOpenCL(clPlatformID, 1, clPlatforms, clContext, clDevices, clQueues);
+  isa::OpenCL::initializeOpenCL(clPlatformID, 1, &clPlatforms, &clContext, &clDevices, &clQueues);
+
+  // Look up the best known configuration
+  if ( !databaseFilename.empty() ) {
+    RadioAstronomy::BeamFormerTuningDatabase database;
+
+    try {
+      RadioAstronomy::readBeamFormerTuningDatabase(database, databaseFilename);
+      conf = RadioAstronomy::getBestBeamFormerConf(database, clDevices.at(clDeviceID).getInfo< CL_DEVICE_NAME >(), outputMode, nrSamplesPerIntegration, inputTypeName, typeName, observation);
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+    std::cout << "Configuration: " << conf.print() << std::endl;
+  }
+  if ( generic || (nrFlaggedStations > 0) ) {
+    // The generic and flagging kernels reject a configuration that splits or blocks the stations
+    conf.setNrStationsPerThread(0);
+    conf.setNrStationsPerBlock(0);
+  }
 
 	// Allocate host memory
-  std::vector< dataType > samples = std::vector< dataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4);
-  std::vector< dataType > output = std::vector< dataType >(observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4);
-  std::vector< dataType > output_c = std::vector< dataType >(observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4);
+  std::vector< inputDataType > samples = std::vector< inputDataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4);
+  const unsigned int nrOutputValues = RadioAstronomy::getNrOutputValues(outputMode);
+  const unsigned int nrOutputSamples = RadioAstronomy::getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration);
+  std::vector< dataType > output = std::vector< dataType >(RadioAstronomy::getOutputSize(observation, outputMode, nrSamplesPerIntegration, outputLayout));
+  std::vector< dataType > output_c = std::vector< dataType >(observation.getNrBeams() * observation.getNrChannels() * nrOutputSamples * nrOutputValues);
   std::vector< float > weights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
   if ( random ) {
     std::srand(time(0));
   } else {
     std::srand(42);
   }
-  std::fill(weights.begin(), weights.end(), std::rand() % 100);
-  std::fill(samples.begin(), samples.end(), std::rand() % 1000);
+  std::vector< float > geometry;
+  if ( generateWeights ) {
+    // Stations within a hundred kilometers, beams within a few degrees of the zenith
+    std::vector< float > stationPositions(observation.getNrStations() * 3);
+    std::vector< float > beamDirections(observation.getNrBeams() * 3);
+
+    for ( unsigned int item = 0; item < stationPositions.size(); item++ ) {
+      stationPositions[item] = ((std::rand() % 200000) - 100000) / 2.0f;
+    }
+    for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+      beamDirections[(beam * 3)] = ((std::rand() % 200) - 100) / 2000.0f;
+      beamDirections[(beam * 3) + 1] = ((std::rand() % 200) - 100) / 2000.0f;
+      beamDirections[(beam * 3) + 2] = std::sqrt(1.0f - (beamDirections[(beam * 3)] * beamDirections[(beam * 3)]) - (beamDirections[(beam * 3) + 1] * beamDirections[(beam * 3) + 1]));
+    }
+    RadioAstronomy::generateWeights(observation, stationPositions, beamDirections, weights);
+    RadioAstronomy::getGeometryTable(observation, stationPositions, beamDirections, geometry);
+
+    // Moving some stations and beams, the incremental update has to give the same weights as a full generation
+    std::vector< float > movedStationPositions(stationPositions);
+    std::vector< float > movedBeamDirections(beamDirections);
+    std::vector< unsigned int > changedStations;
+    std::vector< unsigned int > changedBeams;
+    std::vector< float > updatedWeights(weights);
+    std::vector< float > generatedWeights(weights.size());
+    long long unsigned int wrongWeights = 0;
+
+    for ( unsigned int station = 0; station < observation.getNrStations(); station += 3 ) {
+      movedStationPositions[(station * 3)] += 1.5f;
+      movedStationPositions[(station * 3) + 2] -= 0.5f;
+      changedStations.push_back(station);
+    }
+    for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam += 2 ) {
+      movedBeamDirections[(beam * 3)] = -movedBeamDirections[(beam * 3)];
+      changedBeams.push_back(beam);
+    }
+    RadioAstronomy::updateWeights(observation, movedStationPositions, movedBeamDirections, changedStations, changedBeams, updatedWeights);
+    RadioAstronomy::generateWeights(observation, movedStationPositions, movedBeamDirections, generatedWeights);
+    for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+      for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+        for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+          for ( unsigned int item = 0; item < 2; item++ ) {
+            const unsigned int index = (channel * observation.getNrStations() * observation.getNrPaddedBeams() * 2) + (station * observation.getNrPaddedBeams() * 2) + (beam * 2) + item;
+
+            if ( updatedWeights[index] != generatedWeights[index] ) {
+              wrongWeights++;
+            }
+          }
+        }
+      }
+    }
+    if ( wrongWeights > 0 ) {
+      std::cout << "Wrong updated weights: " << wrongWeights << "." << std::endl;
+    } else {
+      std::cout << "Updated weights: TEST PASSED." << std::endl;
+    }
+  } else {
+    for ( unsigned int item = 0; item < weights.size(); item++ ) {
+      weights[item] = std::rand() % 100;
+    }
+  }
+  // Every item is different, so that indexing errors in the kernels cannot go unnoticed; samples fit in any input type
+  for ( unsigned int item = 0; item < samples.size(); item++ ) {
+    samples[item] = std::rand() % 100;
+  }
+  // Flagged stations are spread over the array, and have different samples so that summing them changes the beams
+  std::vector< bool > flagged(observation.getNrStations(), false);
+  std::vector< unsigned int > activeStations;
+  // At least one station is active
+  nrFlaggedStations = std::min(nrFlaggedStations, observation.getNrStations() - 1);
+  for ( unsigned int station = 0; station < nrFlaggedStations; station++ ) {
+    flagged[(station * observation.getNrStations()) / nrFlaggedStations] = true;
+  }
+  RadioAstronomy::getActiveStations(flagged, activeStations);
+  for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+    for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+      if ( flagged[station] ) {
+        std::fill(samples.begin() + (((channel * observation.getNrStations()) + station) * observation.getNrSamplesPerPaddedSecond() * 4), samples.begin() + (((channel * observation.getNrStations()) + station + 1) * observation.getNrSamplesPerPaddedSecond() * 4), samples[0] + 1);
+      }
+    }
+  }
 
   // Allocate device memory
-  cl::Buffer samples_d, output_d, weights_d;
+  std::vector< dataType > incoherentOutput;
+  std::vector< dataType > incoherentOutput_c;
+  if ( incoherent ) {
+    incoherentOutput.resize(RadioAstronomy::getIncoherentOutputSize(observation, outputMode, nrSamplesPerIntegration));
+    incoherentOutput_c.resize(incoherentOutput.size());
+  }
+  cl::Buffer samples_d, output_d, weights_d, activeStations_d, incoherent_d;
   try {
-    samples_d = cl::Buffer(*clContext, CL_MEM_READ_ONLY, samples.size() * sizeof(dataType), 0, 0);
-    output_d = cl::Buffer(*clContext, CL_MEM_WRITE_ONLY, observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4 * sizeof(dataType), 0, 0);
-    weights_d = cl::Buffer(*clContext, CL_MEM_READ_ONLY, weights.size() * sizeof(float), 0, 0);
+    samples_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, samples.size() * sizeof(inputDataType), 0, 0);
+    output_d = cl::Buffer(clContext, CL_MEM_WRITE_ONLY, output.size() * sizeof(dataType), 0, 0);
+    activeStations_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, activeStations.size() * sizeof(unsigned int), 0, 0);
+    if ( incoherent ) {
+      incoherent_d = cl::Buffer(clContext, CL_MEM_WRITE_ONLY, incoherentOutput.size() * sizeof(dataType), 0, 0);
+    }
+    if ( generateWeights ) {
+      weights_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, geometry.size() * sizeof(float), 0, 0);
+    } else {
+      weights_d = cl::Buffer(clContext, CL_MEM_READ_ONLY, weights.size() * sizeof(float), 0, 0);
+    }
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error allocating memory: " << isa::utils::toString(err.err()) << "." << std::endl;
     return 1;
@@ -103,21 +313,50 @@ int main(int argc, char *argv[]) {
 
   // Copy data structures to device
   try {
-    clQueues->at(clDeviceID)[0].enqueueWriteBuffer(weights_d, CL_FALSE, 0, weights.size() * sizeof(float), reinterpret_cast< void * >(weights.data()));
-    clQueues->at(clDeviceID)[0].enqueueWriteBuffer(samples_d, CL_FALSE, 0, samples.size() * sizeof(dataType), reinterpret_cast< void * >(samples.data()));
+    if ( generateWeights ) {
+      clQueues.at(clDeviceID)[0].enqueueWriteBuffer(weights_d, CL_FALSE, 0, geometry.size() * sizeof(float), reinterpret_cast< void * >(geometry.data()));
+    } else {
+      clQueues.at(clDeviceID)[0].enqueueWriteBuffer(weights_d, CL_FALSE, 0, weights.size() * sizeof(float), reinterpret_cast< void * >(weights.data()));
+    }
+    clQueues.at(clDeviceID)[0].enqueueWriteBuffer(samples_d, CL_FALSE, 0, samples.size() * sizeof(inputDataType), reinterpret_cast< void * >(samples.data()));
+    clQueues.at(clDeviceID)[0].enqueueWriteBuffer(activeStations_d, CL_FALSE, 0, activeStations.size() * sizeof(unsigned int), reinterpret_cast< void * >(activeStations.data()));
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error H2D transfer: " << isa::utils::toString(err.err()) << "." << std::endl;
     return 1;
   }
 
 	// Generate kernel
-  std::string * code = RadioAstronomy::getBeamFormerOpenCL(localMem, nrSamplesPerBlock, nrBeamsPerBlock, nrSamplesPerThread, nrBeamsPerThread, typeName, observation);
+  std::string code;
+  if ( nrFlaggedStations > 0 ) {
+    std::string * flaggingCode = RadioAstronomy::getBeamFormerFlaggingOpenCL(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputTypeName, typeName, observation, incoherent);
+    code = *flaggingCode;
+    delete flaggingCode;
+  } else if ( generic ) {
+    std::string * genericCode = RadioAstronomy::getBeamFormerGenericOpenCL(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputTypeName, typeName, observation, incoherent);
+    code = *genericCode;
+    delete genericCode;
+  } else {
+    code = RadioAstronomy::getBeamFormerOpenCLMemo(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputTypeName, typeName, observation, incoherent);
+    if ( generateWeights ) {
+      // The frequencies are in the geometry table, so the memoized code of other frequencies is the same as generated for them
+      AstroData::Observation shiftedObservation(observation);
+      shiftedObservation.setFrequencyRange(observation.getNrChannels(), observation.getMinFreq() * (1.0f + 2.0e-6f), observation.getChannelBandwidth());
+      std::string * shiftedCode = RadioAstronomy::getBeamFormerOpenCL(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputTypeName, typeName, shiftedObservation, incoherent);
+
+      if ( (RadioAstronomy::getBeamFormerOpenCLMemo(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputTypeName, typeName, shiftedObservation, incoherent) != *shiftedCode) || (*shiftedCode != code) ) {
+        std::cout << "Wrong memoized code for shifted frequencies." << std::endl;
+      } else {
+        std::cout << "Memoized code: TEST PASSED." << std::endl;
+      }
+      delete shiftedCode;
+    }
+  }
   cl::Kernel * kernel;
   if ( print ) {
-    std::cout << *code << std::endl;
+    std::cout << code << std::endl;
   }
 	try {
-    kernel = isa::OpenCL::compile("beamFormer", *code, "-cl-mad-enable -Werror", *clContext, clDevices->at(clDeviceID));
+    kernel = RadioAstronomy::compileCached("beamFormer", code, "-cl-mad-enable -Werror", clContext, clDevices.at(clDeviceID), cacheDirectory);
 	} catch ( isa::OpenCL::OpenCLError &err ) {
     std::cerr << err.what() << std::endl;
 		return 1;
@@ -125,25 +364,87 @@ int main(int argc, char *argv[]) {
 
   // Run OpenCL kernel and CPU control
   try {
-    cl::NDRange global(observation.getNrSamplesPerPaddedSecond() / nrSamplesPerThread, observation.getNrBeams() / nrBeamsPerThread, observation.getNrChannels());
-    cl::NDRange local(nrSamplesPerBlock, nrBeamsPerBlock, 1);
+    cl::NDRange global(observation.getNrSamplesPerPaddedSecond() / conf.getNrSamplesPerThread(), observation.getNrBeams() / conf.getNrBeamsPerThread(), observation.getNrChannels() * conf.getNrStationGroups(observation));
+    cl::NDRange local(conf.getNrSamplesPerBlock(), conf.getNrBeamsPerBlock(), conf.getNrChannelsPerBlock() * conf.getNrStationGroups(observation));
 
     kernel->setArg(0, samples_d);
     kernel->setArg(1, output_d);
     kernel->setArg(2, weights_d);
-    clQueues->at(clDeviceID)[0].enqueueNDRangeKernel(*kernel, cl::NullRange, global, local);
-    RadioAstronomy::beamFormer< dataType >(observation, samples, output_c, weights);
-    clQueues->at(clDeviceID)[0].enqueueReadBuffer(output_d, CL_TRUE, 0, output.size() * sizeof(dataType), reinterpret_cast< void * >(output.data()));
+    if ( nrFlaggedStations > 0 ) {
+      kernel->setArg(3, activeStations_d);
+      kernel->setArg(4, static_cast< unsigned int >(activeStations.size()));
+    } else if ( generic ) {
+      RadioAstronomy::setBeamFormerGenericArguments(*kernel, observation, outputMode, nrSamplesPerIntegration);
+    }
+    if ( incoherent ) {
+      // The incoherent output is the last argument
+      kernel->setArg(3 + ((nrFlaggedStations > 0) ? 2 : 0) + (generic ? 7 : 0), incoherent_d);
+    }
+    clQueues.at(clDeviceID)[0].enqueueNDRangeKernel(*kernel, cl::NullRange, global, local);
+    RadioAstronomy::beamFormer< inputDataType, dataType >(observation, samples, output_c, weights, activeStations, outputMode, nrSamplesPerIntegration);
+    if ( incoherent ) {
+      RadioAstronomy::beamFormerIncoherent< inputDataType, dataType >(observation, samples, incoherentOutput_c, activeStations, outputMode, nrSamplesPerIntegration);
+      clQueues.at(clDeviceID)[0].enqueueReadBuffer(incoherent_d, CL_TRUE, 0, incoherentOutput.size() * sizeof(dataType), reinterpret_cast< void * >(incoherentOutput.data()));
+    }
+    clQueues.at(clDeviceID)[0].enqueueReadBuffer(output_d, CL_TRUE, 0, output.size() * sizeof(dataType), reinterpret_cast< void * >(output.data()));
   } catch ( cl::Error &err ) {
     std::cerr << "OpenCL error kernel execution: " << isa::utils::toString< cl_int >(err.err()) << "." << std::endl;
     return 1;
   }
 
+  // The output of the single device is replaced by the one of the channels partitioned over the devices, and checked against the same control
+  if ( nrChannelsPerChunk > 0 ) {
+    std::vector< cl::Device > devices;
+    std::vector< RadioAstronomy::BeamFormerWorker< inputDataType, dataType > * > workers;
+
+    if ( allDevices ) {
+      devices = clDevices;
+    } else {
+      devices.push_back(clDevices.at(clDeviceID));
+    }
+    std::fill(output.begin(), output.end(), 0);
+    try {
+      for ( unsigned int device = 0; device < devices.size(); device++ ) {
+        std::vector< cl::Device > subDevices;
+
+        if ( splitDevices ) {
+          RadioAstronomy::getNUMASubDevices(devices[device], subDevices);
+        } else {
+          subDevices.push_back(devices[device]);
+        }
+        for ( unsigned int subDevice = 0; subDevice < subDevices.size(); subDevice++ ) {
+          // Sub-devices are not part of the context of the platform
+          cl::Context workerContext(std::vector< cl::Device >(1, subDevices[subDevice]));
+
+          workers.push_back(new RadioAstronomy::BeamFormerWorkerOpenCL< inputDataType, dataType >(observation, conf, outputMode, nrSamplesPerIntegration, outputLayout, inputTypeName, typeName, workerContext, subDevices[subDevice], cacheDirectory));
+        }
+      }
+      RadioAstronomy::BeamFormerMultiDevice< inputDataType, dataType > multiDevice(observation, weights, workers, nrChannelsPerChunk, outputMode, nrSamplesPerIntegration, outputLayout);
+
+      multiDevice.beamForm(samples, output);
+      std::cout << "Workers: " << multiDevice.getNrWorkers() << ", stolen chunks: " << multiDevice.getScheduler().getNrStolenChunks() << "." << std::endl;
+    } catch ( cl::Error & err ) {
+      std::cerr << "OpenCL error multi-device execution: " << isa::utils::toString< cl_int >(err.err()) << "." << std::endl;
+      return 1;
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+  }
+
   for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
     for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
-      for ( unsigned int sample = 0; sample < observation.getNrSamplesPerSecond(); sample++ ) {
-        for ( unsigned int item = 0; item < 4; item++ ) {
-          if ( !isa::utils::same(output[(beam * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4) + (channel * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4) + item], output_c[(beam * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4) + (channel * observation.getNrSamplesPerPaddedSecond() * 4) + (sample * 4) + item]) ) {
+      for ( unsigned int sample = 0; sample < RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration); sample++ ) {
+        for ( unsigned int item = 0; item < nrOutputValues; item++ ) {
+          const dataType value = output[RadioAstronomy::getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, beam, channel, sample) + item];
+          const dataType control = output_c[(beam * observation.getNrChannels() * nrOutputSamples * nrOutputValues) + (channel * nrOutputSamples * nrOutputValues) + (sample * nrOutputValues) + item];
+
+          if ( generateWeights ) {
+            // The device computes the weights in single precision from phases reduced on the host
+            if ( std::abs(value - control) > (1.0e-5 * (std::abs(control) + 1.0f)) ) {
+              wrongSamples++;
+            }
+          } else if ( !isa::utils::same(value, control) ) {
             wrongSamples++;
           }
         }
@@ -151,8 +452,21 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if ( incoherent ) {
+    for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+      for ( unsigned int sample = 0; sample < RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration); sample++ ) {
+        const dataType value = incoherentOutput[(channel * nrOutputSamples) + sample];
+        const dataType control = incoherentOutput_c[(channel * nrOutputSamples) + sample];
+
+        // The device averages in a different order than the host
+        if ( std::abs(value - control) > (1.0e-5 * (std::abs(control) + 1.0f)) ) {
+          wrongSamples++;
+        }
+      }
+    }
+  }
   if ( wrongSamples > 0 ) {
-    std::cout << "Wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< long long unsigned int >(observation.getNrBeams()) *observation.getNrChannels() * observation.getNrSamplesPerSecond() * 4) << "%)." << std::endl;
+    std::cout << "Wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration) * nrOutputValues) << "%)." << std::endl;
   } else {
     std::cout << "TEST PASSED." << std::endl;
   }
@@ -0,0 +1,314 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <ctime>
+
+#include <ArgumentList.hpp>
+#include <Observation.hpp>
+#include <utils.hpp>
+#include <BeamFormer.hpp>
+#include <BeamFormerSIMD.hpp>
+#include <BeamFormerGEMM.hpp>
+#include <BeamFormerUnrolled.hpp>
+#include <BeamFormerMultiDevice.hpp>
+
+#if defined(BEAM_FORMER_INPUT_CHAR)
+typedef char inputDataType;
+#elif defined(BEAM_FORMER_INPUT_SHORT)
+typedef short inputDataType;
+#else
+typedef float inputDataType;
+#endif
+typedef float dataType;
+
+
+int main(int argc, char *argv[]) {
+  bool random = false;
+  bool incoherent = false;
+  unsigned int nrSamplesPerIntegration = 1;
+  unsigned int nrSamplesPerTile = 0;
+  unsigned int nrBeamsPerTile = 0;
+  unsigned int nrStationsPerTile = 0;
+  unsigned int nrStationsPerThread = 0;
+  unsigned int nrChannelsPerChunk = 0;
+  unsigned int nrWorkers = 0;
+  long long unsigned int wrongSamples = 0;
+  RadioAstronomy::OutputMode outputMode = RadioAstronomy::OUTPUT_VOLTAGES;
+  RadioAstronomy::OutputLayout outputLayout = RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE;
+  AstroData::Observation observation;
+
+  try {
+    isa::utils::ArgumentList args(argc, argv);
+    random = args.getSwitch("-random");
+    incoherent = args.getSwitch("-incoherent");
+    if ( args.getSwitch("-stokes_i") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_I;
+    } else if ( args.getSwitch("-stokes_iquv") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_IQUV;
+    }
+    if ( outputMode != RadioAstronomy::OUTPUT_VOLTAGES ) {
+      nrSamplesPerIntegration = args.getSwitchArgument< unsigned int >("-integration");
+    }
+    if ( args.getSwitch("-channel_beam_sample") ) {
+      outputLayout = RadioAstronomy::LAYOUT_CHANNEL_BEAM_SAMPLE;
+    } else if ( args.getSwitch("-beam_sample_channel") ) {
+      outputLayout = RadioAstronomy::LAYOUT_BEAM_SAMPLE_CHANNEL;
+    }
+    observation.setPadding(args.getSwitchArgument< unsigned int >("-padding"));
+    nrSamplesPerTile = args.getSwitchArgument< unsigned int >("-tile_samples");
+    nrBeamsPerTile = args.getSwitchArgument< unsigned int >("-tile_beams");
+    nrStationsPerTile = args.getSwitchArgument< unsigned int >("-tile_stations");
+    try {
+      nrStationsPerThread = args.getSwitchArgument< unsigned int >("-thread_stations");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The engine splitting the stations over the threads is only tested on request
+    }
+    try {
+      nrChannelsPerChunk = args.getSwitchArgument< unsigned int >("-chunk_channels");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The multi-device scheduler is only tested on request
+    }
+    try {
+      nrWorkers = args.getSwitchArgument< unsigned int >("-workers");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // One worker per NUMA node by default
+    }
+    observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
+    observation.setNrStations(args.getSwitchArgument< unsigned int >("-stations"));
+    observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    observation.setNrSamplesPerSecond(args.getSwitchArgument< unsigned int >("-samples"));
+  } catch  ( isa::utils::SwitchNotFound &err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  } catch ( std::exception &err ) {
+    std::cerr << "Usage: " << argv[0] << " [-random] [-incoherent] [-stokes_i | -stokes_iquv -integration ...] [-channel_beam_sample | -beam_sample_channel] -padding ... -tile_samples ... -tile_beams ... -tile_stations ... [-thread_stations ...] [-chunk_channels ... [-workers ...]] -beams ... -stations ... -samples ... -channels ..." << std::endl;
+    return 1;
+  }
+
+  if ( !RadioAstronomy::isIntegrationValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    std::cerr << "The integration of " << nrSamplesPerIntegration << " samples does not divide the " << observation.getNrSamplesPerSecond() << " samples of a second." << std::endl;
+    return 1;
+  }
+
+  // Allocate host memory
+  std::vector< inputDataType > samples = std::vector< inputDataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4);
+  const unsigned int nrOutputValues = RadioAstronomy::getNrOutputValues(outputMode);
+  const unsigned int nrOutputSamples = RadioAstronomy::getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration);
+  std::vector< dataType > output = std::vector< dataType >(RadioAstronomy::getOutputSize(observation, outputMode, nrSamplesPerIntegration, outputLayout));
+  std::vector< dataType > output_c = std::vector< dataType >(observation.getNrBeams() * observation.getNrChannels() * nrOutputSamples * nrOutputValues);
+  std::vector< float > weights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
+  if ( random ) {
+    std::srand(time(0));
+  } else {
+    std::srand(42);
+  }
+  // Every item is different, so that indexing errors in the tiled code cannot go unnoticed; samples fit in any input type
+  for ( unsigned int item = 0; item < weights.size(); item++ ) {
+    weights[item] = std::rand() % 100;
+  }
+  for ( unsigned int item = 0; item < samples.size(); item++ ) {
+    samples[item] = std::rand() % 100;
+  }
+
+  // Run the sequential control, in the default layout, then every CPU engine
+  RadioAstronomy::beamFormer< inputDataType, dataType >(observation, samples, output_c, weights, outputMode, nrSamplesPerIntegration);
+  std::vector< dataType > incoherentOutput;
+  std::vector< dataType > incoherentOutput_c;
+  if ( incoherent ) {
+    std::vector< unsigned int > activeStations(observation.getNrStations());
+
+    for ( unsigned int station = 0; station < observation.getNrStations(); station++ ) {
+      activeStations[station] = station;
+    }
+    incoherentOutput.resize(RadioAstronomy::getIncoherentOutputSize(observation, outputMode, nrSamplesPerIntegration));
+    incoherentOutput_c.resize(incoherentOutput.size());
+    RadioAstronomy::beamFormerIncoherent< inputDataType, dataType >(observation, samples, incoherentOutput_c, activeStations, outputMode, nrSamplesPerIntegration);
+  }
+  // Every engine is identified by its name and the option (instruction set, backend or instantiation) it runs with
+  std::vector< std::string > engines;
+  std::vector< unsigned int > engineOptions;
+  engines.push_back("parallel");
+  engineOptions.push_back(0);
+  if ( incoherent ) {
+    engines.push_back("incoherent");
+    engineOptions.push_back(0);
+  }
+  if ( nrStationsPerThread > 0 ) {
+    engines.push_back("stations");
+    engineOptions.push_back(nrStationsPerThread);
+  }
+  for ( unsigned int instructionSet = RadioAstronomy::SIMD_SCALAR; instructionSet <= RadioAstronomy::getSIMDInstructionSet(); instructionSet++ ) {
+    engines.push_back("SIMD");
+    engineOptions.push_back(instructionSet);
+  }
+  for ( unsigned int backend = RadioAstronomy::GEMM_INTERNAL; backend <= RadioAstronomy::getGEMMBackend< inputDataType, dataType >(outputMode, outputLayout); backend++ ) {
+    engines.push_back("GEMM");
+    engineOptions.push_back(backend);
+  }
+  std::vector< RadioAstronomy::BeamFormerUnrolledKernel< inputDataType, dataType > > unrolledKernels;
+  RadioAstronomy::getBeamFormerUnrolledKernels< inputDataType, dataType >(observation, unrolledKernels);
+  for ( unsigned int kernel = 0; kernel < unrolledKernels.size(); kernel++ ) {
+    engines.push_back("unrolled");
+    engineOptions.push_back(kernel);
+  }
+  if ( nrChannelsPerChunk > 0 ) {
+    engines.push_back("multi-device");
+    engineOptions.push_back(nrWorkers);
+  }
+  for ( unsigned int engine = 0; engine < engines.size(); engine++ ) {
+    std::string engineName = engines[engine];
+
+    wrongSamples = 0;
+    std::fill(output.begin(), output.end(), 0);
+    if ( engineName == "parallel" ) {
+      RadioAstronomy::beamFormerParallel< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout);
+    } else if ( engineName == "incoherent" ) {
+      // The incoherent beam is computed in the same pass as the beams, and checked with them
+      std::fill(incoherentOutput.begin(), incoherentOutput.end(), 0);
+      RadioAstronomy::beamFormerTiled< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, RadioAstronomy::beamFormerTile< inputDataType, dataType >, &incoherentOutput);
+      for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+        for ( unsigned int sample = 0; sample < RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration); sample++ ) {
+          if ( !isa::utils::same(incoherentOutput[(channel * nrOutputSamples) + sample], incoherentOutput_c[(channel * nrOutputSamples) + sample]) ) {
+            wrongSamples++;
+          }
+        }
+      }
+    } else if ( engineName == "stations" ) {
+      RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, engineOptions[engine], outputMode, nrSamplesPerIntegration, outputLayout);
+    } else if ( engineName == "SIMD" ) {
+      engineName += " " + RadioAstronomy::getSIMDInstructionSetName(static_cast< RadioAstronomy::SIMDInstructionSet >(engineOptions[engine]));
+      RadioAstronomy::beamFormerSIMD< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, static_cast< RadioAstronomy::SIMDInstructionSet >(engineOptions[engine]));
+    } else if ( engineName == "GEMM" ) {
+      engineName += " " + RadioAstronomy::getGEMMBackendName(static_cast< RadioAstronomy::GEMMBackend >(engineOptions[engine]));
+      RadioAstronomy::beamFormerGEMM< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, static_cast< RadioAstronomy::GEMMBackend >(engineOptions[engine]));
+    } else if ( engineName == "unrolled" ) {
+      engineName += " " + unrolledKernels[engineOptions[engine]].print();
+      RadioAstronomy::beamFormerTiled< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, unrolledKernels[engineOptions[engine]].tileFunction);
+    } else if ( engineName == "multi-device" ) {
+      std::vector< std::vector< unsigned int > > nodes;
+      std::vector< RadioAstronomy::BeamFormerWorker< inputDataType, dataType > * > workers;
+
+      RadioAstronomy::getNUMANodes(nodes);
+      if ( engineOptions[engine] > 0 ) {
+        // The cores are dealt to more workers than nodes, so that balancing and stealing are tested on any machine
+        std::vector< std::vector< unsigned int > > groups(engineOptions[engine]);
+        unsigned int group = 0;
+
+        for ( unsigned int node = 0; node < nodes.size(); node++ ) {
+          for ( unsigned int cpu = 0; cpu < nodes[node].size(); cpu++ ) {
+            groups[group].push_back(nodes[node][cpu]);
+            group = (group + 1) % groups.size();
+          }
+        }
+        nodes.swap(groups);
+      }
+      for ( unsigned int node = 0; node < nodes.size(); node++ ) {
+        workers.push_back(new RadioAstronomy::BeamFormerWorkerCPU< inputDataType, dataType >("CPU " + isa::utils::toString(node), nodes[node], observation, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout));
+      }
+      RadioAstronomy::BeamFormerMultiDevice< inputDataType, dataType > multiDevice(observation, weights, workers, nrChannelsPerChunk, outputMode, nrSamplesPerIntegration, outputLayout);
+      RadioAstronomy::AlignedBuffer< inputDataType > * placedSamples = multiDevice.allocateSamples();
+
+      // The first second partitions the channels evenly, the following ones by throughput
+      std::copy(samples.begin(), samples.end(), placedSamples->data());
+      for ( unsigned int second = 0; second < 3; second++ ) {
+        std::fill(output.begin(), output.end(), 0);
+        multiDevice.beamForm(placedSamples->data(), output);
+      }
+      engineName += " " + isa::utils::toString(multiDevice.getNrWorkers()) + " workers, " + isa::utils::toString(multiDevice.getScheduler().getNrStolenChunks()) + " stolen chunks";
+      delete placedSamples;
+    }
+
+    for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+      for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+        for ( unsigned int sample = 0; sample < RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration); sample++ ) {
+          for ( unsigned int item = 0; item < nrOutputValues; item++ ) {
+            if ( !isa::utils::same(output[RadioAstronomy::getOutputIndex(observation, outputMode, nrSamplesPerIntegration, outputLayout, beam, channel, sample) + item], output_c[(beam * observation.getNrChannels() * nrOutputSamples * nrOutputValues) + (channel * nrOutputSamples * nrOutputValues) + (sample * nrOutputValues) + item]) ) {
+              wrongSamples++;
+            }
+          }
+        }
+      }
+    }
+
+    if ( wrongSamples > 0 ) {
+      std::cout << engineName << ": wrong samples: " << wrongSamples << " (" << (wrongSamples * 100.0) / (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration) * nrOutputValues) << "%)." << std::endl;
+    } else {
+      std::cout << engineName << ": TEST PASSED." << std::endl;
+    }
+  }
+
+  // A second that is not made of whole integrations is rejected, instead of storing its partial integration past the output
+  AstroData::Observation partialObservation = observation;
+  const unsigned int nrPartialSamplesPerIntegration = 2;
+  unsigned int nrAccepted = 0;
+
+  partialObservation.setNrSamplesPerSecond((observation.getNrSamplesPerSecond() * nrPartialSamplesPerIntegration) + 1);
+  std::vector< inputDataType > partialSamples = std::vector< inputDataType >(partialObservation.getNrChannels() * partialObservation.getNrStations() * partialObservation.getNrSamplesPerPaddedSecond() * 4);
+  std::vector< dataType > partialOutput = std::vector< dataType >(RadioAstronomy::getOutputSize(partialObservation, RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE));
+  std::vector< dataType > partialIncoherentOutput = std::vector< dataType >(RadioAstronomy::getIncoherentOutputSize(partialObservation, RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration));
+  std::vector< unsigned int > partialActiveStations(partialObservation.getNrStations());
+  if ( RadioAstronomy::BeamFormerConf().isValid(partialObservation, RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration) ) {
+    nrAccepted++;
+  }
+  for ( unsigned int station = 0; station < partialObservation.getNrStations(); station++ ) {
+    partialActiveStations[station] = station;
+  }
+  try {
+    RadioAstronomy::beamFormer< inputDataType, dataType >(partialObservation, partialSamples, partialOutput, weights, RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration);
+    nrAccepted++;
+  } catch ( std::invalid_argument & err ) {
+    // Rejected
+  }
+  try {
+    RadioAstronomy::beamFormerParallel< inputDataType, dataType >(partialObservation, partialSamples, partialOutput, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration);
+    nrAccepted++;
+  } catch ( std::invalid_argument & err ) {
+    // Rejected
+  }
+  try {
+    RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(partialObservation, partialSamples, partialOutput, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, partialObservation.getNrStations(), RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration);
+    nrAccepted++;
+  } catch ( std::invalid_argument & err ) {
+    // Rejected
+  }
+  try {
+    RadioAstronomy::beamFormerIncoherent< inputDataType, dataType >(partialObservation, partialSamples, partialIncoherentOutput, partialActiveStations, RadioAstronomy::OUTPUT_STOKES_I, nrPartialSamplesPerIntegration);
+    nrAccepted++;
+  } catch ( std::invalid_argument & err ) {
+    // Rejected
+  }
+  if ( nrAccepted > 0 ) {
+    std::cout << "partial integration: accepted by " << nrAccepted << " engines." << std::endl;
+  } else {
+    std::cout << "partial integration: TEST PASSED." << std::endl;
+  }
+
+  // A backend that cannot compute the test is rejected, instead of running the internal one in its place
+  if ( RadioAstronomy::getGEMMBackend< inputDataType, dataType >(outputMode, outputLayout) == RadioAstronomy::GEMM_INTERNAL ) {
+    try {
+      RadioAstronomy::beamFormerGEMM< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, outputLayout, RadioAstronomy::GEMM_BLAS);
+      std::cout << "GEMM BLAS: accepted." << std::endl;
+    } catch ( std::invalid_argument & err ) {
+      std::cout << "GEMM BLAS: TEST PASSED." << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+#include <ctime>
+
+#include <ArgumentList.hpp>
+#include <Observation.hpp>
+#include <InitializeOpenCL.hpp>
+#include <Kernel.hpp>
+#include <utils.hpp>
+#include <BeamFormer.hpp>
+#include <BeamFormerStream.hpp>
+#include <BeamFormerStreamOpenCL.hpp>
+#include <StationData.hpp>
+
+typedef float inputDataType;
+std::string inputTypeName("float");
+typedef float dataType;
+std::string typeName("float");
+
+
+long long unsigned int compare(const AstroData::Observation & observation, const RadioAstronomy::OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::vector< dataType > & output, const std::vector< dataType > & output_c);
+// Streams nrSeconds of random samples, or of the samples in input without copying them, switching the weights every quarter of the stream, and checks every second against the sequential beam former
+template< typename S > long long unsigned int testStream(S & stream, const AstroData::Observation & observation, const RadioAstronomy::OutputMode outputMode, const unsigned int nrSamplesPerIntegration, unsigned int nrSeconds, std::vector< float > & weights, std::vector< float > & newWeights, RadioAstronomy::StationDataFile< inputDataType > * input);
+
+int main(int argc, char *argv[]) {
+  bool random = false;
+  bool openCL = false;
+  unsigned int nrSeconds = 0;
+  unsigned int nrBuffers = 0;
+  unsigned int nrSamplesPerIntegration = 1;
+  unsigned int nrSamplesPerTile = 0;
+  unsigned int nrBeamsPerTile = 0;
+  unsigned int nrStationsPerTile = 0;
+	unsigned int clPlatformID = 0;
+	unsigned int clDeviceID = 0;
+  std::string inputFilename;
+  RadioAstronomy::BeamFormerConf conf;
+  RadioAstronomy::OutputMode outputMode = RadioAstronomy::OUTPUT_VOLTAGES;
+  AstroData::Observation observation;
+
+  try {
+    isa::utils::ArgumentList args(argc, argv);
+    random = args.getSwitch("-random");
+    if ( args.getSwitch("-stokes_i") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_I;
+    } else if ( args.getSwitch("-stokes_iquv") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_IQUV;
+    }
+    if ( outputMode != RadioAstronomy::OUTPUT_VOLTAGES ) {
+      nrSamplesPerIntegration = args.getSwitchArgument< unsigned int >("-integration");
+    }
+    nrSeconds = args.getSwitchArgument< unsigned int >("-seconds");
+    nrBuffers = args.getSwitchArgument< unsigned int >("-buffers");
+    try {
+      inputFilename = args.getSwitchArgument< std::string >("-input");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // Without recorded station data the samples are random
+    }
+    observation.setPadding(args.getSwitchArgument< unsigned int >("-padding"));
+    nrSamplesPerTile = args.getSwitchArgument< unsigned int >("-tile_samples");
+    nrBeamsPerTile = args.getSwitchArgument< unsigned int >("-tile_beams");
+    nrStationsPerTile = args.getSwitchArgument< unsigned int >("-tile_stations");
+    openCL = args.getSwitch("-opencl");
+    if ( openCL ) {
+      clPlatformID = args.getSwitchArgument< unsigned int >("-opencl_platform");
+      clDeviceID = args.getSwitchArgument< unsigned int >("-opencl_device");
+      conf.setLocalMem(args.getSwitch("-local"));
+      conf.setNrSamplesPerBlock(args.getSwitchArgument< unsigned int >("-sb"));
+      conf.setNrBeamsPerBlock(args.getSwitchArgument< unsigned int >("-bb"));
+      conf.setNrSamplesPerThread(args.getSwitchArgument< unsigned int >("-st"));
+      conf.setNrBeamsPerThread(args.getSwitchArgument< unsigned int >("-bt"));
+    }
+    observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
+    observation.setNrStations(args.getSwitchArgument< unsigned int >("-stations"));
+    observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    observation.setNrSamplesPerSecond(args.getSwitchArgument< unsigned int >("-samples"));
+  } catch  ( isa::utils::SwitchNotFound &err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  } catch ( std::exception &err ) {
+    std::cerr << "Usage: " << argv[0] << " [-random] [-stokes_i | -stokes_iquv -integration ...] -seconds ... -buffers ... [-input ...] -padding ... -tile_samples ... -tile_beams ... -tile_stations ... [-opencl -opencl_platform ... -opencl_device ... [-local] -sb ... -bb ... -st ... -bt ...] -beams ... -stations ... -samples ... -channels ..." << std::endl;
+    return 1;
+  }
+
+  if ( !RadioAstronomy::isIntegrationValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    std::cerr << "The integration of " << nrSamplesPerIntegration << " samples does not divide the " << observation.getNrSamplesPerSecond() << " samples of a second." << std::endl;
+    return 1;
+  }
+
+  // Allocate host memory
+  std::vector< float > weights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
+  std::vector< float > newWeights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
+  if ( random ) {
+    std::srand(time(0));
+  } else {
+    std::srand(42);
+  }
+  for ( unsigned int item = 0; item < weights.size(); item++ ) {
+    weights[item] = std::rand() % 100;
+    newWeights[item] = std::rand() % 100;
+  }
+
+  RadioAstronomy::StationDataFile< inputDataType > * input = 0;
+  if ( !inputFilename.empty() ) {
+    try {
+      input = new RadioAstronomy::StationDataFile< inputDataType >(inputFilename, observation, nrBuffers);
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // CPU stream
+  {
+    RadioAstronomy::BeamFormerStreamCPU< inputDataType, dataType > stream(observation, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, outputMode, nrSamplesPerIntegration, RadioAstronomy::beamFormerTile< inputDataType, dataType >, nrBuffers);
+    long long unsigned int wrongSamples = testStream(stream, observation, outputMode, nrSamplesPerIntegration, nrSeconds, weights, newWeights, input);
+
+    if ( wrongSamples > 0 ) {
+      std::cout << "CPU stream: wrong samples: " << wrongSamples << "." << std::endl;
+    } else {
+      std::cout << "CPU stream: TEST PASSED." << std::endl;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "CPU stream: real-time factor " << stream.getStatistics().getRealTimeFactor() << ", " << stream.getStatistics().getThroughput() << " GB/s." << std::endl;
+  }
+
+  // OpenCL stream
+  if ( openCL ) {
+    cl::Context clContext;
+    std::vector< cl::Platform > clPlatforms;
+    std::vector< cl::Device > clDevices;
+    std::vector< std::vector< cl::CommandQueue > > clQueues;
+
+    isa::OpenCL::initializeOpenCL(clPlatformID, 1, &clPlatforms, &clContext, &clDevices, &clQueues);
+    try {
+      RadioAstronomy::BeamFormerStreamOpenCL< inputDataType, dataType > stream(observation, weights, conf, outputMode, nrSamplesPerIntegration, inputTypeName, typeName, clContext, clDevices.at(clDeviceID), std::string(), nrBuffers);
+      long long unsigned int wrongSamples = testStream(stream, observation, outputMode, nrSamplesPerIntegration, nrSeconds, weights, newWeights, input);
+
+      if ( wrongSamples > 0 ) {
+        std::cout << "OpenCL stream: wrong samples: " << wrongSamples << "." << std::endl;
+      } else {
+        std::cout << "OpenCL stream: TEST PASSED." << std::endl;
+      }
+      std::cout << std::fixed << std::setprecision(3);
+      std::cout << "OpenCL stream: real-time factor " << stream.getStatistics().getRealTimeFactor() << ", " << stream.getStatistics().getThroughput() << " GB/s." << std::endl;
+    } catch ( isa::OpenCL::OpenCLError & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    } catch ( cl::Error & err ) {
+      std::cerr << "OpenCL error: " << isa::utils::toString(err.err()) << "." << std::endl;
+      return 1;
+    }
+  }
+
+  delete input;
+
+  return 0;
+}
+
+long long unsigned int compare(const AstroData::Observation & observation, const RadioAstronomy::OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const std::vector< dataType > & output, const std::vector< dataType > & output_c) {
+  const unsigned int nrOutputValues = RadioAstronomy::getNrOutputValues(outputMode);
+  const unsigned int nrOutputSamples = RadioAstronomy::getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration);
+  long long unsigned int wrongSamples = 0;
+
+  for ( unsigned int beam = 0; beam < observation.getNrBeams(); beam++ ) {
+    for ( unsigned int channel = 0; channel < observation.getNrChannels(); channel++ ) {
+      for ( unsigned int sample = 0; sample < RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration); sample++ ) {
+        for ( unsigned int item = 0; item < nrOutputValues; item++ ) {
+          if ( !isa::utils::same(output[(beam * observation.getNrChannels() * nrOutputSamples * nrOutputValues) + (channel * nrOutputSamples * nrOutputValues) + (sample * nrOutputValues) + item], output_c[(beam * observation.getNrChannels() * nrOutputSamples * nrOutputValues) + (channel * nrOutputSamples * nrOutputValues) + (sample * nrOutputValues) + item]) ) {
+            wrongSamples++;
+          }
+        }
+      }
+    }
+  }
+  return wrongSamples;
+}
+
+template< typename S > long long unsigned int testStream(S & stream, const AstroData::Observation & observation, const RadioAstronomy::OutputMode outputMode, const unsigned int nrSamplesPerIntegration, unsigned int nrSeconds, std::vector< float > & weights, std::vector< float > & newWeights, RadioAstronomy::StationDataFile< inputDataType > * input) {
+  long long unsigned int wrongSamples = 0;
+  std::vector< dataType > output;
+  if ( input != 0 ) {
+    nrSeconds = std::min(nrSeconds, input->getNrSeconds());
+  }
+  // Input and control output are generated in advance, so that the stream statistics only measure the stream
+  std::vector< std::vector< inputDataType > > samples(nrSeconds, std::vector< inputDataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4));
+  std::vector< std::vector< dataType > > controls(nrSeconds, std::vector< dataType >(observation.getNrBeams() * observation.getNrChannels() * RadioAstronomy::getNrOutputSamplesPerPaddedSecond(observation, outputMode, nrSamplesPerIntegration) * RadioAstronomy::getNrOutputValues(outputMode)));
+
+  for ( unsigned int second = 0; second < nrSeconds; second++ ) {
+    if ( input != 0 ) {
+      // The control needs its own copy
+      const inputDataType * secondSamples = input->getSecond(second);
+
+      std::copy(secondSamples, secondSamples + samples[second].size(), samples[second].begin());
+    } else {
+      for ( unsigned int item = 0; item < samples[second].size(); item++ ) {
+        samples[second][item] = std::rand() % 100;
+      }
+    }
+    RadioAstronomy::beamFormer< inputDataType, dataType >(observation, samples[second], controls[second], ((((second * 4) / nrSeconds) % 2) == 0) ? weights : newWeights, outputMode, nrSamplesPerIntegration);
+  }
+
+  unsigned int nrPopped = 0;
+  for ( unsigned int second = 0; second < nrSeconds; second++ ) {
+    // Several versions of the weights are in flight at the same time
+    if ( (second > 0) && (((second * 4) / nrSeconds) != (((second - 1) * 4) / nrSeconds)) ) {
+      stream.setWeights(((((second * 4) / nrSeconds) % 2) == 0) ? weights : newWeights);
+    }
+    bool popped = false;
+
+    if ( input != 0 ) {
+      popped = stream.push(input->getSecond(second), output);
+    } else {
+      popped = stream.push(samples[second], output);
+    }
+    if ( popped ) {
+      wrongSamples += compare(observation, outputMode, nrSamplesPerIntegration, output, controls[nrPopped]);
+      if ( input != 0 ) {
+        input->release(nrPopped);
+      }
+      nrPopped++;
+    }
+  }
+  while ( stream.pop(output) ) {
+    wrongSamples += compare(observation, outputMode, nrSamplesPerIntegration, output, controls[nrPopped]);
+    if ( input != 0 ) {
+      input->release(nrPopped);
+    }
+    nrPopped++;
+  }
+  return wrongSamples;
+}
@@ -21,22 +21,53 @@
 #include <limits>
 #include <ctime>
 #include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <memory>
+#include <random>
 
 #include <ArgumentList.hpp>
 #include <Observation.hpp>
 #include <InitializeOpenCL.hpp>
 #include <Kernel.hpp>
 #include <BeamFormer.hpp>
+#include <BeamFormerDatabase.hpp>
+#include <KernelCache.hpp>
+#include <HostDeviceBuffer.hpp>
+#include <Profiler.hpp>
+#include <ProfilerOpenCL.hpp>
 #include <utils.hpp>
 #include <Timer.hpp>
 #include <Stats.hpp>
 
+#if defined(BEAM_FORMER_INPUT_CHAR)
+typedef char inputDataType;
+std::string inputTypeName("char");
+#elif defined(BEAM_FORMER_INPUT_SHORT)
+typedef short inputDataType;
+std::string inputTypeName("short");
+#else
+typedef float inputDataType;
+std::string inputTypeName("float");
+#endif
 typedef float dataType;
 std::string typeName("float");
 
+// The exhaustive search tries every configuration in order, the others stop when the time budget is over
+enum SearchStrategy { SEARCH_EXHAUSTIVE = 0, SEARCH_RANDOM, SEARCH_HILL_CLIMBING, SEARCH_ANNEALING };
+
+double gflops(const RadioAstronomy::OutputMode outputMode, const AstroData::Observation & observation);
+// Configurations that differ from the current one in exactly one parameter
+std::vector< unsigned int > getNeighbours(const std::vector< RadioAstronomy::BeamFormerConf > & configurations, const unsigned int current);
+// Result of tune for a configuration that fails to compile or run
+const double TUNE_FAILED = -1.0;
+// Returns the GFLOP/s of the configuration, zero if it is slower than pruneTime after any iteration, or TUNE_FAILED; with profiler, the runs are recorded
+double tune(const RadioAstronomy::BeamFormerConf & conf, const unsigned int nrIterations, const double pruneTime, const RadioAstronomy::OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const RadioAstronomy::OutputLayout outputLayout, const bool generateWeights, const AstroData::Observation & observation, const std::string & cacheDirectory, cl::Context & clContext, cl::Device & clDevice, cl::CommandQueue & clQueue, cl::Buffer & samples_d, cl::Buffer & output_d, cl::Buffer & weights_d, RadioAstronomy::Profiler * profiler);
 
 int main(int argc, char * argv[]) {
   bool localMem = false;
+  bool generateWeights = false;
+  unsigned int nrSamplesPerIntegration = 1;
 	unsigned int nrIterations = 0;
 	unsigned int clPlatformID = 0;
 	unsigned int clDeviceID = 0;
@@ -47,12 +78,73 @@ int main(int argc, char * argv[]) {
   unsigned int threadUnit = 0;
   unsigned int threadIncrement = 0;
   unsigned int maxItems = 0;
+  unsigned int budget = 0;
+  double pruneMargin = 0.0;
+  double initialTemperature = 0.1;
+  double coolingRate = 0.95;
+  double peakGFLOPs = 0.0;
+  double peakGBs = 0.0;
+  SearchStrategy strategy = SEARCH_EXHAUSTIVE;
+  std::string databaseFilename;
+  std::string cacheDirectory;
+  std::string profileFilename;
+  RadioAstronomy::OutputMode outputMode = RadioAstronomy::OUTPUT_VOLTAGES;
+  RadioAstronomy::OutputLayout outputLayout = RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE;
   AstroData::Observation observation;
+  RadioAstronomy::BeamFormerTuningEntry best;
 
 	try {
     isa::utils::ArgumentList args(argc, argv);
 
     localMem = args.getSwitch("-local");
+    generateWeights = args.getSwitch("-generate_weights");
+    try {
+      databaseFilename = args.getSwitchArgument< std::string >("-database");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The tuning database is optional
+    }
+    try {
+      cacheDirectory = args.getSwitchArgument< std::string >("-kernel_cache");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // Without a cache directory kernels are only cached in memory
+    }
+    try {
+      profileFilename = args.getSwitchArgument< std::string >("-profile");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The records of the kernels and transfers are exported only on request
+    }
+    if ( args.getSwitch("-roofline") ) {
+      peakGFLOPs = args.getSwitchArgument< double >("-peak_gflops");
+      peakGBs = args.getSwitchArgument< double >("-peak_gbs");
+    }
+    if ( args.getSwitch("-random") ) {
+      strategy = SEARCH_RANDOM;
+    } else if ( args.getSwitch("-hill_climbing") ) {
+      strategy = SEARCH_HILL_CLIMBING;
+    } else if ( args.getSwitch("-annealing") ) {
+      strategy = SEARCH_ANNEALING;
+      initialTemperature = args.getSwitchArgument< double >("-temperature");
+      coolingRate = args.getSwitchArgument< double >("-cooling");
+    }
+    if ( strategy != SEARCH_EXHAUSTIVE ) {
+      budget = args.getSwitchArgument< unsigned int >("-budget");
+    }
+    if ( args.getSwitch("-prune") ) {
+      pruneMargin = args.getSwitchArgument< double >("-margin");
+    }
+    if ( args.getSwitch("-stokes_i") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_I;
+    } else if ( args.getSwitch("-stokes_iquv") ) {
+      outputMode = RadioAstronomy::OUTPUT_STOKES_IQUV;
+    }
+    if ( outputMode != RadioAstronomy::OUTPUT_VOLTAGES ) {
+      nrSamplesPerIntegration = args.getSwitchArgument< unsigned int >("-integration");
+    }
+    if ( args.getSwitch("-channel_beam_sample") ) {
+      outputLayout = RadioAstronomy::LAYOUT_CHANNEL_BEAM_SAMPLE;
+    } else if ( args.getSwitch("-beam_sample_channel") ) {
+      outputLayout = RadioAstronomy::LAYOUT_BEAM_SAMPLE_CHANNEL;
+    }
 		nrIterations = args.getSwitchArgument< unsigned int >("-iterations");
 		clPlatformID = args.getSwitchArgument< unsigned int >("-opencl_platform");
 		clDeviceID = args.getSwitchArgument< unsigned int >("-opencl_device");
@@ -66,153 +158,411 @@ int main(int argc, char * argv[]) {
 		maxItems = args.getSwitchArgument< unsigned int >("-max_items");
     observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
     observation.setNrStations(args.getSwitchArgument< unsigned int >("-stations"));
-    observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    if ( generateWeights ) {
+      unsigned int nrChannels = args.getSwitchArgument< unsigned int >("-channels");
+      float minFreq = args.getSwitchArgument< float >("-min_freq");
+
+      observation.setFrequencyRange(nrChannels, minFreq, args.getSwitchArgument< float >("-channel_bandwidth"));
+    } else {
+      observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    }
 		observation.setNrSamplesPerSecond(args.getSwitchArgument< unsigned int >("-samples"));
 	} catch ( isa::utils::EmptyCommandLine & err ) {
-		std::cerr << argv[0] << " -iterations ... [-local] -opencl_platform ... -opencl_device ... -padding ... -thread_unit ... -min_threads ... -max_threads ... -max_items ... -max_columns ... -max_rows ... -thread_increment ... -beams ... -stations ... -samples ... -channels ..." << std::endl;
+		std::cerr << argv[0] << " -iterations ... [-local] [-generate_weights -min_freq ... -channel_bandwidth ...] [-database ...] [-kernel_cache ...] [-profile ... [-roofline -peak_gflops ... -peak_gbs ...]] [-random -budget ... | -hill_climbing -budget ... | -annealing -temperature ... -cooling ... -budget ...] [-prune -margin ...] [-stokes_i | -stokes_iquv -integration ...] [-channel_beam_sample | -beam_sample_channel] -opencl_platform ... -opencl_device ... -padding ... -thread_unit ... -min_threads ... -max_threads ... -max_items ... -max_columns ... -max_rows ... -thread_increment ... -beams ... -stations ... -samples ... -channels ..." << std::endl;
 		return 1;
 	} catch ( std::exception & err ) {
 		std::cerr << err.what() << std::endl;
 		return 1;
 	}
 
+  if ( !RadioAstronomy::isIntegrationValid(observation, outputMode, nrSamplesPerIntegration) ) {
+    std::cerr << "The integration of " << nrSamplesPerIntegration << " samples does not divide the " << observation.getNrSamplesPerSecond() << " samples of a second." << std::endl;
+    return 1;
+  }
+
 	// Initialize OpenCL
-	cl::Context * clContext = new cl::Context();
-	std::vector< cl::Platform > * clPlatforms = new std::vector< cl::Platform >();
-	std::vector< cl::Device > * clDevices = new std::vector< cl::Device >();
-	std::vector< std::vector< cl::CommandQueue > > * clQueues = new std::vector< std::vector < cl::CommandQueue > >();
+	cl::Context clContext;
+	std::vector< cl::Platform > clPlatforms;
+	std::vector< cl::Device > clDevices;
+	std::vector< std::vector< cl::CommandQueue > > clQueues;
 
-  isa::OpenCL::initializeOpenCL(clPlatformID, 1, clPlatforms, clContext, clDevices, clQueues);
+  isa::OpenCL::initializeOpenCL(clPlatformID, 1, &clPlatforms, &clContext, &clDevices, &clQueues);
+  // Kernels and transfers are timed by the device, without the queueing and synchronization of the host
+  cl::CommandQueue clQueue(clContext, clDevices.at(clDeviceID), CL_QUEUE_PROFILING_ENABLE);
+  RadioAstronomy::Profiler profiler(peakGFLOPs, peakGBs);
+  RadioAstronomy::Profiler * profilerPointer = profileFilename.empty() ? 0 : &profiler;
 
-	// Allocate host memory
-  std::vector< dataType > samples = std::vector< dataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4);
-  std::vector< float > weights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
-  std::srand(time(0));
-  std::fill(weights.begin(), weights.end(), std::rand() % 100);
-  std::fill(samples.begin(), samples.end(), std::rand() % 1000);
-
-  // Allocate device memory
-  cl::Buffer samples_d, output_d, weights_d;
+  // Allocate host and device memory, once for all the configurations
+  std::size_t nrWeights = 0;
+  if ( generateWeights ) {
+    // The kernel reads the geometry table instead of the weights
+    nrWeights = observation.getNrStations() * observation.getNrPaddedBeams() * 4;
+  } else {
+    nrWeights = observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2;
+  }
+  // The buffers are released on every return
+  std::unique_ptr< RadioAstronomy::HostDeviceBuffer< inputDataType > > samples;
+  std::unique_ptr< RadioAstronomy::HostDeviceBuffer< dataType > > output;
+  std::unique_ptr< RadioAstronomy::HostDeviceBuffer< float > > weights;
   try {
-    samples_d = cl::Buffer(*clContext, CL_MEM_READ_ONLY, samples.size() * sizeof(dataType), 0, 0);
-    output_d = cl::Buffer(*clContext, CL_MEM_WRITE_ONLY, observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4 * sizeof(dataType), 0, 0);
-    weights_d = cl::Buffer(*clContext, CL_MEM_READ_ONLY, weights.size() * sizeof(float), 0, 0);
+    samples.reset(new RadioAstronomy::HostDeviceBuffer< inputDataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4, CL_MEM_READ_ONLY, clContext, clDevices.at(clDeviceID), clQueue));
+    output.reset(new RadioAstronomy::HostDeviceBuffer< dataType >(RadioAstronomy::getOutputSize(observation, outputMode, nrSamplesPerIntegration, outputLayout), CL_MEM_WRITE_ONLY, clContext, clDevices.at(clDeviceID), clQueue));
+    weights.reset(new RadioAstronomy::HostDeviceBuffer< float >(nrWeights, CL_MEM_READ_ONLY, clContext, clDevices.at(clDeviceID), clQueue));
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error allocating memory: " << isa::utils::toString(err.err()) << "." << std::endl;
     return 1;
   }
+  std::srand(time(0));
+  std::fill(weights->data(), weights->data() + weights->size(), std::rand() % 100);
+  std::fill(samples->data(), samples->data() + samples->size(), std::rand() % 100);
 
   // Copy data structures to device
   try {
-    clQueues->at(clDeviceID)[0].enqueueWriteBuffer(weights_d, CL_FALSE, 0, weights.size() * sizeof(float), reinterpret_cast< void * >(weights.data()));
-    clQueues->at(clDeviceID)[0].enqueueWriteBuffer(samples_d, CL_FALSE, 0, samples.size() * sizeof(dataType), reinterpret_cast< void * >(samples.data()));
+    cl::Event weightsEvent;
+    cl::Event samplesEvent;
+
+    weights->upload(false, &weightsEvent);
+    samples->upload(false, &samplesEvent);
+    clQueue.finish();
+    if ( profilerPointer != 0 ) {
+      RadioAstronomy::recordEvent(profiler, "upload_weights", "", weightsEvent, 0.0, weights->size() * sizeof(float));
+      RadioAstronomy::recordEvent(profiler, "upload_samples", "", samplesEvent, 0.0, samples->size() * sizeof(inputDataType));
+    }
   } catch ( cl::Error & err ) {
     std::cerr << "OpenCL error H2D transfer: " << isa::utils::toString(err.err()) << "." << std::endl;
     return 1;
   }
 
-	// Find the parameters
-	std::vector< unsigned int > samplesPerBlock;
-	for ( unsigned int samples = minThreads; samples <= maxColumns; samples += threadIncrement ) {
-		if ( (observation.getNrSamplesPerPaddedSecond() % samples) == 0 ) {
-			samplesPerBlock.push_back(samples);
-		}
-	}
-	std::vector< unsigned int > beamsPerBlock;
-	for ( unsigned int beams = 1; beams <= maxRows; beams++ ) {
-		if ( (observation.getNrBeams() % beams) == 0 ) {
-			beamsPerBlock.push_back(beams);
-		}
-	}
-
-	std::cout << std::fixed << std::endl;
-	std::cout << "# nrBeams nrStations nrChannels nrSamples local samplesPerBlock beamsPerBlock samplesPerThread beamsPerThread GFLOP/s GB/s time stdDeviation COV" << std::endl << std::endl;
-
-	for ( std::vector< unsigned int >::iterator samples = samplesPerBlock.begin(); samples != samplesPerBlock.end(); ++samples ) {
-		for ( std::vector< unsigned int >::iterator beams = beamsPerBlock.begin(); beams != beamsPerBlock.end(); ++beams ) {
-			if ( ((*samples) * (*beams)) > maxThreads ) {
-				break;
-			} else if ( ((*samples) * (*beams)) % threadUnit != 0 ) {
-        continue;
+  // Find the parameters
+  std::vector< unsigned int > samplesPerBlock;
+  for ( unsigned int samples = minThreads; samples <= maxColumns; samples += threadIncrement ) {
+    if ( (observation.getNrSamplesPerPaddedSecond() % samples) == 0 ) {
+      samplesPerBlock.push_back(samples);
+    }
+  }
+  std::vector< unsigned int > beamsPerBlock;
+  for ( unsigned int beams = 1; beams <= maxRows; beams++ ) {
+    if ( (observation.getNrBeams() % beams) == 0 ) {
+      beamsPerBlock.push_back(beams);
+    }
+  }
+  // More channels per work-group only make the stores of the transposed layout longer
+  std::vector< unsigned int > channelsPerBlock(1, 1);
+  if ( outputLayout == RadioAstronomy::LAYOUT_BEAM_SAMPLE_CHANNEL ) {
+    for ( unsigned int channels = 2; channels <= std::min(observation.getNrChannels(), maxThreads); channels *= 2 ) {
+      if ( (observation.getNrChannels() % channels) == 0 ) {
+        channelsPerBlock.push_back(channels);
       }
+    }
+  }
+  // Zero is the kernel without station groups, the others split the stations over work-items and reduce their partial beams
+  std::vector< unsigned int > stationsPerThread(1, 0);
+  for ( unsigned int stations = observation.getNrStations() / 2; stations > 0; stations-- ) {
+    if ( ((observation.getNrStations() % stations) == 0) && ((observation.getNrStations() / stations) <= maxThreads) ) {
+      stationsPerThread.push_back(stations);
+    }
+  }
+  std::vector< RadioAstronomy::BeamFormerConf > configurations;
+  for ( std::vector< unsigned int >::iterator stations = stationsPerThread.begin(); stations != stationsPerThread.end(); ++stations ) {
+    const unsigned int nrStationGroups = (*stations > 0) ? observation.getNrStations() / *stations : 1;
 
-			for ( unsigned int samplesPerThread = 1; samplesPerThread <= maxItems; samplesPerThread++ ) {
-				if ( (observation.getNrSamplesPerPaddedSecond() % ((*samples) * samplesPerThread)) != 0 ) {
-					continue;
-				}
-
-				for ( unsigned int beamsPerThread = 1; beamsPerThread <= maxItems; beamsPerThread++ ) {
-					if ( (observation.getNrBeams() % ((*beams) * beamsPerThread)) != 0 ) {
-						continue;
-					} else if ( !localMem && (samplesPerThread + (samplesPerThread * beamsPerThread * 4) + 8) > maxItems ) {
-						break;
-					} else if ( localMem && (samplesPerThread + (samplesPerThread * beamsPerThread * 4) + 11) > maxItems ) {
+    for ( std::vector< unsigned int >::iterator channels = channelsPerBlock.begin(); channels != channelsPerBlock.end(); ++channels ) {
+      for ( std::vector< unsigned int >::iterator samples = samplesPerBlock.begin(); samples != samplesPerBlock.end(); ++samples ) {
+        for ( std::vector< unsigned int >::iterator beams = beamsPerBlock.begin(); beams != beamsPerBlock.end(); ++beams ) {
+          if ( ((*samples) * (*beams) * (*channels) * nrStationGroups) > maxThreads ) {
             break;
-          }
-
-          // Generate kernel
-          double gflops = isa::utils::giga((static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerSecond() * observation.getNrStations() * 16) + (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerSecond() * 4));
-          double gbs;
-          if ( localMem ) {
-            gbs = isa::utils::giga((static_cast< long long unsigned int >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations() * (observation.getNrBeams() / (beamsPerThread * *beams)) * 4 * sizeof(dataType)) + (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerSecond() * 4 * sizeof(dataType)) + (observation.getNrChannels() * observation.getNrStations() * observation.getNrBeams() * 2 * sizeof(float)));
-          } else {
-            gbs = isa::utils::giga((static_cast< long long unsigned int >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations() * (observation.getNrBeams() / beamsPerThread) * 4 * sizeof(dataType)) + (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * observation.getNrSamplesPerSecond() * 4 * sizeof(dataType)) + (observation.getNrChannels() * observation.getNrStations() * observation.getNrBeams() * 2 * sizeof(float)));
-          }
-          isa::utils::Timer timer;
-          cl::Event event;
-          cl::Kernel * kernel;
-          std::string * code = RadioAstronomy::getBeamFormerOpenCL(localMem, *samples, *beams, samplesPerThread, beamsPerThread, typeName, observation);
-
-          try {
-            kernel = isa::OpenCL::compile("beamFormer", *code, "-cl-mad-enable -Werror", *clContext, clDevices->at(clDeviceID));
-          } catch ( isa::OpenCL::OpenCLError & err ) {
-            std::cerr << err.what() << std::endl;
+          } else if ( ((*samples) * (*beams) * (*channels) * nrStationGroups) % threadUnit != 0 ) {
             continue;
           }
 
-          cl::NDRange global(observation.getNrSamplesPerPaddedSecond() / samplesPerThread, observation.getNrBeams() / beamsPerThread, observation.getNrChannels());
-          cl::NDRange local(*samples, *beams, 1);
+          for ( unsigned int samplesPerThread = 1; samplesPerThread <= maxItems; samplesPerThread++ ) {
+            for ( unsigned int beamsPerThread = 1; beamsPerThread <= maxItems; beamsPerThread++ ) {
+              if ( !localMem && (samplesPerThread + (samplesPerThread * beamsPerThread * 4) + 8) > maxItems ) {
+                break;
+              } else if ( localMem && (samplesPerThread + (samplesPerThread * beamsPerThread * 4) + 11) > maxItems ) {
+                break;
+              }
+              RadioAstronomy::BeamFormerConf conf;
 
-          kernel->setArg(0, samples_d);
-          kernel->setArg(1, output_d);
-          kernel->setArg(2, weights_d);
-
-          // Warm-up run
-          try {
-            clQueues->at(clDeviceID)[0].enqueueNDRangeKernel(*kernel, cl::NullRange, global, local, 0, &event);
-            event.wait();
-          } catch ( cl::Error & err ) {
-            std::cerr << "OpenCL error kernel execution: " << isa::utils::toString(err.err()) << "." << std::endl;
-            continue;
-          }
-          // Tuning runs
-          try {
-            for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
-              timer.start();
-              clQueues->at(clDeviceID)[0].enqueueNDRangeKernel(*kernel, cl::NullRange, global, local, 0, &event);
-              event.wait();
-              timer.stop();
+              conf.setLocalMem(localMem);
+              conf.setNrSamplesPerBlock(*samples);
+              conf.setNrBeamsPerBlock(*beams);
+              conf.setNrChannelsPerBlock(*channels);
+              conf.setNrSamplesPerThread(samplesPerThread);
+              conf.setNrBeamsPerThread(beamsPerThread);
+              conf.setNrStationsPerThread(*stations);
+              if ( conf.isValid(observation, outputMode, nrSamplesPerIntegration) ) {
+                configurations.push_back(conf);
+              }
             }
-          } catch ( cl::Error & err ) {
-            std::cerr << "OpenCL error kernel execution: " << isa::utils::toString(err.err()) << "." << std::endl;
-            continue;
           }
+        }
+      }
+    }
+  }
 
-          std::cout << observation.getNrBeams() << " " << observation.getNrStations() << " " << observation.getNrChannels() << " " << observation.getNrSamplesPerSecond() << " ";
-          std::cout << localMem << " " << *samples << " " << *beams << " " << samplesPerThread << " " << beamsPerThread << " ";
-          std::cout << std::setprecision(3);
-          std::cout << gflops / timer.getAverageTime() << " ";
-          std::cout << gbs / timer.getAverageTime() << " ";
-          std::cout << std::setprecision(6);
-          std::cout << timer.getAverageTime() << " " << timer.getStandardDeviation() << " ";
-          std::cout << timer.getCoefficientOfVariation() <<  std::endl;
-				}
-			}
-		}
-	}
+  // Weights staged in local memory for blocks of stations, and with local memory double-buffered samples, are tried on top of every configuration
+  for ( unsigned int configuration = configurations.size(); configuration > 0; configuration-- ) {
+    const RadioAstronomy::BeamFormerConf base = configurations[configuration - 1];
+    const unsigned int nrThreadStations = (base.getNrStationsPerThread() > 0) ? base.getNrStationsPerThread() : observation.getNrStations();
+
+    for ( unsigned int doubleBuffer = 0; doubleBuffer <= 1; doubleBuffer++ ) {
+      for ( unsigned int stations = 0; stations <= nrThreadStations; stations = (stations == 0) ? 1 : stations * 2 ) {
+        RadioAstronomy::BeamFormerConf conf = base;
+
+        if ( ((doubleBuffer == 0) && (stations == 0)) || ((stations > 0) && generateWeights) ) {
+          continue;
+        }
+        conf.setDoubleBuffer(doubleBuffer == 1);
+        conf.setNrStationsPerBlock(stations);
+        if ( conf.isValid(observation, outputMode, nrSamplesPerIntegration) ) {
+          configurations.push_back(conf);
+        }
+      }
+    }
+  }
+
+  // Order in which the configurations are tried
+  std::vector< unsigned int > order(configurations.size());
+  for ( unsigned int configuration = 0; configuration < configurations.size(); configuration++ ) {
+    order[configuration] = configuration;
+  }
+  if ( strategy != SEARCH_EXHAUSTIVE ) {
+    std::default_random_engine engine(std::time(0));
+
+    std::shuffle(order.begin(), order.end(), engine);
+  }
+
+  std::cout << std::fixed << std::endl;
+  std::cout << "# nrBeams nrStations nrChannels nrSamples local samplesPerBlock beamsPerBlock samplesPerThread beamsPerThread channelsPerBlock stationsPerThread stationsPerBlock doubleBuffer GFLOP/s GB/s time stdDeviation COV" << std::endl << std::endl;
+
+  // Search; performance is negative for configurations not yet tried, and zero for the ones that failed or were pruned
+  std::vector< double > performance(configurations.size(), -1.0);
+  std::time_t startTime = std::time(0);
+  unsigned int nrTried = 0;
+  unsigned int nrPruned = 0;
+  unsigned int nrFailed = 0;
+  unsigned int current = 0;
+  unsigned int nextStart = 0;
+  double temperature = initialTemperature;
+
+  while ( (nrTried < configurations.size()) && ((budget == 0) || (std::difftime(std::time(0), startTime) < budget)) ) {
+    unsigned int candidate = 0;
+
+    if ( (strategy == SEARCH_EXHAUSTIVE) || (strategy == SEARCH_RANDOM) || (nrTried == 0) ) {
+      candidate = order[nrTried];
+    } else {
+      std::vector< unsigned int > neighbours = getNeighbours(configurations, current);
+      std::vector< unsigned int > untried;
+
+      for ( std::vector< unsigned int >::iterator neighbour = neighbours.begin(); neighbour != neighbours.end(); ++neighbour ) {
+        if ( performance[*neighbour] < 0.0 ) {
+          untried.push_back(*neighbour);
+        }
+      }
+      if ( untried.empty() ) {
+        // Local optimum: restart from an untried configuration if there is a time budget left, stop otherwise
+        if ( budget == 0 ) {
+          break;
+        }
+        while ( performance[order[nextStart]] >= 0.0 ) {
+          nextStart++;
+        }
+        candidate = order[nextStart];
+        current = candidate;
+        temperature = initialTemperature;
+      } else {
+        candidate = untried[std::rand() % untried.size()];
+      }
+    }
+
+    double pruneTime = 0.0;
+    if ( (pruneMargin > 0.0) && (best.gflops > 0.0) ) {
+      pruneTime = (gflops(outputMode, observation) / best.gflops) * (1.0 + pruneMargin);
+    }
+    performance[candidate] = tune(configurations[candidate], nrIterations, pruneTime, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, observation, cacheDirectory, clContext, clDevices.at(clDeviceID), clQueue, samples->getDeviceBuffer(), output->getDeviceBuffer(), weights->getDeviceBuffer(), profilerPointer);
+    nrTried++;
+    if ( performance[candidate] == TUNE_FAILED ) {
+      performance[candidate] = 0.0;
+      nrFailed++;
+    } else if ( performance[candidate] == 0.0 ) {
+      nrPruned++;
+    }
+    if ( performance[candidate] > best.gflops ) {
+      best.gflops = performance[candidate];
+      best.conf = configurations[candidate];
+    }
+
+    // Move on the lattice
+    if ( nrTried == 1 ) {
+      current = candidate;
+    } else if ( strategy == SEARCH_HILL_CLIMBING ) {
+      if ( performance[candidate] > performance[current] ) {
+        current = candidate;
+      }
+    } else if ( strategy == SEARCH_ANNEALING ) {
+      if ( performance[candidate] > performance[current] ) {
+        current = candidate;
+      } else if ( (temperature > 0.0) && (performance[candidate] > 0.0) && (performance[current] > 0.0) && ((static_cast< double >(std::rand()) / RAND_MAX) < std::exp((performance[candidate] - performance[current]) / (performance[current] * temperature))) ) {
+        current = candidate;
+      }
+      temperature *= coolingRate;
+    }
+  }
+
+  std::cout << std::endl;
+  std::cout << "# tried " << nrTried << " of " << configurations.size() << " configurations, pruned " << nrPruned << ", failed " << nrFailed << std::endl;
+  std::cout << std::endl;
+
+  // Export the records, with the transfer of the output of the last configuration
+  if ( !profileFilename.empty() ) {
+    try {
+      cl::Event outputEvent;
+
+      output->download(true, &outputEvent);
+      RadioAstronomy::recordEvent(profiler, "download_output", "", outputEvent, 0.0, output->size() * sizeof(dataType));
+      RadioAstronomy::writeProfile(profiler, profileFilename);
+    } catch ( cl::Error & err ) {
+      std::cerr << "OpenCL error D2H transfer: " << isa::utils::toString(err.err()) << "." << std::endl;
+      return 1;
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+  }
 
-	std::cout << std::endl;
+  // Store the best configuration; the database does not distinguish kernels that generate their weights or transpose their output
+  if ( !databaseFilename.empty() && !generateWeights && (outputLayout == RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE) && (best.gflops > 0.0) ) {
+    RadioAstronomy::BeamFormerTuningDatabase database;
+
+    best.deviceName = RadioAstronomy::getDeviceKey(clDevices.at(clDeviceID).getInfo< CL_DEVICE_NAME >());
+    best.inputDataType = inputTypeName;
+    best.dataType = typeName;
+    best.outputMode = outputMode;
+    best.nrSamplesPerIntegration = nrSamplesPerIntegration;
+    best.nrBeams = observation.getNrBeams();
+    best.nrStations = observation.getNrStations();
+    best.nrChannels = observation.getNrChannels();
+    best.nrSamples = observation.getNrSamplesPerSecond();
+    try {
+      RadioAstronomy::readBeamFormerTuningDatabase(database, databaseFilename);
+      RadioAstronomy::updateBeamFormerTuningDatabase(database, best);
+      RadioAstronomy::writeBeamFormerTuningDatabase(database, databaseFilename);
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+  }
 
 	return 0;
 }
 
+
+double gflops(const RadioAstronomy::OutputMode outputMode, const AstroData::Observation & observation) {
+  return isa::utils::giga(RadioAstronomy::getBeamFormerFLOP(observation, outputMode));
+}
+
+std::vector< unsigned int > getNeighbours(const std::vector< RadioAstronomy::BeamFormerConf > & configurations, const unsigned int current) {
+  std::vector< unsigned int > neighbours;
+
+  for ( unsigned int configuration = 0; configuration < configurations.size(); configuration++ ) {
+    unsigned int nrDifferences = 0;
+
+    nrDifferences += configurations[configuration].getLocalMem() != configurations[current].getLocalMem();
+    nrDifferences += configurations[configuration].getNrSamplesPerBlock() != configurations[current].getNrSamplesPerBlock();
+    nrDifferences += configurations[configuration].getNrBeamsPerBlock() != configurations[current].getNrBeamsPerBlock();
+    nrDifferences += configurations[configuration].getNrChannelsPerBlock() != configurations[current].getNrChannelsPerBlock();
+    nrDifferences += configurations[configuration].getNrSamplesPerThread() != configurations[current].getNrSamplesPerThread();
+    nrDifferences += configurations[configuration].getNrBeamsPerThread() != configurations[current].getNrBeamsPerThread();
+    nrDifferences += configurations[configuration].getNrStationsPerThread() != configurations[current].getNrStationsPerThread();
+    nrDifferences += configurations[configuration].getNrStationsPerBlock() != configurations[current].getNrStationsPerBlock();
+    nrDifferences += configurations[configuration].getDoubleBuffer() != configurations[current].getDoubleBuffer();
+    if ( nrDifferences == 1 ) {
+      neighbours.push_back(configuration);
+    }
+  }
+  return neighbours;
+}
+
+double tune(const RadioAstronomy::BeamFormerConf & conf, const unsigned int nrIterations, const double pruneTime, const RadioAstronomy::OutputMode outputMode, const unsigned int nrSamplesPerIntegration, const RadioAstronomy::OutputLayout outputLayout, const bool generateWeights, const AstroData::Observation & observation, const std::string & cacheDirectory, cl::Context & clContext, cl::Device & clDevice, cl::CommandQueue & clQueue, cl::Buffer & samples_d, cl::Buffer & output_d, cl::Buffer & weights_d, RadioAstronomy::Profiler * profiler) {
+  double gbs;
+  double weightsBytes = observation.getNrChannels() * observation.getNrStations() * observation.getNrBeams() * 2 * sizeof(float);
+  if ( generateWeights ) {
+    weightsBytes = observation.getNrStations() * observation.getNrBeams() * 4 * sizeof(float);
+  }
+  if ( conf.getLocalMem() ) {
+    gbs = isa::utils::giga((static_cast< long long unsigned int >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations() * (observation.getNrBeams() / (conf.getNrBeamsPerThread() * conf.getNrBeamsPerBlock())) * 4 * sizeof(inputDataType)) + (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration) * RadioAstronomy::getNrOutputValues(outputMode) * sizeof(dataType)) + weightsBytes);
+  } else {
+    gbs = isa::utils::giga((static_cast< long long unsigned int >(observation.getNrChannels()) * observation.getNrSamplesPerSecond() * observation.getNrStations() * (observation.getNrBeams() / conf.getNrBeamsPerThread()) * 4 * sizeof(inputDataType)) + (static_cast< long long unsigned int >(observation.getNrBeams()) * observation.getNrChannels() * RadioAstronomy::getNrOutputSamplesPerSecond(observation, outputMode, nrSamplesPerIntegration) * RadioAstronomy::getNrOutputValues(outputMode) * sizeof(dataType)) + weightsBytes);
+  }
+  // Statistics of the execution time of the kernel on the device
+  unsigned int nrRuns = 0;
+  double time = 0.0;
+  double totalTime = 0.0;
+  double squaredTime = 0.0;
+  cl::Event event;
+  cl::Kernel * kernel;
+
+  // Generate kernel
+  const std::string & code = RadioAstronomy::getBeamFormerOpenCLMemo(conf, outputMode, nrSamplesPerIntegration, outputLayout, generateWeights, inputTypeName, typeName, observation);
+
+  try {
+    kernel = RadioAstronomy::compileCached("beamFormer", code, "-cl-mad-enable -Werror", clContext, clDevice, cacheDirectory);
+  } catch ( isa::OpenCL::OpenCLError & err ) {
+    std::cerr << err.what() << std::endl;
+    return TUNE_FAILED;
+  }
+
+  cl::NDRange global(observation.getNrSamplesPerPaddedSecond() / conf.getNrSamplesPerThread(), observation.getNrBeams() / conf.getNrBeamsPerThread(), observation.getNrChannels() * conf.getNrStationGroups(observation));
+  cl::NDRange local(conf.getNrSamplesPerBlock(), conf.getNrBeamsPerBlock(), conf.getNrChannelsPerBlock() * conf.getNrStationGroups(observation));
+
+  kernel->setArg(0, samples_d);
+  kernel->setArg(1, output_d);
+  kernel->setArg(2, weights_d);
+
+  // Warm-up run
+  try {
+    clQueue.enqueueNDRangeKernel(*kernel, cl::NullRange, global, local, 0, &event);
+    event.wait();
+  } catch ( cl::Error & err ) {
+    std::cerr << "OpenCL error kernel execution: " << isa::utils::toString(err.err()) << "." << std::endl;
+    delete kernel;
+    return TUNE_FAILED;
+  }
+  // Tuning runs
+  try {
+    for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
+      clQueue.enqueueNDRangeKernel(*kernel, cl::NullRange, global, local, 0, &event);
+      event.wait();
+      time = RadioAstronomy::getEventTime(event);
+      nrRuns++;
+      totalTime += time;
+      squaredTime += time * time;
+      if ( profiler != 0 ) {
+        RadioAstronomy::recordEvent(*profiler, "beamFormer", conf.print(), event, RadioAstronomy::getBeamFormerFLOP(observation, outputMode), gbs * 1.0e+09);
+      }
+      if ( (pruneTime > 0.0) && ((totalTime / nrRuns) > pruneTime) ) {
+        delete kernel;
+        return 0.0;
+      }
+    }
+  } catch ( cl::Error & err ) {
+    std::cerr << "OpenCL error kernel execution: " << isa::utils::toString(err.err()) << "." << std::endl;
+    delete kernel;
+    return TUNE_FAILED;
+  }
+  delete kernel;
+  const double averageTime = totalTime / nrRuns;
+  const double standardDeviation = std::sqrt(std::max(0.0, (squaredTime / nrRuns) - (averageTime * averageTime)));
+
+  std::cout << observation.getNrBeams() << " " << observation.getNrStations() << " " << observation.getNrChannels() << " " << observation.getNrSamplesPerSecond() << " ";
+  std::cout << conf.print() << " ";
+  std::cout << std::setprecision(3);
+  std::cout << gflops(outputMode, observation) / averageTime << " ";
+  std::cout << gbs / averageTime << " ";
+  std::cout << std::setprecision(6);
+  std::cout << averageTime << " " << standardDeviation << " ";
+  std::cout << standardDeviation / averageTime <<  std::endl;
+
+  return gflops(outputMode, observation) / averageTime;
+}
@@ -0,0 +1,240 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <iomanip>
+#include <cstdlib>
+#include <ctime>
+#include <omp.h>
+
+#include <ArgumentList.hpp>
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+#include <BeamFormerSIMD.hpp>
+#include <BeamFormerGEMM.hpp>
+#include <BeamFormerBenchmark.hpp>
+#include <Profiler.hpp>
+#include <utils.hpp>
+#include <Timer.hpp>
+
+typedef float inputDataType;
+typedef float dataType;
+
+// Tiles of the benchmark, fixed so that runs can be compared with the baseline
+const unsigned int nrSamplesPerTile = 32;
+const unsigned int nrBeamsPerTile = 8;
+const unsigned int nrStationsPerTile = 16;
+const unsigned int nrStationsPerThread = 32;
+
+// Runs an engine, identified by its name and the option (instruction set or backend) it runs with
+void beamFormer(const std::string & engine, const unsigned int option, const AstroData::Observation & observation, std::vector< inputDataType > & samples, std::vector< dataType > & output, std::vector< float > & weights);
+
+int main(int argc, char * argv[]) {
+  bool updateBaseline = false;
+  unsigned int nrIterations = 0;
+  unsigned int padding = 0;
+  unsigned int maxThreads = 0;
+  double tolerance = 0.1;
+  std::string geometryName;
+  std::string baselineFilename;
+  std::string profileFilename;
+  RadioAstronomy::BeamFormerBenchmarkBaseline baseline;
+
+  try {
+    isa::utils::ArgumentList args(argc, argv);
+
+    try {
+      geometryName = args.getSwitchArgument< std::string >("-geometry");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // All the reference geometries are measured
+    }
+    try {
+      baselineFilename = args.getSwitchArgument< std::string >("-baseline");
+      updateBaseline = args.getSwitch("-update");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // Without a baseline there is nothing to compare with
+    }
+    try {
+      tolerance = args.getSwitchArgument< double >("-tolerance");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // A run is a slowdown if it is more than 10% slower than the baseline
+    }
+    try {
+      profileFilename = args.getSwitchArgument< std::string >("-profile");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The runs are exported only on request
+    }
+    nrIterations = args.getSwitchArgument< unsigned int >("-iterations");
+    padding = args.getSwitchArgument< unsigned int >("-padding");
+    maxThreads = args.getSwitchArgument< unsigned int >("-max_threads");
+  } catch ( isa::utils::EmptyCommandLine & err ) {
+    std::cerr << argv[0] << " [-geometry ...] [-baseline ... [-update] [-tolerance ...]] [-profile ...] -iterations ... -padding ... -max_threads ..." << std::endl;
+    return 1;
+  } catch ( std::exception & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  if ( !baselineFilename.empty() ) {
+    try {
+      RadioAstronomy::readBeamFormerBenchmarkBaseline(baseline, baselineFilename);
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // Every engine is identified by its name and the option it runs with; the sequential engine runs only with one thread
+  std::vector< std::string > engines;
+  std::vector< unsigned int > engineOptions;
+  engines.push_back("sequential");
+  engineOptions.push_back(0);
+  engines.push_back("parallel");
+  engineOptions.push_back(0);
+  engines.push_back("stations");
+  engineOptions.push_back(nrStationsPerThread);
+  for ( unsigned int instructionSet = RadioAstronomy::SIMD_SCALAR; instructionSet <= RadioAstronomy::getSIMDInstructionSet(); instructionSet++ ) {
+    engines.push_back("SIMD");
+    engineOptions.push_back(instructionSet);
+  }
+  for ( unsigned int backend = RadioAstronomy::GEMM_INTERNAL; backend <= RadioAstronomy::getGEMMBackend< inputDataType, dataType >(RadioAstronomy::OUTPUT_VOLTAGES, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE); backend++ ) {
+    engines.push_back("GEMM");
+    engineOptions.push_back(backend);
+  }
+  // Powers of two, and all the threads
+  std::vector< unsigned int > threads;
+  for ( unsigned int nrThreads = 1; nrThreads < maxThreads; nrThreads *= 2 ) {
+    threads.push_back(nrThreads);
+  }
+  threads.push_back(maxThreads);
+
+  std::vector< RadioAstronomy::BeamFormerGeometry > geometries = RadioAstronomy::getReferenceGeometries();
+  RadioAstronomy::Profiler profiler;
+  unsigned int nrSlowdowns = 0;
+
+  std::srand(time(0));
+  std::cout << std::fixed << std::endl;
+  std::cout << "# geometry engine threads nrBeams nrStations nrChannels nrSamples GFLOP/s GB/s time stdDeviation COV baselineGFLOP/s" << std::endl << std::endl;
+  for ( std::vector< RadioAstronomy::BeamFormerGeometry >::const_iterator geometry = geometries.begin(); geometry != geometries.end(); ++geometry ) {
+    if ( !geometryName.empty() && (geometry->name != geometryName) ) {
+      continue;
+    }
+    AstroData::Observation observation = geometry->getObservation(padding);
+
+    // Allocate host memory
+    std::vector< inputDataType > samples = std::vector< inputDataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4);
+    std::vector< dataType > output = std::vector< dataType >(RadioAstronomy::getOutputSize(observation, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE));
+    std::vector< float > weights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
+    std::fill(weights.begin(), weights.end(), std::rand() % 100);
+    std::fill(samples.begin(), samples.end(), std::rand() % 100);
+    const double flop = RadioAstronomy::getBeamFormerFLOP(observation, RadioAstronomy::OUTPUT_VOLTAGES);
+
+    for ( unsigned int engine = 0; engine < engines.size(); engine++ ) {
+      std::string engineName = engines[engine];
+
+      if ( engineName == "SIMD" ) {
+        engineName += "_" + RadioAstronomy::getSIMDInstructionSetName(static_cast< RadioAstronomy::SIMDInstructionSet >(engineOptions[engine]));
+      } else if ( engineName == "GEMM" ) {
+        engineName += "_" + RadioAstronomy::getGEMMBackendName(static_cast< RadioAstronomy::GEMMBackend >(engineOptions[engine]));
+      }
+      // The sequential engine goes through all the beams for every sample
+      const double bytes = RadioAstronomy::getBeamFormerTiledBytes(observation, (engines[engine] == "sequential") ? observation.getNrBeams() : nrBeamsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, sizeof(inputDataType), sizeof(dataType));
+
+      for ( std::vector< unsigned int >::const_iterator nrThreads = threads.begin(); nrThreads != threads.end(); ++nrThreads ) {
+        if ( (engines[engine] == "sequential") && (*nrThreads > 1) ) {
+          break;
+        }
+        isa::utils::Timer timer;
+        RadioAstronomy::BeamFormerBenchmarkEntry entry;
+
+        omp_set_num_threads(*nrThreads);
+        // Warm-up run
+        beamFormer(engines[engine], engineOptions[engine], observation, samples, output, weights);
+        // Benchmark runs
+        for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
+          const double started = profiler.now();
+
+          timer.start();
+          beamFormer(engines[engine], engineOptions[engine], observation, samples, output, weights);
+          timer.stop();
+          const double ended = profiler.now();
+
+          profiler.record(engineName, geometry->name + " " + isa::utils::toString(*nrThreads), started, ended, ended - started, flop, bytes);
+        }
+        entry.geometry = geometry->name;
+        entry.engine = engineName;
+        entry.nrThreads = *nrThreads;
+        entry.gflops = isa::utils::giga(flop) / timer.getAverageTime();
+        const RadioAstronomy::BeamFormerBenchmarkEntry * reference = RadioAstronomy::findBeamFormerBenchmarkEntry(baseline, entry);
+
+        std::cout << geometry->name << " " << engineName << " " << *nrThreads << " ";
+        std::cout << observation.getNrBeams() << " " << observation.getNrStations() << " " << observation.getNrChannels() << " " << observation.getNrSamplesPerSecond() << " ";
+        std::cout << std::setprecision(3);
+        std::cout << entry.gflops << " ";
+        std::cout << isa::utils::giga(bytes) / timer.getAverageTime() << " ";
+        std::cout << std::setprecision(6);
+        std::cout << timer.getAverageTime() << " " << timer.getStandardDeviation() << " ";
+        std::cout << timer.getCoefficientOfVariation() << " ";
+        std::cout << std::setprecision(3);
+        if ( reference != 0 ) {
+          std::cout << reference->gflops << std::endl;
+        } else {
+          std::cout << "-" << std::endl;
+        }
+        if ( updateBaseline ) {
+          RadioAstronomy::updateBeamFormerBenchmarkBaseline(baseline, entry);
+        } else if ( (reference != 0) && (entry.gflops < (reference->gflops * (1.0 - tolerance))) ) {
+          std::cerr << "Slowdown: " << geometry->name << " " << engineName << " " << *nrThreads << " threads, " << entry.gflops << " GFLOP/s instead of " << reference->gflops << "." << std::endl;
+          nrSlowdowns++;
+        }
+      }
+    }
+  }
+  std::cout << std::endl;
+
+  try {
+    if ( updateBaseline ) {
+      RadioAstronomy::writeBeamFormerBenchmarkBaseline(baseline, baselineFilename);
+    }
+    if ( !profileFilename.empty() ) {
+      RadioAstronomy::writeProfile(profiler, profileFilename);
+    }
+  } catch ( std::exception & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+  // A slowdown fails the run
+  if ( nrSlowdowns > 0 ) {
+    std::cerr << "Runs slower than the baseline, with tolerance " << tolerance << ": " << nrSlowdowns << "." << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+void beamFormer(const std::string & engine, const unsigned int option, const AstroData::Observation & observation, std::vector< inputDataType > & samples, std::vector< dataType > & output, std::vector< float > & weights) {
+  if ( engine == "sequential" ) {
+    RadioAstronomy::beamFormer< inputDataType, dataType >(observation, samples, output, weights);
+  } else if ( engine == "parallel" ) {
+    RadioAstronomy::beamFormerParallel< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile);
+  } else if ( engine == "stations" ) {
+    RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, option);
+  } else if ( engine == "SIMD" ) {
+    RadioAstronomy::beamFormerSIMD< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, static_cast< RadioAstronomy::SIMDInstructionSet >(option));
+  } else if ( engine == "GEMM" ) {
+    RadioAstronomy::beamFormerGEMM< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, static_cast< RadioAstronomy::GEMMBackend >(option));
+  }
+}
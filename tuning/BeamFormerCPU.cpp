@@ -0,0 +1,272 @@
+// Copyright 2014 Alessio Sclocco <a.sclocco@vu.nl>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <exception>
+#include <iomanip>
+#include <cstdlib>
+#include <ctime>
+#include <omp.h>
+
+#include <ArgumentList.hpp>
+#include <Observation.hpp>
+#include <BeamFormer.hpp>
+#include <BeamFormerSIMD.hpp>
+#include <BeamFormerGEMM.hpp>
+#include <BeamFormerUnrolled.hpp>
+#include <Profiler.hpp>
+#include <utils.hpp>
+#include <Timer.hpp>
+
+#if defined(BEAM_FORMER_INPUT_CHAR)
+typedef char inputDataType;
+#elif defined(BEAM_FORMER_INPUT_SHORT)
+typedef short inputDataType;
+#else
+typedef float inputDataType;
+#endif
+typedef float dataType;
+
+
+// With nrStationsPerThread > 0 the stations of every tile are split over the threads; with profiler the stages of the engine are recorded
+// With unrolled, the tiles are computed by that instantiation of the unrolled kernel
+void beamFormer(const bool simd, const bool gemm, RadioAstronomy::TileFunction< inputDataType, dataType >::type unrolled, const AstroData::Observation & observation, std::vector< inputDataType > & samples, std::vector< dataType > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const unsigned int nrStationsPerThread, RadioAstronomy::Profiler * profiler = 0);
+
+int main(int argc, char * argv[]) {
+  bool simd = false;
+  bool gemm = false;
+  bool unrolled = false;
+  unsigned int nrIterations = 0;
+  unsigned int maxThreads = 0;
+  unsigned int maxSamplesPerTile = 0;
+  unsigned int maxBeamsPerTile = 0;
+  unsigned int maxStationsPerTile = 0;
+  double peakGFLOPs = 0.0;
+  double peakGBs = 0.0;
+  std::string profileFilename;
+  AstroData::Observation observation;
+
+  try {
+    isa::utils::ArgumentList args(argc, argv);
+
+    simd = args.getSwitch("-simd");
+    gemm = args.getSwitch("-gemm");
+    unrolled = args.getSwitch("-unrolled");
+    try {
+      profileFilename = args.getSwitchArgument< std::string >("-profile");
+    } catch ( isa::utils::SwitchNotFound & err ) {
+      // The stages of the engines are recorded only on request
+    }
+    if ( args.getSwitch("-roofline") ) {
+      peakGFLOPs = args.getSwitchArgument< double >("-peak_gflops");
+      peakGBs = args.getSwitchArgument< double >("-peak_gbs");
+    }
+    nrIterations = args.getSwitchArgument< unsigned int >("-iterations");
+    observation.setPadding(args.getSwitchArgument< unsigned int >("-padding"));
+    maxThreads = args.getSwitchArgument< unsigned int >("-max_threads");
+    maxSamplesPerTile = args.getSwitchArgument< unsigned int >("-max_tile_samples");
+    maxBeamsPerTile = args.getSwitchArgument< unsigned int >("-max_tile_beams");
+    maxStationsPerTile = args.getSwitchArgument< unsigned int >("-max_tile_stations");
+    observation.setNrBeams(args.getSwitchArgument< unsigned int >("-beams"));
+    observation.setNrStations(args.getSwitchArgument< unsigned int >("-stations"));
+    observation.setFrequencyRange(args.getSwitchArgument< unsigned int >("-channels"), 0, 0);
+    observation.setNrSamplesPerSecond(args.getSwitchArgument< unsigned int >("-samples"));
+  } catch ( isa::utils::EmptyCommandLine & err ) {
+    std::cerr << argv[0] << " [-simd | -gemm | -unrolled] [-profile ... [-roofline -peak_gflops ... -peak_gbs ...]] -iterations ... -padding ... -max_threads ... -max_tile_samples ... -max_tile_beams ... -max_tile_stations ... -beams ... -stations ... -samples ... -channels ..." << std::endl;
+    return 1;
+  } catch ( std::exception & err ) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+
+  // Allocate host memory
+  std::vector< inputDataType > samples = std::vector< inputDataType >(observation.getNrChannels() * observation.getNrStations() * observation.getNrSamplesPerPaddedSecond() * 4);
+  std::vector< dataType > output = std::vector< dataType >(observation.getNrBeams() * observation.getNrChannels() * observation.getNrSamplesPerPaddedSecond() * 4);
+  std::vector< float > weights = std::vector< float >(observation.getNrChannels() * observation.getNrStations() * observation.getNrPaddedBeams() * 2);
+  std::srand(time(0));
+  std::fill(weights.begin(), weights.end(), std::rand() % 100);
+  std::fill(samples.begin(), samples.end(), std::rand() % 100);
+
+  double gflops = isa::utils::giga(RadioAstronomy::getBeamFormerFLOP(observation, RadioAstronomy::OUTPUT_VOLTAGES));
+  RadioAstronomy::Profiler profiler(peakGFLOPs, peakGBs);
+  RadioAstronomy::Profiler * profilerPointer = profileFilename.empty() ? 0 : &profiler;
+  double bestGflops = 0.0;
+  unsigned int bestSamplesPerTile = 0;
+  unsigned int bestBeamsPerTile = 0;
+  unsigned int bestStationsPerTile = 0;
+  unsigned int bestStationsPerThread = 0;
+  // In unrolled mode every instantiation that can compute the observation is tuned, the other engines have a single empty kernel
+  std::vector< RadioAstronomy::BeamFormerUnrolledKernel< inputDataType, dataType > > kernels(1);
+  unsigned int bestKernel = 0;
+
+  if ( unrolled ) {
+    RadioAstronomy::getBeamFormerUnrolledKernels< inputDataType, dataType >(observation, kernels);
+  }
+
+  std::cout << std::fixed << std::endl;
+  if ( simd ) {
+    std::cout << "# " << RadioAstronomy::getSIMDInstructionSetName(RadioAstronomy::getSIMDInstructionSet()) << std::endl;
+  } else if ( gemm ) {
+    std::cout << "# GEMM " << RadioAstronomy::getGEMMBackendName(RadioAstronomy::getGEMMBackend< inputDataType, dataType >(RadioAstronomy::OUTPUT_VOLTAGES, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE)) << std::endl;
+  } else if ( unrolled ) {
+    std::cout << "# unrolled, " << kernels.size() << " instantiations" << std::endl;
+  }
+  std::cout << "# nrBeams nrStations nrChannels nrSamples threads samplesPerTile beamsPerTile stationsPerTile ";
+  if ( unrolled ) {
+    std::cout << "samplesPerIteration beamsPerIteration fixedStations ";
+  }
+  std::cout << "GFLOP/s GB/s time stdDeviation COV" << std::endl << std::endl;
+
+  // Find the tile sizes, and the instantiation of the unrolled kernel, using all threads
+  omp_set_num_threads(maxThreads);
+  for ( unsigned int kernel = 0; kernel < kernels.size(); kernel++ ) {
+    for ( unsigned int samplesPerTile = 4; samplesPerTile <= maxSamplesPerTile; samplesPerTile *= 2 ) {
+      for ( unsigned int beamsPerTile = 1; beamsPerTile <= maxBeamsPerTile; beamsPerTile *= 2 ) {
+        for ( unsigned int stationsPerTile = 1; stationsPerTile <= maxStationsPerTile; stationsPerTile *= 2 ) {
+          if ( (kernels[kernel].nrStations > 0) && (stationsPerTile > 1) ) {
+            // Instantiations with a fixed number of stations do not use station tiles
+            continue;
+          }
+          // The samples of a station tile are read once per beam tile
+          double gbs = isa::utils::giga(RadioAstronomy::getBeamFormerTiledBytes(observation, beamsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, sizeof(inputDataType), sizeof(dataType)));
+          isa::utils::Timer timer;
+
+          // Warm-up run
+          beamFormer(simd, gemm, kernels[kernel].tileFunction, observation, samples, output, weights, samplesPerTile, beamsPerTile, stationsPerTile, 0);
+          // Tuning runs
+          for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
+            timer.start();
+            beamFormer(simd, gemm, kernels[kernel].tileFunction, observation, samples, output, weights, samplesPerTile, beamsPerTile, stationsPerTile, 0, profilerPointer);
+            timer.stop();
+          }
+          if ( gflops / timer.getAverageTime() > bestGflops ) {
+            bestGflops = gflops / timer.getAverageTime();
+            bestSamplesPerTile = samplesPerTile;
+            bestBeamsPerTile = beamsPerTile;
+            bestStationsPerTile = stationsPerTile;
+            bestKernel = kernel;
+          }
+
+          std::cout << observation.getNrBeams() << " " << observation.getNrStations() << " " << observation.getNrChannels() << " " << observation.getNrSamplesPerSecond() << " ";
+          std::cout << maxThreads << " " << samplesPerTile << " " << beamsPerTile << " " << stationsPerTile << " ";
+          if ( unrolled ) {
+            std::cout << kernels[kernel].print() << " ";
+          }
+          std::cout << std::setprecision(3);
+          std::cout << gflops / timer.getAverageTime() << " ";
+          std::cout << gbs / timer.getAverageTime() << " ";
+          std::cout << std::setprecision(6);
+          std::cout << timer.getAverageTime() << " " << timer.getStandardDeviation() << " ";
+          std::cout << timer.getCoefficientOfVariation() <<  std::endl;
+        }
+      }
+    }
+  }
+  if ( unrolled ) {
+    std::cout << std::endl;
+    std::cout << "# best instantiation: samplesPerIteration beamsPerIteration fixedStations" << std::endl;
+    std::cout << kernels[bestKernel].print() << std::endl;
+  }
+
+  // Split the stations of the best tiles over the threads, instead of distributing the tiles
+  std::cout << std::endl;
+  std::cout << "# nrBeams nrStations nrChannels nrSamples threads samplesPerTile beamsPerTile stationsPerTile stationsPerThread GFLOP/s time stdDeviation COV" << std::endl << std::endl;
+  for ( unsigned int stationsPerThread = 1; stationsPerThread < observation.getNrStations(); stationsPerThread *= 2 ) {
+    isa::utils::Timer timer;
+
+    beamFormer(simd, gemm, kernels[bestKernel].tileFunction, observation, samples, output, weights, bestSamplesPerTile, bestBeamsPerTile, bestStationsPerTile, stationsPerThread);
+    for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
+      timer.start();
+      beamFormer(simd, gemm, kernels[bestKernel].tileFunction, observation, samples, output, weights, bestSamplesPerTile, bestBeamsPerTile, bestStationsPerTile, stationsPerThread, profilerPointer);
+      timer.stop();
+    }
+    if ( gflops / timer.getAverageTime() > bestGflops ) {
+      bestGflops = gflops / timer.getAverageTime();
+      bestStationsPerThread = stationsPerThread;
+    }
+
+    std::cout << observation.getNrBeams() << " " << observation.getNrStations() << " " << observation.getNrChannels() << " " << observation.getNrSamplesPerSecond() << " ";
+    std::cout << maxThreads << " " << bestSamplesPerTile << " " << bestBeamsPerTile << " " << bestStationsPerTile << " " << stationsPerThread << " ";
+    std::cout << std::setprecision(3);
+    std::cout << gflops / timer.getAverageTime() << " ";
+    std::cout << std::setprecision(6);
+    std::cout << timer.getAverageTime() << " " << timer.getStandardDeviation() << " ";
+    std::cout << timer.getCoefficientOfVariation() <<  std::endl;
+  }
+
+  // Per-core scaling of the best configuration
+  double singleThreadTime = 0.0;
+
+  std::cout << std::endl;
+  std::cout << "# threads samplesPerTile beamsPerTile stationsPerTile stationsPerThread GFLOP/s speedup efficiency time stdDeviation COV" << std::endl << std::endl;
+  for ( unsigned int threads = 1; threads <= maxThreads; threads++ ) {
+    isa::utils::Timer timer;
+
+    omp_set_num_threads(threads);
+    beamFormer(simd, gemm, kernels[bestKernel].tileFunction, observation, samples, output, weights, bestSamplesPerTile, bestBeamsPerTile, bestStationsPerTile, bestStationsPerThread);
+    for ( unsigned int iteration = 0; iteration < nrIterations; iteration++ ) {
+      timer.start();
+      beamFormer(simd, gemm, kernels[bestKernel].tileFunction, observation, samples, output, weights, bestSamplesPerTile, bestBeamsPerTile, bestStationsPerTile, bestStationsPerThread);
+      timer.stop();
+    }
+    if ( threads == 1 ) {
+      singleThreadTime = timer.getAverageTime();
+    }
+
+    std::cout << threads << " " << bestSamplesPerTile << " " << bestBeamsPerTile << " " << bestStationsPerTile << " " << bestStationsPerThread << " ";
+    std::cout << std::setprecision(3);
+    std::cout << gflops / timer.getAverageTime() << " ";
+    std::cout << singleThreadTime / timer.getAverageTime() << " ";
+    std::cout << singleThreadTime / (timer.getAverageTime() * threads) << " ";
+    std::cout << std::setprecision(6);
+    std::cout << timer.getAverageTime() << " " << timer.getStandardDeviation() << " ";
+    std::cout << timer.getCoefficientOfVariation() <<  std::endl;
+  }
+
+  std::cout << std::endl;
+
+  if ( !profileFilename.empty() ) {
+    try {
+      RadioAstronomy::writeProfile(profiler, profileFilename);
+    } catch ( std::exception & err ) {
+      std::cerr << err.what() << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void beamFormer(const bool simd, const bool gemm, RadioAstronomy::TileFunction< inputDataType, dataType >::type unrolled, const AstroData::Observation & observation, std::vector< inputDataType > & samples, std::vector< dataType > & output, std::vector< float > & weights, const unsigned int nrSamplesPerTile, const unsigned int nrBeamsPerTile, const unsigned int nrStationsPerTile, const unsigned int nrStationsPerThread, RadioAstronomy::Profiler * profiler) {
+  if ( (nrStationsPerThread > 0) && (unrolled != 0) ) {
+    RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, nrStationsPerThread, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, unrolled, profiler);
+  } else if ( (nrStationsPerThread > 0) && simd ) {
+    RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, nrStationsPerThread, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, RadioAstronomy::getBeamFormerTileSIMD< inputDataType, dataType >(RadioAstronomy::getSIMDInstructionSet()), profiler);
+  } else if ( (nrStationsPerThread > 0) && gemm ) {
+    RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, nrStationsPerThread, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, RadioAstronomy::beamFormerTileGEMM< inputDataType, dataType >, profiler);
+  } else if ( nrStationsPerThread > 0 ) {
+    RadioAstronomy::beamFormerParallelStations< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, nrStationsPerThread, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, RadioAstronomy::beamFormerTile< inputDataType, dataType >, profiler);
+  } else if ( unrolled != 0 ) {
+    RadioAstronomy::beamFormerTiled< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, unrolled, 0, profiler);
+  } else if ( simd ) {
+    RadioAstronomy::beamFormerSIMD< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, RadioAstronomy::getSIMDInstructionSet(), profiler);
+  } else if ( gemm ) {
+    RadioAstronomy::beamFormerGEMM< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, RadioAstronomy::getGEMMBackend< inputDataType, dataType >(RadioAstronomy::OUTPUT_VOLTAGES, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE), profiler);
+  } else {
+    RadioAstronomy::beamFormerParallel< inputDataType, dataType >(observation, samples, output, weights, nrSamplesPerTile, nrBeamsPerTile, nrStationsPerTile, RadioAstronomy::OUTPUT_VOLTAGES, 1, RadioAstronomy::LAYOUT_BEAM_CHANNEL_SAMPLE, profiler);
+  }
+}
+